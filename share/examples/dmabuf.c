@@ -0,0 +1,316 @@
+/* Virtual camera dma-buf example.
+ * Copyright (C) 2020  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Alternatively you can redistribute this file under the terms of the
+ * BSD license as stated below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. The names of its contributors may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/dma-buf.h>
+#include <linux/udmabuf.h>
+#include <linux/videodev2.h>
+
+/* For the sake of simplicity, the program does very little validation, you are
+ * adviced the check every single value returned by ioctl() and other
+ * functions.
+ * This program shows how to share frames with the driver through dma-bufs
+ * without any copy in user space:
+ *
+ * - The frames are written to buffers allocated with udmabuf, and imported in
+ *   the output device with V4L2_MEMORY_DMABUF. The output device must have the
+ *   'dmabuf' mode enabled.
+ * - The capture device buffers are exported with VIDIOC_EXPBUF, and the frames
+ *   are read mapping the exported dma-bufs.
+ *
+ * Every frame is filled with a single value, the program checks that the
+ * frames read from the capture device are not torn nor stale, and returns a
+ * non zero value if any of them is.
+ */
+
+// We'll assume these are a valid and connected akvcam output and capture.
+#define VIDEO_OUTPUT "/dev/video7"
+#define VIDEO_CAPTURE "/dev/video0"
+
+// Choose the number of buffers to use in each device.
+#define N_BUFFERS 4
+
+// Send frames for about 10 seconds in a 30 FPS stream.
+#define FPS 30
+#define DURATION_SECONDS 10
+#define N_FRAMES (FPS * DURATION_SECONDS)
+
+// This structure will store the frames data.
+struct DataBuffer
+{
+    int fd;
+    char *start;
+    size_t length;
+};
+
+// The output and capture formats must match, so the frames are not converted.
+static void setFormat(int fd, enum v4l2_buf_type type, struct v4l2_format *fmt)
+{
+    memset(fmt, 0, sizeof(struct v4l2_format));
+    fmt->type = type;
+    ioctl(fd, VIDIOC_G_FMT, fmt);
+    fmt->fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+    fmt->fmt.pix.width = 640;
+    fmt->fmt.pix.height = 480;
+    ioctl(fd, VIDIOC_S_FMT, fmt);
+}
+
+// udmabuf needs a sealed memfd with a size multiple of the page size.
+static void createUdmabuf(int udmabuf, size_t size, struct DataBuffer *buffer)
+{
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    struct udmabuf_create create;
+    int memfd;
+
+    buffer->length = (size + pageSize - 1) / pageSize * pageSize;
+    memfd = memfd_create("akvcam-frame", MFD_ALLOW_SEALING);
+    ftruncate(memfd, (off_t) buffer->length);
+    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK);
+
+    memset(&create, 0, sizeof(struct udmabuf_create));
+    create.memfd = (__u32) memfd;
+    create.offset = 0;
+    create.size = buffer->length;
+    buffer->fd = ioctl(udmabuf, UDMABUF_CREATE, &create);
+    buffer->start = mmap(NULL,
+                         buffer->length,
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED,
+                         buffer->fd,
+                         0);
+    close(memfd);
+}
+
+static void syncBuffer(int fd, __u64 flags)
+{
+    struct dma_buf_sync sync;
+    sync.flags = flags;
+    ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+}
+
+int main()
+{
+    int output = open(VIDEO_OUTPUT, O_RDWR | O_NONBLOCK, 0);
+    int capture = open(VIDEO_CAPTURE, O_RDWR | O_NONBLOCK, 0);
+    int udmabuf = open("/dev/udmabuf", O_RDWR, 0);
+
+    if (output < 0 || capture < 0 || udmabuf < 0) {
+        fprintf(stderr, "Can't open the devices\n");
+
+        return -1;
+    }
+
+    struct v4l2_format outputFmt;
+    struct v4l2_format captureFmt;
+    setFormat(output, V4L2_BUF_TYPE_VIDEO_OUTPUT, &outputFmt);
+    setFormat(capture, V4L2_BUF_TYPE_VIDEO_CAPTURE, &captureFmt);
+
+    // Import the udmabuf buffers in the output device.
+    struct v4l2_requestbuffers requestBuffers;
+    memset(&requestBuffers, 0, sizeof(struct v4l2_requestbuffers));
+    requestBuffers.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    requestBuffers.memory = V4L2_MEMORY_DMABUF;
+    requestBuffers.count = N_BUFFERS;
+
+    if (ioctl(output, VIDIOC_REQBUFS, &requestBuffers) < 0) {
+        fprintf(stderr, "The output device doesn't support 'dmabuf'\n");
+
+        return -1;
+    }
+
+    struct DataBuffer outputBuffers[N_BUFFERS];
+    __u32 nOutputBuffers = requestBuffers.count;
+
+    for (__u32 i = 0; i < nOutputBuffers; i++) {
+        createUdmabuf(udmabuf, outputFmt.fmt.pix.sizeimage, outputBuffers + i);
+        memset(outputBuffers[i].start, 0, outputBuffers[i].length);
+
+        struct v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(struct v4l2_buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buffer.memory = V4L2_MEMORY_DMABUF;
+        buffer.index = i;
+        buffer.m.fd = outputBuffers[i].fd;
+        buffer.length = (__u32) outputBuffers[i].length;
+        buffer.bytesused = outputFmt.fmt.pix.sizeimage;
+        ioctl(output, VIDIOC_QBUF, &buffer);
+    }
+
+    // Export the capture buffers as dma-bufs.
+    memset(&requestBuffers, 0, sizeof(struct v4l2_requestbuffers));
+    requestBuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    requestBuffers.memory = V4L2_MEMORY_MMAP;
+    requestBuffers.count = N_BUFFERS;
+    ioctl(capture, VIDIOC_REQBUFS, &requestBuffers);
+
+    struct DataBuffer captureBuffers[N_BUFFERS];
+    __u32 nCaptureBuffers = requestBuffers.count;
+
+    for (__u32 i = 0; i < nCaptureBuffers; i++) {
+        struct v4l2_exportbuffer exportBuffer;
+        memset(&exportBuffer, 0, sizeof(struct v4l2_exportbuffer));
+        exportBuffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        exportBuffer.index = i;
+        exportBuffer.flags = O_RDONLY | O_CLOEXEC;
+        ioctl(capture, VIDIOC_EXPBUF, &exportBuffer);
+
+        struct v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(struct v4l2_buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = i;
+        ioctl(capture, VIDIOC_QUERYBUF, &buffer);
+
+        captureBuffers[i].fd = exportBuffer.fd;
+        captureBuffers[i].length = buffer.length;
+        captureBuffers[i].start = mmap(NULL,
+                                       buffer.length,
+                                       PROT_READ,
+                                       MAP_SHARED,
+                                       exportBuffer.fd,
+                                       0);
+        ioctl(capture, VIDIOC_QBUF, &buffer);
+    }
+
+    // Start the streams.
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    ioctl(output, VIDIOC_STREAMON, &type);
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    ioctl(capture, VIDIOC_STREAMON, &type);
+
+    int framesRead = 0;
+    int badFrames = 0;
+
+    for (int i = 0; i < N_FRAMES; i++) {
+        // Write a new frame to any buffer returned by the output device.
+        struct v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(struct v4l2_buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buffer.memory = V4L2_MEMORY_DMABUF;
+
+        if (ioctl(output, VIDIOC_DQBUF, &buffer) == 0) {
+            struct DataBuffer *data = outputBuffers + buffer.index;
+
+            syncBuffer(data->fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE);
+            memset(data->start, (i % 255) + 1, outputFmt.fmt.pix.sizeimage);
+            syncBuffer(data->fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE);
+
+            buffer.m.fd = data->fd;
+            buffer.length = (__u32) data->length;
+            buffer.bytesused = outputFmt.fmt.pix.sizeimage;
+            ioctl(output, VIDIOC_QBUF, &buffer);
+        }
+
+        // Check every frame received in the capture device.
+        memset(&buffer, 0, sizeof(struct v4l2_buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+
+        if (ioctl(capture, VIDIOC_DQBUF, &buffer) == 0) {
+            struct DataBuffer *data = captureBuffers + buffer.index;
+
+            syncBuffer(data->fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+
+            int uniform = 1;
+
+            for (__u32 byte = 1; byte < buffer.bytesused && uniform; byte++)
+                uniform = data->start[byte] == data->start[0];
+
+            /* Skip the default frames sent before the first output frame,
+             * then every frame must be filled with a single value.
+             */
+            if (framesRead > 0 || (uniform && data->start[0] != 0)) {
+                framesRead++;
+
+                if (!uniform)
+                    badFrames++;
+            }
+
+            syncBuffer(data->fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+            ioctl(capture, VIDIOC_QBUF, &buffer);
+        }
+
+        struct timespec ts;
+        ts.tv_sec = 0;
+        ts.tv_nsec = 1e9 / FPS;
+        nanosleep(&ts, &ts);
+    }
+
+    // Stop the streams.
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    ioctl(capture, VIDIOC_STREAMOFF, &type);
+    type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    ioctl(output, VIDIOC_STREAMOFF, &type);
+
+    // Free the buffers.
+    for (__u32 i = 0; i < nCaptureBuffers; i++) {
+        munmap(captureBuffers[i].start, captureBuffers[i].length);
+        close(captureBuffers[i].fd);
+    }
+
+    for (__u32 i = 0; i < nOutputBuffers; i++) {
+        munmap(outputBuffers[i].start, outputBuffers[i].length);
+        close(outputBuffers[i].fd);
+    }
+
+    close(udmabuf);
+    close(capture);
+    close(output);
+
+    printf("Frames read: %d, bad frames: %d\n", framesRead, badFrames);
+
+    return framesRead > 0 && badFrames == 0? 0: -1;
+}
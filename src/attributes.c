@@ -22,7 +22,9 @@
 #include "attributes.h"
 #include "controls.h"
 #include "device.h"
+#include "frame_pyramid.h"
 #include "list.h"
+#include "stats.h"
 
 static const struct attribute_group *akvcam_attributes_capture_groups[2];
 static const struct attribute_group *akvcam_attributes_output_groups[2];
@@ -136,6 +138,52 @@ static ssize_t akvcam_attributes_streaming_devices_show(struct device *dev,
     return n;
 }
 
+static ssize_t akvcam_attributes_pyramid_show(struct device *dev,
+                                              struct device_attribute *attribute,
+                                              char *buffer)
+{
+    struct video_device *vdev = to_video_device(dev);
+    akvcam_device_t device = video_get_drvdata(vdev);
+
+    UNUSED(attribute);
+    memset(buffer, 0, PAGE_SIZE);
+
+    return akvcam_frame_pyramid_stats(akvcam_device_frame_pyramid_nr(device),
+                                      buffer,
+                                      PAGE_SIZE);
+}
+
+static ssize_t akvcam_attributes_stats_show(struct device *dev,
+                                            struct device_attribute *attribute,
+                                            char *buffer)
+{
+    struct video_device *vdev = to_video_device(dev);
+    akvcam_device_t device = video_get_drvdata(vdev);
+
+    UNUSED(attribute);
+    memset(buffer, 0, PAGE_SIZE);
+
+    return akvcam_stats_print(akvcam_device_stats_nr(device),
+                              buffer,
+                              PAGE_SIZE);
+}
+
+// Writing anything to the attribute resets the statistics.
+static ssize_t akvcam_attributes_stats_store(struct device *dev,
+                                             struct device_attribute *attribute,
+                                             const char *buffer,
+                                             size_t size)
+{
+    struct video_device *vdev = to_video_device(dev);
+    akvcam_device_t device = video_get_drvdata(vdev);
+
+    UNUSED(attribute);
+    UNUSED(buffer);
+    akvcam_stats_reset(akvcam_device_stats_nr(device));
+
+    return size;
+}
+
 static ssize_t akvcam_attributes_device_modes_show(struct device *dev,
                                                    struct device_attribute *attribute,
                                                    char *buffer)
@@ -261,10 +309,18 @@ static DEVICE_ATTR(broadcasters,
                    S_IRUGO,
                    akvcam_attributes_streaming_devices_show,
                    NULL);
+static DEVICE_ATTR(stats,
+                   S_IRUGO | S_IWUSR,
+                   akvcam_attributes_stats_show,
+                   akvcam_attributes_stats_store);
 static DEVICE_ATTR(modes,
                    S_IRUGO,
                    akvcam_attributes_device_modes_show,
                    NULL);
+static DEVICE_ATTR(pyramid,
+                   S_IRUGO,
+                   akvcam_attributes_pyramid_show,
+                   NULL);
 static DEVICE_ATTR(brightness,
                    S_IRUGO | S_IWUSR,
                    akvcam_attributes_int_show,
@@ -315,6 +371,7 @@ static DEVICE_ATTR(swap_rgb,
 static struct attribute	*akvcam_attributes_capture[] = {
     &dev_attr_connected_devices.attr,
     &dev_attr_broadcasters.attr,
+    &dev_attr_stats.attr,
     &dev_attr_modes.attr,
     &dev_attr_brightness.attr,
     &dev_attr_contrast.attr,
@@ -342,12 +399,14 @@ static const struct attribute_group *akvcam_attributes_capture_groups[] = {
 static struct attribute	*akvcam_attributes_output[] = {
     &dev_attr_connected_devices.attr,
     &dev_attr_listeners.attr,
+    &dev_attr_stats.attr,
     &dev_attr_modes.attr,
     &dev_attr_hflip.attr,
     &dev_attr_vflip.attr,
     &dev_attr_aspect_ratio.attr,
     &dev_attr_scaling.attr,
     &dev_attr_swap_rgb.attr,
+    &dev_attr_pyramid.attr,
     NULL
 };
 
@@ -16,21 +16,46 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define AKVCAM_LOG_CATEGORY AKVCAM_LOG_CATEGORY_BUFFERS
+
+#include <linux/dma-buf.h>
 #include <linux/kref.h>
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <media/v4l2-common.h>
 #include <media/videobuf2-vmalloc.h>
 
+#if IS_ENABLED(CONFIG_VIDEOBUF2_DMA_SG)
+#include <media/videobuf2-dma-sg.h>
+#endif
+
+#if IS_ENABLED(CONFIG_VIDEOBUF2_DMA_CONTIG)
+#include <media/videobuf2-dma-contig.h>
+#endif
+
 #include "buffers.h"
 #include "device.h"
 #include "format.h"
 #include "format_specs_types.h"
 #include "frame.h"
 #include "log.h"
+#include "overlay.h"
+#include "trace.h"
 
 #define AKVCAM_BUFFERS_MIN 2
 
+typedef struct
+{
+    AKVCAM_MEMORY_BACKEND backend;
+    char str[32];
+} akvcam_buffers_memory_backend_strings;
+
+static const akvcam_buffers_memory_backend_strings akvcam_buffers_memory_backend_strs[] = {
+    {AKVCAM_MEMORY_BACKEND_VMALLOC   , "vmalloc"   },
+    {AKVCAM_MEMORY_BACKEND_DMA_SG    , "dma-sg"    },
+    {AKVCAM_MEMORY_BACKEND_DMA_CONTIG, "dma-contig"},
+};
+
 typedef struct {
     struct vb2_v4l2_buffer vb;
     struct list_head list;
@@ -46,11 +71,15 @@ struct akvcam_buffers
     struct mutex buffers_mutex;
     struct mutex frames_mutex;
     akvcam_format_t format;
+    akvcam_overlay_t overlay;
     akvcam_signal_callback(buffers, streaming_started);
     akvcam_signal_callback(buffers, streaming_stopped);
     enum v4l2_buf_type type;
     AKVCAM_RW_MODE rw_mode;
+    AKVCAM_MEMORY_BACKEND memory_backend;
     __u32 sequence;
+    int32_t device_num;
+    bool timestamp_copy;
 };
 
 akvcam_signal_define(buffers, streaming_started)
@@ -80,6 +109,7 @@ akvcam_buffers_t akvcam_buffers_new(AKVCAM_RW_MODE rw_mode,
     self->rw_mode = rw_mode;
     self->type = type;
     self->format = akvcam_format_new(0, 0, 0, NULL);
+    self->device_num = -1;
     self->queue.type = type;
     self->queue.io_modes =
             akvcam_buffers_io_modes_from_device_type(self->type,
@@ -89,16 +119,42 @@ akvcam_buffers_t akvcam_buffers_new(AKVCAM_RW_MODE rw_mode,
     self->queue.buf_struct_size = sizeof(akvcam_buffers_buffer);
     self->queue.mem_ops = &vb2_vmalloc_memops;
     self->queue.ops = &akvcam_akvcam_buffers_queue_ops;
-    self->queue.timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+
+    /* Output devices keep the timestamps set by the producer, so they can
+     * be forwarded to the capture devices.
+     */
+    self->queue.timestamp_flags =
+            akvcam_device_type_from_v4l2(type) == AKVCAM_DEVICE_TYPE_OUTPUT?
+                V4L2_BUF_FLAG_TIMESTAMP_COPY:
+                V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
 
     akvcam_buffers_set_count(self, AKVCAM_BUFFERS_MIN);
 
     return self;
 }
 
+/* Only the settings are copied, the new queue starts without any buffer.
+ */
+akvcam_buffers_t akvcam_buffers_new_copy(akvcam_buffers_ct other)
+{
+    akvcam_buffers_t self = akvcam_buffers_new(other->rw_mode, other->type);
+
+    akvcam_buffers_set_format(self, other->format);
+    akvcam_buffers_set_count(self, akvcam_buffers_count(other));
+    akvcam_buffers_set_device_num(self, other->device_num);
+    akvcam_buffers_set_timestamp_copy(self, other->timestamp_copy);
+    akvcam_buffers_set_memory_backend(self,
+                                      other->memory_backend,
+                                      other->queue.dev);
+    akvcam_buffers_set_overlay(self, other->overlay);
+
+    return self;
+}
+
 static void akvcam_buffers_free(struct kref *ref)
 {
     akvcam_buffers_t self = container_of(ref, struct akvcam_buffers, ref);
+    akvcam_overlay_delete(self->overlay);
     akvcam_format_delete(self->format);
     kfree(self);
 }
@@ -132,6 +188,19 @@ void akvcam_buffers_set_format(akvcam_buffers_t self, akvcam_format_ct format)
     akvcam_format_copy(self->format, format);
 }
 
+// Queues sharing a device must be serialized by the device lock.
+void akvcam_buffers_set_lock(akvcam_buffers_t self, struct mutex *lock)
+{
+    self->queue.lock = lock? lock: &self->buffers_mutex;
+}
+
+void akvcam_buffers_set_overlay(akvcam_buffers_t self,
+                                akvcam_overlay_t overlay)
+{
+    akvcam_overlay_delete(self->overlay);
+    self->overlay = akvcam_overlay_ref(overlay);
+}
+
 size_t akvcam_buffers_count(akvcam_buffers_ct self)
 {
 #if LINUX_VERSION_CODE < KERNEL_VERSION(6, 8, 0)
@@ -150,10 +219,80 @@ void akvcam_buffers_set_count(akvcam_buffers_t self, size_t nbuffers)
 #endif
 }
 
+void akvcam_buffers_set_device_num(akvcam_buffers_t self, int32_t num)
+{
+    self->device_num = num;
+}
+
+bool akvcam_buffers_timestamp_copy(akvcam_buffers_ct self)
+{
+    return self->timestamp_copy;
+}
+
+/* In timestamp copy mode, capture buffers get the timestamp and sequence
+ * of the output buffer the frame came from, instead of the time they were
+ * written.
+ */
+void akvcam_buffers_set_timestamp_copy(akvcam_buffers_t self,
+                                       bool timestamp_copy)
+{
+    if (akvcam_device_type_from_v4l2(self->type) != AKVCAM_DEVICE_TYPE_CAPTURE)
+        return;
+
+    self->timestamp_copy = timestamp_copy;
+    self->queue.timestamp_flags =
+            timestamp_copy?
+                V4L2_BUF_FLAG_TIMESTAMP_COPY:
+                V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+}
+
+AKVCAM_MEMORY_BACKEND akvcam_buffers_memory_backend(akvcam_buffers_ct self)
+{
+    return self->memory_backend;
+}
+
+/* Large frames can use scattered pages or a contiguous DMA region instead
+ * of vmalloc space. Both need a device to allocate from, and the frames are
+ * still accessed through the kernel mapping of the planes. Backends not
+ * built in the kernel fall back to vmalloc.
+ */
+void akvcam_buffers_set_memory_backend(akvcam_buffers_t self,
+                                       AKVCAM_MEMORY_BACKEND backend,
+                                       struct device *dma_device)
+{
+    self->memory_backend = AKVCAM_MEMORY_BACKEND_VMALLOC;
+    self->queue.mem_ops = &vb2_vmalloc_memops;
+    self->queue.dev = NULL;
+
+    if (!dma_device)
+        return;
+
+    switch (backend) {
+#if IS_ENABLED(CONFIG_VIDEOBUF2_DMA_SG)
+    case AKVCAM_MEMORY_BACKEND_DMA_SG:
+        self->queue.mem_ops = &vb2_dma_sg_memops;
+        break;
+#endif
+
+#if IS_ENABLED(CONFIG_VIDEOBUF2_DMA_CONTIG)
+    case AKVCAM_MEMORY_BACKEND_DMA_CONTIG:
+        self->queue.mem_ops = &vb2_dma_contig_memops;
+        break;
+#endif
+
+    default:
+        return;
+    }
+
+    self->memory_backend = backend;
+    self->queue.dev = dma_device;
+}
+
 akvcam_frame_t akvcam_buffers_read_frame(akvcam_buffers_t self)
 {
     akvcam_frame_t frame;
     akvcam_buffers_buffer_t buf;
+    size_t bytes = 0;
     size_t i;
 
     akpr_function();
@@ -169,12 +308,25 @@ akvcam_frame_t akvcam_buffers_read_frame(akvcam_buffers_t self)
 
     buf = list_entry(self->buffers.next, akvcam_buffers_buffer, list);
     list_del(&buf->list);
-    buf->vb.vb2_buf.timestamp = ktime_get_ns();
+
+    // Producers not setting the timestamp get the time of reading.
+    if (!buf->vb.vb2_buf.timestamp)
+        buf->vb.vb2_buf.timestamp = ktime_get_ns();
+
     buf->vb.field = V4L2_FIELD_NONE;
     buf->vb.sequence = self->sequence++;
     mutex_unlock(&self->frames_mutex);
 
+    if (akvcam_buffers_begin_cpu_access(&buf->vb.vb2_buf, DMA_FROM_DEVICE)) {
+        akpr_err_ratelimited("Failed to access the buffer %u\n", buf->vb.vb2_buf.index);
+        vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+
+        return NULL;
+    }
+
     frame = akvcam_frame_new(self->format);
+    akvcam_frame_set_timestamp(frame, buf->vb.vb2_buf.timestamp);
+    akvcam_frame_set_sequence(frame, buf->vb.sequence);
 
     for (i = 0; i < buf->vb.vb2_buf.num_planes; i++) {
         void *src = vb2_plane_vaddr(&buf->vb.vb2_buf, i);
@@ -183,18 +335,36 @@ akvcam_frame_t akvcam_buffers_read_frame(akvcam_buffers_t self)
         size_t expected = akvcam_format_plane_size(self->format, i);
         size_t copy_size = akvcam_min(payload, expected);
 
-        if (src && dst && copy_size > 0)
+        if (src && dst && copy_size > 0) {
             memcpy(dst, src, copy_size);
+            bytes += copy_size;
+        }
     }
 
+    if (akvcam_buffers_end_cpu_access(&buf->vb.vb2_buf, DMA_FROM_DEVICE)) {
+        akpr_err_ratelimited("Failed to release the buffer %u\n", buf->vb.vb2_buf.index);
+        akvcam_frame_delete(frame);
+        vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+
+        return NULL;
+    }
+
+    if (akvcam_format_is_compressed(self->format))
+        akvcam_frame_set_bytes_used(frame, bytes);
+
+    trace_akvcam_read_frame(self->device_num, buf->vb.sequence, bytes);
+    trace_akvcam_buffer_done(self->device_num, buf->vb.sequence, bytes);
     vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_DONE);
 
     return frame;
 }
 
-int akvcam_buffers_write_frame(akvcam_buffers_t self, akvcam_frame_t frame)
+int akvcam_buffers_write_frame(akvcam_buffers_t self,
+                               akvcam_frame_t frame,
+                               akvcam_frame_ct metadata)
 {
     akvcam_buffers_buffer_t buf;
+    size_t bytes = 0;
     size_t i;
     int result;
 
@@ -212,24 +382,64 @@ int akvcam_buffers_write_frame(akvcam_buffers_t self, akvcam_frame_t frame)
 
     buf = list_entry(self->buffers.next, akvcam_buffers_buffer, list);
     list_del(&buf->list);
-    buf->vb.vb2_buf.timestamp = ktime_get_ns();
     buf->vb.field = V4L2_FIELD_NONE;
-    buf->vb.sequence = self->sequence++;
+
+    if (self->timestamp_copy && akvcam_frame_timestamp(metadata)) {
+        buf->vb.vb2_buf.timestamp = akvcam_frame_timestamp(metadata);
+        buf->vb.sequence = akvcam_frame_sequence(metadata);
+    } else {
+        buf->vb.vb2_buf.timestamp = ktime_get_ns();
+        buf->vb.sequence = self->sequence++;
+    }
+
     mutex_unlock(&self->frames_mutex);
+    result = akvcam_buffers_begin_cpu_access(&buf->vb.vb2_buf, DMA_TO_DEVICE);
+
+    if (result) {
+        vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+
+        return result;
+    }
 
     for (i = 0; i < buf->vb.vb2_buf.num_planes; i++) {
         void *dst = vb2_plane_vaddr(&buf->vb.vb2_buf, i);
         void *src = akvcam_frame_plane_data(frame, i);
         size_t frame_size = akvcam_format_plane_size(self->format, i);
         size_t buf_size = vb2_plane_size(&buf->vb.vb2_buf, i);
-        size_t copy_size = akvcam_min(frame_size, buf_size);
+        size_t copy_size;
+
+        // Only copy the payload of compressed frames.
+        if (akvcam_format_is_compressed(self->format))
+            frame_size = akvcam_min(frame_size, akvcam_frame_bytes_used(frame));
+
+        copy_size = akvcam_min(frame_size, buf_size);
 
         if (dst && src && copy_size > 0) {
             memcpy(dst, src, copy_size);
+
+            /* Blend the overlay in the buffer, so the frames shared with
+             * other devices are never modified.
+             */
+            if (self->overlay
+                && !akvcam_format_is_compressed(self->format)
+                && copy_size == akvcam_format_plane_size(self->format, i))
+                akvcam_overlay_blend(self->overlay, self->format, i, dst);
+
             vb2_set_plane_payload(&buf->vb.vb2_buf, i, copy_size);
+            bytes += copy_size;
         }
     }
 
+    result = akvcam_buffers_end_cpu_access(&buf->vb.vb2_buf, DMA_TO_DEVICE);
+
+    if (result) {
+        vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+
+        return result;
+    }
+
+    trace_akvcam_write_frame(self->device_num, buf->vb.sequence, bytes);
+    trace_akvcam_buffer_done(self->device_num, buf->vb.sequence, bytes);
     vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_DONE);
 
     return 0;
@@ -240,6 +450,82 @@ struct vb2_queue *akvcam_buffers_vb2_queue(akvcam_buffers_t self)
     return &self->queue;
 }
 
+AKVCAM_MEMORY_BACKEND akvcam_buffers_memory_backend_from_string(const char *str)
+{
+    size_t i;
+
+    if (str)
+        for (i = 0; i < ARRAY_SIZE(akvcam_buffers_memory_backend_strs); i++)
+            if (strcmp(akvcam_buffers_memory_backend_strs[i].str, str) == 0)
+                return akvcam_buffers_memory_backend_strs[i].backend;
+
+    return AKVCAM_MEMORY_BACKEND_VMALLOC;
+}
+
+const char *akvcam_buffers_memory_backend_to_string(AKVCAM_MEMORY_BACKEND backend)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(akvcam_buffers_memory_backend_strs); i++)
+        if (akvcam_buffers_memory_backend_strs[i].backend == backend)
+            return akvcam_buffers_memory_backend_strs[i].str;
+
+    return akvcam_buffers_memory_backend_strs[0].str;
+}
+
+/* vb2_vmalloc maps the imported dma-bufs but never syncs them, so the CPU
+ * access is bracketed here to let the exporter flush or invalidate its
+ * caches. Exported and local buffers need nothing.
+ */
+int akvcam_buffers_begin_cpu_access(struct vb2_buffer *buffer,
+                                    enum dma_data_direction direction)
+{
+    size_t i;
+    int result;
+
+    if (buffer->memory != VB2_MEMORY_DMABUF)
+        return 0;
+
+    for (i = 0; i < buffer->num_planes; i++) {
+        if (!buffer->planes[i].dbuf)
+            continue;
+
+        result = dma_buf_begin_cpu_access(buffer->planes[i].dbuf, direction);
+
+        if (result) {
+            // Release the planes already granted.
+            while (i-- > 0)
+                if (buffer->planes[i].dbuf)
+                    dma_buf_end_cpu_access(buffer->planes[i].dbuf, direction);
+
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+int akvcam_buffers_end_cpu_access(struct vb2_buffer *buffer,
+                                  enum dma_data_direction direction)
+{
+    size_t i;
+    int result = 0;
+
+    if (buffer->memory != VB2_MEMORY_DMABUF)
+        return 0;
+
+    for (i = 0; i < buffer->num_planes; i++)
+        if (buffer->planes[i].dbuf) {
+            int plane_result =
+                    dma_buf_end_cpu_access(buffer->planes[i].dbuf, direction);
+
+            if (!result)
+                result = plane_result;
+        }
+
+    return result;
+}
+
 enum vb2_io_modes akvcam_buffers_io_modes_from_device_type(enum v4l2_buf_type type,
                                                            AKVCAM_RW_MODE rw_mode)
 {
@@ -302,6 +588,7 @@ int akvcam_buffers_buffer_prepare(struct vb2_buffer *buffer)
 {
     akvcam_buffers_t self = vb2_get_drv_priv(buffer->vb2_queue);
     struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(buffer);
+    bool compressed = akvcam_format_is_compressed(self->format);
     size_t i;
 
     akpr_function();
@@ -311,8 +598,12 @@ int akvcam_buffers_buffer_prepare(struct vb2_buffer *buffer)
 
         if (vb2_plane_size(buffer, i) < plane_size)
             return -EINVAL;
-        else
-            vb2_set_plane_payload(buffer, i, plane_size);
+
+        // The producer sets the payload of compressed frames.
+        if (compressed && V4L2_TYPE_IS_OUTPUT(self->type))
+            continue;
+
+        vb2_set_plane_payload(buffer, i, plane_size);
     }
 
     if (vbuf->field == V4L2_FIELD_ANY)
@@ -337,6 +628,9 @@ void akvcam_buffers_buffer_queue(struct vb2_buffer *buffer)
 
     list_add_tail(&buf->list, &self->buffers);
     mutex_unlock(&self->frames_mutex);
+    trace_akvcam_buffer_queue(self->device_num,
+                              buffer->index,
+                              akvcam_format_size(self->format));
 }
 
 int akvcam_buffers_start_streaming(struct vb2_queue *queue, unsigned int count)
@@ -25,25 +25,52 @@
 #include "device_types.h"
 #include "format_types.h"
 #include "frame_types.h"
+#include "overlay_types.h"
 #include "utils.h"
 
+enum dma_data_direction;
 enum v4l2_buf_type;
+struct device;
+struct mutex;
+struct vb2_buffer;
 struct vb2_queue;
 
 akvcam_buffers_t akvcam_buffers_new(AKVCAM_RW_MODE rw_mode,
                                     enum v4l2_buf_type type);
+akvcam_buffers_t akvcam_buffers_new_copy(akvcam_buffers_ct other);
 void akvcam_buffers_delete(akvcam_buffers_t self);
 akvcam_buffers_t akvcam_buffers_ref(akvcam_buffers_t self);
 
 akvcam_format_t akvcam_buffers_format_nr(akvcam_buffers_ct self);
 akvcam_format_t akvcam_buffers_format(akvcam_buffers_ct self);
 void akvcam_buffers_set_format(akvcam_buffers_t self, akvcam_format_ct format);
+void akvcam_buffers_set_lock(akvcam_buffers_t self, struct mutex *lock);
+void akvcam_buffers_set_overlay(akvcam_buffers_t self,
+                                akvcam_overlay_t overlay);
 size_t akvcam_buffers_count(akvcam_buffers_ct self);
 void akvcam_buffers_set_count(akvcam_buffers_t self, size_t nbuffers);
+void akvcam_buffers_set_device_num(akvcam_buffers_t self, int32_t num);
+bool akvcam_buffers_timestamp_copy(akvcam_buffers_ct self);
+void akvcam_buffers_set_timestamp_copy(akvcam_buffers_t self,
+                                       bool timestamp_copy);
+AKVCAM_MEMORY_BACKEND akvcam_buffers_memory_backend(akvcam_buffers_ct self);
+void akvcam_buffers_set_memory_backend(akvcam_buffers_t self,
+                                       AKVCAM_MEMORY_BACKEND backend,
+                                       struct device *dma_device);
 akvcam_frame_t akvcam_buffers_read_frame(akvcam_buffers_t self);
-int akvcam_buffers_write_frame(akvcam_buffers_t self, akvcam_frame_t frame);
+int akvcam_buffers_write_frame(akvcam_buffers_t self,
+                               akvcam_frame_t frame,
+                               akvcam_frame_ct metadata);
 struct vb2_queue *akvcam_buffers_vb2_queue(akvcam_buffers_t self);
 
+// public static
+AKVCAM_MEMORY_BACKEND akvcam_buffers_memory_backend_from_string(const char *str);
+const char *akvcam_buffers_memory_backend_to_string(AKVCAM_MEMORY_BACKEND backend);
+int akvcam_buffers_begin_cpu_access(struct vb2_buffer *buffer,
+                                    enum dma_data_direction direction);
+int akvcam_buffers_end_cpu_access(struct vb2_buffer *buffer,
+                                  enum dma_data_direction direction);
+
 // signals
 akvcam_signal_no_args(buffers, streaming_started);
 akvcam_signal_no_args(buffers, streaming_stopped);
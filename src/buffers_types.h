@@ -19,6 +19,13 @@
 #ifndef AKVCAM_BUFFERS_TYPES_H
 #define AKVCAM_BUFFERS_TYPES_H
 
+typedef enum
+{
+    AKVCAM_MEMORY_BACKEND_VMALLOC,
+    AKVCAM_MEMORY_BACKEND_DMA_SG,
+    AKVCAM_MEMORY_BACKEND_DMA_CONTIG,
+} AKVCAM_MEMORY_BACKEND;
+
 struct akvcam_buffers;
 typedef struct akvcam_buffers *akvcam_buffers_t;
 typedef const struct akvcam_buffers *akvcam_buffers_ct;
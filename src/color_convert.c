@@ -18,6 +18,7 @@
 
 #include <linux/kref.h>
 #include <linux/slab.h>
+#include <linux/videodev2.h>
 
 #include "color_convert.h"
 #include "format_specs.h"
@@ -37,6 +38,11 @@ void akvcam_color_convert_private_rb_constants(AKVCAM_YUV_COLOR_SPACE color_spac
                                                int64_t *div);
 int64_t akvcam_color_convert_private_rounded_div(int64_t num, int64_t den);
 int64_t akvcam_color_convert_private_nearest_pow_of_2(int64_t value);
+void akvcam_color_convert_private_compose(const int64_t *a,
+                                          int ashift,
+                                          const int64_t *b,
+                                          int bshift,
+                                          int64_t *result);
 void akvcam_color_convert_private_limits_y(int bits,
                                            AKVCAM_YUV_COLOR_SPACE_TYPE type,
                                            int64_t *min_y,
@@ -563,6 +569,97 @@ void akvcam_color_convert_load_matrix_from_fixel_formats(akvcam_color_convert_t
     akvcam_color_convert_load_matrix(self, spec_from, spec_to);
 }
 
+void akvcam_color_convert_load_adjusted_matrix(akvcam_color_convert_t self,
+                                               akvcam_format_specs_ct from,
+                                               akvcam_format_specs_ct to,
+                                               const int64_t *adjust_matrix,
+                                               int adjust_shift)
+{
+    akvcam_format_specs_ct rgb_specs;
+    akvcam_color_convert_t to_rgb;
+    akvcam_color_convert_t from_rgb;
+    int64_t to_rgb_matrix[12];
+    int64_t from_rgb_matrix[12];
+    int64_t adjusted_matrix[12];
+    int64_t color_matrix[12];
+    int64_t min_values[3];
+    int64_t max_values[3];
+    int64_t to_rgb_shift = 0;
+    int64_t from_rgb_shift = 0;
+    int i;
+
+    akvcam_color_convert_load_matrix(self, from, to);
+
+    if (!adjust_matrix
+        || !from
+        || !to
+        || akvcam_format_specs_main_components(from) != 3)
+        return;
+
+    /* The adjustment matrix works over 8 bits RGB values, so the final
+     * matrix is built as:
+     *
+     * from -> RGB24 -> adjust -> RGB24 -> to
+     *
+     * and the three steps are collapsed into a single affine transform.
+     */
+    rgb_specs = akvcam_format_specs_from_fixel_format(V4L2_PIX_FMT_RGB24);
+    to_rgb = akvcam_color_convert_new();
+    from_rgb = akvcam_color_convert_new();
+    akvcam_color_convert_set_yuv_color_space(to_rgb, self->priv->yuv_color_space);
+    akvcam_color_convert_set_yuv_color_space_type(to_rgb, self->priv->yuv_color_space_type);
+    akvcam_color_convert_set_yuv_color_space(from_rgb, self->priv->yuv_color_space);
+    akvcam_color_convert_set_yuv_color_space_type(from_rgb, self->priv->yuv_color_space_type);
+    akvcam_color_convert_load_matrix(to_rgb, from, rgb_specs);
+    akvcam_color_convert_load_matrix(from_rgb, rgb_specs, to);
+    akvcam_color_convert_read_matrix(to_rgb,
+                                     to_rgb_matrix,
+                                     NULL,
+                                     NULL,
+                                     NULL,
+                                     &to_rgb_shift,
+                                     NULL);
+    akvcam_color_convert_read_matrix(from_rgb,
+                                     from_rgb_matrix,
+                                     NULL,
+                                     min_values,
+                                     max_values,
+                                     &from_rgb_shift,
+                                     NULL);
+    akvcam_color_convert_delete(from_rgb);
+    akvcam_color_convert_delete(to_rgb);
+
+    // Remove the rounding terms, it will be added once at the end.
+    for (i = 0; i < 3; i++) {
+        to_rgb_matrix[4 * i + 3] -= 1LL << (to_rgb_shift - 1);
+        from_rgb_matrix[4 * i + 3] -= 1LL << (from_rgb_shift - 1);
+    }
+
+    akvcam_color_convert_private_compose(adjust_matrix,
+                                         adjust_shift,
+                                         to_rgb_matrix,
+                                         (int) to_rgb_shift,
+                                         adjusted_matrix);
+    akvcam_color_convert_private_compose(from_rgb_matrix,
+                                         (int) from_rgb_shift,
+                                         adjusted_matrix,
+                                         (int) to_rgb_shift,
+                                         color_matrix);
+
+    for (i = 0; i < 3; i++)
+        color_matrix[4 * i + 3] += 1LL << (to_rgb_shift - 1);
+
+    self->m00 = color_matrix[0]; self->m01 = color_matrix[1]; self->m02 = color_matrix[2]; self->m03 = color_matrix[3];
+    self->m10 = color_matrix[4]; self->m11 = color_matrix[5]; self->m12 = color_matrix[6]; self->m13 = color_matrix[7];
+    self->m20 = color_matrix[8]; self->m21 = color_matrix[9]; self->m22 = color_matrix[10]; self->m23 = color_matrix[11];
+
+    self->xmin = min_values[0]; self->xmax = max_values[0];
+    self->ymin = min_values[1]; self->ymax = max_values[1];
+    self->zmin = min_values[2]; self->zmax = max_values[2];
+
+    self->color_shift = to_rgb_shift;
+}
+
 akvcam_color_convert_private_t akvcam_color_convert_private_new(akvcam_color_convert_t parent)
 {
     akvcam_color_convert_private_t self =
@@ -650,6 +747,39 @@ int64_t akvcam_color_convert_private_nearest_pow_of_2(int64_t value)
     return 1 << res;
 }
 
+/* Compose two affine 3x4 matrices, the result is equivalent to apply b first
+ * and then a, and it's expressed with the same shift as b.
+ */
+void akvcam_color_convert_private_compose(const int64_t *a,
+                                          int ashift,
+                                          const int64_t *b,
+                                          int bshift,
+                                          int64_t *result)
+{
+    int64_t ashift_div = 1LL << ashift;
+    int64_t bshift_div = 1LL << bshift;
+    int i;
+    int j;
+
+    for (i = 0; i < 3; i++) {
+        const int64_t *arow = a + 4 * i;
+
+        for (j = 0; j < 3; j++)
+            result[4 * i + j] =
+                akvcam_color_convert_private_rounded_div(arow[0] * b[j]
+                                                         + arow[1] * b[4 + j]
+                                                         + arow[2] * b[8 + j],
+                                                         ashift_div);
+
+        result[4 * i + 3] =
+            akvcam_color_convert_private_rounded_div(arow[0] * b[3]
+                                                     + arow[1] * b[7]
+                                                     + arow[2] * b[11]
+                                                     + arow[3] * bshift_div,
+                                                     ashift_div);
+    }
+}
+
 void akvcam_color_convert_private_limits_y(int bits,
                                            AKVCAM_YUV_COLOR_SPACE_TYPE type,
                                            int64_t *min_y,
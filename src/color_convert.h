@@ -56,6 +56,11 @@ void akvcam_color_convert_load_matrix(akvcam_color_convert_t self,
 void akvcam_color_convert_load_matrix_from_fixel_formats(akvcam_color_convert_t self,
                                                          __u32 from,
                                                          __u32 to);
+void akvcam_color_convert_load_adjusted_matrix(akvcam_color_convert_t self,
+                                               akvcam_format_specs_ct from,
+                                               akvcam_format_specs_ct to,
+                                               const int64_t *adjust_matrix,
+                                               int adjust_shift);
 
 static inline void akvcam_color_convert_apply_matrix(akvcam_color_convert_ct self,
                                                      int64_t a, int64_t b, int64_t c,
@@ -0,0 +1,534 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/videodev2.h>
+
+#include "compositor.h"
+#include "converter.h"
+#include "format.h"
+#include "frame.h"
+#include "utils.h"
+
+#define AKVCAM_COMPOSITOR_BUFFERS 2
+#define AKVCAM_COMPOSITOR_ALL_BUFFERS ((1 << AKVCAM_COMPOSITOR_BUFFERS) - 1)
+
+/* The dirty and vacated masks have one bit per composited frame, telling if
+ * the source must be drawn again in that frame, or if its area must be
+ * cleared because it has no frame anymore.
+ */
+typedef struct
+{
+    const void *source;
+    struct v4l2_rect rect;
+    int z;
+    akvcam_converter_t converter;
+    akvcam_frame_t frame;
+    akvcam_frame_t converted;
+    akvcam_frame_t background;
+    uint8_t dirty;
+    uint8_t vacated;
+    bool updated;
+} akvcam_compositor_source, *akvcam_compositor_source_t;
+
+typedef const akvcam_compositor_source *akvcam_compositor_source_ct;
+
+/* Combines the frames of several sources into a single frame. Every source
+ * is scaled straight to the size of its own area and drawn in z-order over
+ * the previous ones. The composited frame is only redrawn when some source
+ * sends a new frame. The redraws alternate between a few composited frames,
+ * only the ones nobody else holds a reference to are drawn again, so the
+ * frames already handed out never change. Only the areas of the sources that
+ * changed since the last time a frame was drawn, and the sources overlapping
+ * them, are drawn again.
+ */
+struct akvcam_compositor
+{
+    struct kref ref;
+    akvcam_compositor_source sources[AKVCAM_COMPOSITOR_MAX_SOURCES];
+    size_t n_sources;
+    akvcam_format_t format;
+    akvcam_frame_t composites[AKVCAM_COMPOSITOR_BUFFERS];
+    size_t current;
+    AKVCAM_SCALING_MODE scaling;
+    AKVCAM_ASPECT_RATIO_MODE aspect_ratio;
+    struct mutex mutex;
+};
+
+void akvcam_compositor_source_area(akvcam_compositor_source_ct source,
+                                   akvcam_format_ct format,
+                                   struct v4l2_rect *area);
+akvcam_frame_t akvcam_compositor_convert(akvcam_compositor_t self,
+                                         akvcam_compositor_source_t source,
+                                         akvcam_frame_ct frame);
+void akvcam_compositor_release_composites(akvcam_compositor_t self);
+size_t akvcam_compositor_next_composite(akvcam_compositor_t self);
+void akvcam_compositor_draw(akvcam_compositor_t self, size_t index);
+bool akvcam_compositor_rects_intersect(const struct v4l2_rect *a,
+                                       const struct v4l2_rect *b);
+
+akvcam_compositor_t akvcam_compositor_new(void)
+{
+    akvcam_compositor_t self =
+            kzalloc(sizeof(struct akvcam_compositor), GFP_KERNEL);
+    kref_init(&self->ref);
+    self->format = akvcam_format_new(0, 0, 0, NULL);
+    mutex_init(&self->mutex);
+
+    return self;
+}
+
+static void akvcam_compositor_free(struct kref *ref)
+{
+    akvcam_compositor_t self =
+            container_of(ref, struct akvcam_compositor, ref);
+    size_t i;
+
+    akvcam_compositor_clear(self);
+
+    for (i = 0; i < self->n_sources; i++)
+        akvcam_converter_delete(self->sources[i].converter);
+
+    akvcam_compositor_release_composites(self);
+    akvcam_format_delete(self->format);
+    kfree(self);
+}
+
+void akvcam_compositor_delete(akvcam_compositor_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_compositor_free);
+}
+
+akvcam_compositor_t akvcam_compositor_ref(akvcam_compositor_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+size_t akvcam_compositor_sources(akvcam_compositor_ct self)
+{
+    return self->n_sources;
+}
+
+/* An empty rect uses the whole frame. The sources are kept sorted by z, the
+ * sources with the same z are drawn in the order they were added.
+ */
+bool akvcam_compositor_add_source(akvcam_compositor_t self,
+                                  const void *source,
+                                  const struct v4l2_rect *rect,
+                                  int z)
+{
+    akvcam_compositor_source_t new_source;
+    size_t i;
+
+    mutex_lock(&self->mutex);
+
+    if (self->n_sources >= AKVCAM_COMPOSITOR_MAX_SOURCES) {
+        mutex_unlock(&self->mutex);
+
+        return false;
+    }
+
+    for (i = self->n_sources; i > 0; i--)
+        if (self->sources[i - 1].z <= z)
+            break;
+
+    memmove(self->sources + i + 1,
+            self->sources + i,
+            (self->n_sources - i) * sizeof(akvcam_compositor_source));
+    new_source = self->sources + i;
+    memset(new_source, 0, sizeof(akvcam_compositor_source));
+    new_source->source = source;
+
+    if (rect)
+        new_source->rect = *rect;
+
+    new_source->z = z;
+    new_source->converter = akvcam_converter_new();
+    self->n_sources++;
+    mutex_unlock(&self->mutex);
+
+    return true;
+}
+
+bool akvcam_compositor_source_rect(akvcam_compositor_ct self,
+                                   size_t index,
+                                   struct v4l2_rect *rect,
+                                   int *z)
+{
+    if (index >= self->n_sources)
+        return false;
+
+    if (rect)
+        *rect = self->sources[index].rect;
+
+    if (z)
+        *z = self->sources[index].z;
+
+    return true;
+}
+
+/* Called from the thread of the source, a NULL frame removes the source from
+ * the composited frame until it sends a new one.
+ */
+void akvcam_compositor_set_frame(akvcam_compositor_t self,
+                                 const void *source,
+                                 akvcam_frame_t frame)
+{
+    size_t i;
+
+    mutex_lock(&self->mutex);
+
+    for (i = 0; i < self->n_sources; i++) {
+        akvcam_compositor_source_t compositor_source = self->sources + i;
+
+        if (compositor_source->source != source)
+            continue;
+
+        akvcam_frame_delete(compositor_source->frame);
+        compositor_source->frame = akvcam_frame_ref(frame);
+        compositor_source->updated = true;
+    }
+
+    mutex_unlock(&self->mutex);
+}
+
+/* Returns NULL while no source has sent a frame yet, so the caller can fall
+ * back to its placeholder frame.
+ */
+akvcam_frame_t akvcam_compositor_frame(akvcam_compositor_t self,
+                                       akvcam_format_ct format,
+                                       AKVCAM_SCALING_MODE scaling,
+                                       AKVCAM_ASPECT_RATIO_MODE aspect_ratio)
+{
+    akvcam_frame_t frames[AKVCAM_COMPOSITOR_MAX_SOURCES];
+    bool updated[AKVCAM_COMPOSITOR_MAX_SOURCES];
+    akvcam_frame_ct latest = NULL;
+    bool reconfigure;
+    bool redraw = false;
+    bool have_frames = false;
+    size_t i;
+
+    if (!akvcam_format_is_valid(format) || akvcam_format_is_compressed(format))
+        return NULL;
+
+    reconfigure = !self->composites[self->current]
+                  || !akvcam_format_is_same_format(self->format, format)
+                  || self->scaling != scaling
+                  || self->aspect_ratio != aspect_ratio;
+
+    // Only take the new frames in the lock, convert them out of it.
+    mutex_lock(&self->mutex);
+
+    for (i = 0; i < self->n_sources; i++) {
+        akvcam_compositor_source_t source = self->sources + i;
+
+        updated[i] = source->updated || reconfigure;
+        frames[i] = updated[i]? akvcam_frame_ref(source->frame): NULL;
+        source->updated = false;
+        redraw |= updated[i];
+        have_frames |= source->frame != NULL;
+    }
+
+    mutex_unlock(&self->mutex);
+
+    if (!have_frames) {
+        for (i = 0; i < self->n_sources; i++)
+            akvcam_frame_delete(frames[i]);
+
+        return NULL;
+    }
+
+    if (reconfigure) {
+        akvcam_format_copy(self->format, format);
+        self->scaling = scaling;
+        self->aspect_ratio = aspect_ratio;
+        akvcam_compositor_release_composites(self);
+
+        for (i = 0; i < self->n_sources; i++) {
+            akvcam_frame_delete(self->sources[i].background);
+            self->sources[i].background = NULL;
+        }
+    }
+
+    for (i = 0; i < self->n_sources; i++) {
+        akvcam_compositor_source_t source = self->sources + i;
+
+        if (!updated[i])
+            continue;
+
+        if (source->converted)
+            source->vacated = AKVCAM_COMPOSITOR_ALL_BUFFERS;
+
+        akvcam_frame_delete(source->converted);
+        source->converted = NULL;
+        source->dirty = 0;
+
+        if (!frames[i])
+            continue;
+
+        source->converted = akvcam_compositor_convert(self, source, frames[i]);
+
+        /* The new frame covers the whole area of the source, there is
+         * nothing to clear.
+         */
+        if (source->converted) {
+            source->dirty = AKVCAM_COMPOSITOR_ALL_BUFFERS;
+            source->vacated = 0;
+        }
+
+        if (!latest
+            || akvcam_frame_timestamp(frames[i]) > akvcam_frame_timestamp(latest))
+            latest = frames[i];
+    }
+
+    if (redraw) {
+        self->current = akvcam_compositor_next_composite(self);
+        akvcam_compositor_draw(self, self->current);
+
+        if (latest)
+            akvcam_frame_copy_metadata(self->composites[self->current],
+                                       latest);
+    }
+
+    for (i = 0; i < self->n_sources; i++)
+        akvcam_frame_delete(frames[i]);
+
+    return akvcam_frame_ref(self->composites[self->current]);
+}
+
+void akvcam_compositor_clear(akvcam_compositor_t self)
+{
+    size_t i;
+
+    mutex_lock(&self->mutex);
+
+    for (i = 0; i < self->n_sources; i++) {
+        akvcam_compositor_source_t source = self->sources + i;
+
+        akvcam_frame_delete(source->frame);
+        source->frame = NULL;
+        akvcam_frame_delete(source->converted);
+        source->converted = NULL;
+        akvcam_frame_delete(source->background);
+        source->background = NULL;
+        source->dirty = 0;
+        source->vacated = 0;
+        source->updated = false;
+    }
+
+    akvcam_compositor_release_composites(self);
+    mutex_unlock(&self->mutex);
+}
+
+void akvcam_compositor_source_area(akvcam_compositor_source_ct source,
+                                   akvcam_format_ct format,
+                                   struct v4l2_rect *area)
+{
+    __s32 width = (__s32) akvcam_format_width(format);
+    __s32 height = (__s32) akvcam_format_height(format);
+    __s32 area_width;
+    __s32 area_height;
+
+    // Keep the area aligned to the chroma subsampling.
+    area->left = akvcam_bound(0, source->rect.left, width) & ~1;
+    area->top = akvcam_bound(0, source->rect.top, height) & ~1;
+    area_width = width - area->left;
+    area_height = height - area->top;
+
+    if (source->rect.width > 0)
+        area_width = akvcam_min((__s32) source->rect.width, area_width);
+
+    if (source->rect.height > 0)
+        area_height = akvcam_min((__s32) source->rect.height, area_height);
+
+    area->width = (__u32) area_width & ~1;
+    area->height = (__u32) area_height & ~1;
+}
+
+akvcam_frame_t akvcam_compositor_convert(akvcam_compositor_t self,
+                                         akvcam_compositor_source_t source,
+                                         akvcam_frame_ct frame)
+{
+    struct v4l2_fract frame_rate = akvcam_format_frame_rate(self->format);
+    struct v4l2_rect area;
+    akvcam_format_t format;
+    akvcam_frame_t converted;
+
+    // Compressed frames can't be scaled.
+    if (akvcam_format_is_compressed(akvcam_frame_format_nr(frame)))
+        return NULL;
+
+    akvcam_compositor_source_area(source, self->format, &area);
+
+    if (area.width < 1 || area.height < 1)
+        return NULL;
+
+    format = akvcam_format_new(akvcam_format_fourcc(self->format),
+                               area.width,
+                               area.height,
+                               &frame_rate);
+    akvcam_converter_set_output_format(source->converter, format);
+    akvcam_converter_set_scaling_mode(source->converter, self->scaling);
+    akvcam_converter_set_aspect_ratio_mode(source->converter,
+                                           self->aspect_ratio);
+    akvcam_format_delete(format);
+
+    akvcam_converter_begin(source->converter);
+    converted = akvcam_converter_convert(source->converter, frame);
+    akvcam_converter_end(source->converter);
+
+    return converted;
+}
+
+void akvcam_compositor_release_composites(akvcam_compositor_t self)
+{
+    size_t i;
+
+    for (i = 0; i < AKVCAM_COMPOSITOR_BUFFERS; i++) {
+        akvcam_frame_delete(self->composites[i]);
+        self->composites[i] = NULL;
+    }
+
+    self->current = 0;
+}
+
+/* Returns the composited frame to draw the next frame into. The current
+ * frame is the one that needs less work, if nobody holds it, then any other
+ * frame nobody holds. If every frame is held by someone, a new one is
+ * created, and since a new frame is empty all the sources are drawn in it.
+ */
+size_t akvcam_compositor_next_composite(akvcam_compositor_t self)
+{
+    size_t index = self->current;
+    size_t i;
+
+    for (i = 0; i < AKVCAM_COMPOSITOR_BUFFERS; i++) {
+        index = (self->current + i) % AKVCAM_COMPOSITOR_BUFFERS;
+
+        if (!self->composites[index]
+            || !akvcam_frame_is_shared(self->composites[index]))
+            break;
+    }
+
+    if (i >= AKVCAM_COMPOSITOR_BUFFERS)
+        index = (self->current + 1) % AKVCAM_COMPOSITOR_BUFFERS;
+
+    if (!self->composites[index]
+        || akvcam_frame_is_shared(self->composites[index])) {
+        akvcam_frame_delete(self->composites[index]);
+        self->composites[index] = akvcam_frame_new(self->format);
+        akvcam_frame_fill_rgba(self->composites[index], akvcam_xyz(0, 0, 0));
+
+        for (i = 0; i < self->n_sources; i++) {
+            akvcam_compositor_source_t source = self->sources + i;
+
+            if (source->converted)
+                source->dirty |= 1 << index;
+
+            source->vacated &= ~(1 << index);
+        }
+    }
+
+    return index;
+}
+
+void akvcam_compositor_draw(akvcam_compositor_t self, size_t index)
+{
+    akvcam_frame_t composite = self->composites[index];
+    struct v4l2_rect damaged[2 * AKVCAM_COMPOSITOR_MAX_SOURCES];
+    size_t n_damaged = 0;
+    uint8_t mask = 1 << index;
+    size_t i;
+    size_t j;
+
+    // Clear the areas of the sources that have no frame anymore.
+    for (i = 0; i < self->n_sources; i++) {
+        akvcam_compositor_source_t source = self->sources + i;
+        struct v4l2_rect area;
+
+        if (!(source->vacated & mask))
+            continue;
+
+        source->vacated &= ~mask;
+        akvcam_compositor_source_area(source, self->format, &area);
+
+        if (area.width < 1 || area.height < 1)
+            continue;
+
+        if (!source->background) {
+            struct v4l2_fract frame_rate =
+                    akvcam_format_frame_rate(self->format);
+            akvcam_format_t format =
+                    akvcam_format_new(akvcam_format_fourcc(self->format),
+                                      area.width,
+                                      area.height,
+                                      &frame_rate);
+            source->background = akvcam_frame_new(format);
+            akvcam_format_delete(format);
+            akvcam_frame_fill_rgba(source->background, akvcam_xyz(0, 0, 0));
+        }
+
+        akvcam_frame_blit(composite, source->background, area.left, area.top);
+        damaged[n_damaged++] = area;
+    }
+
+    /* Draw the sources that changed, and the ones overlapping an area that
+     * was drawn before them.
+     */
+    for (i = 0; i < self->n_sources; i++) {
+        akvcam_compositor_source_t source = self->sources + i;
+        struct v4l2_rect area;
+        bool draw = source->dirty & mask;
+
+        source->dirty &= ~mask;
+
+        if (!source->converted)
+            continue;
+
+        akvcam_compositor_source_area(source, self->format, &area);
+
+        for (j = 0; j < n_damaged && !draw; j++)
+            draw = akvcam_compositor_rects_intersect(&area, damaged + j);
+
+        if (!draw)
+            continue;
+
+        akvcam_frame_blit(composite, source->converted, area.left, area.top);
+        damaged[n_damaged++] = area;
+    }
+}
+
+bool akvcam_compositor_rects_intersect(const struct v4l2_rect *a,
+                                       const struct v4l2_rect *b)
+{
+    return a->width > 0
+           && a->height > 0
+           && b->width > 0
+           && b->height > 0
+           && a->left < b->left + (__s32) b->width
+           && b->left < a->left + (__s32) a->width
+           && a->top < b->top + (__s32) b->height
+           && b->top < a->top + (__s32) a->height;
+}
@@ -0,0 +1,57 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_COMPOSITOR_H
+#define AKVCAM_COMPOSITOR_H
+
+#include <linux/types.h>
+
+#include "compositor_types.h"
+#include "converter_types.h"
+#include "format_types.h"
+#include "frame_types.h"
+
+#define AKVCAM_COMPOSITOR_MAX_SOURCES 16
+
+struct v4l2_rect;
+
+// public
+akvcam_compositor_t akvcam_compositor_new(void);
+void akvcam_compositor_delete(akvcam_compositor_t self);
+akvcam_compositor_t akvcam_compositor_ref(akvcam_compositor_t self);
+
+size_t akvcam_compositor_sources(akvcam_compositor_ct self);
+bool akvcam_compositor_add_source(akvcam_compositor_t self,
+                                  const void *source,
+                                  const struct v4l2_rect *rect,
+                                  int z);
+bool akvcam_compositor_source_rect(akvcam_compositor_ct self,
+                                   size_t index,
+                                   struct v4l2_rect *rect,
+                                   int *z);
+void akvcam_compositor_set_frame(akvcam_compositor_t self,
+                                 const void *source,
+                                 akvcam_frame_t frame);
+akvcam_frame_t akvcam_compositor_frame(akvcam_compositor_t self,
+                                       akvcam_format_ct format,
+                                       AKVCAM_SCALING_MODE scaling,
+                                       AKVCAM_ASPECT_RATIO_MODE aspect_ratio);
+void akvcam_compositor_clear(akvcam_compositor_t self);
+
+#endif // AKVCAM_COMPOSITOR_H
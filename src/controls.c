@@ -91,6 +91,45 @@ static const struct v4l2_ctrl_config akvcam_controls_output[] = {
     {.id = 0},
 };
 
+// Converter devices have both, the picture and the output controls.
+static const struct v4l2_ctrl_config akvcam_controls_m2m[] = {
+    {.id = V4L2_CID_BRIGHTNESS, .min = -255             , .max = 255            , .step = 1},
+    {.id = V4L2_CID_CONTRAST  , .min = -255             , .max = 255            , .step = 1},
+    {.id = V4L2_CID_SATURATION, .min = -255             , .max = 255            , .step = 1},
+    {.id = V4L2_CID_HUE       , .min = -359             , .max = 359            , .step = 1},
+    {.id = V4L2_CID_GAMMA     , .min = -255             , .max = 255            , .step = 1},
+    {.id = V4L2_CID_HFLIP     , .min = 0                , .max = 1              , .step = 1},
+    {.id = V4L2_CID_VFLIP     , .min = 0                , .max = 1              , .step = 1},
+    {.id = V4L2_CID_COLORFX   , .min = V4L2_COLORFX_NONE, .max = V4L2_COLORFX_BW, .step = 1},
+    {
+        .id = AKVCAM_CID_SCALING,
+        .type = V4L2_CTRL_TYPE_MENU,
+        .name = "Scaling Mode",
+        .max = ARRAY_SIZE(akvcam_controls_scaling_menu) - 1,
+        .step = 0,
+        .qmenu = akvcam_controls_scaling_menu,
+        .ops = &akvcam_controls_ops
+    },
+    {
+        .id = AKVCAM_CID_ASPECT_RATIO,
+        .type = V4L2_CTRL_TYPE_MENU,
+        .name = "Aspect Ratio Mode" ,
+        .max = ARRAY_SIZE(akvcam_controls_aspect_menu) - 1,
+        .step = 0,
+        .qmenu = akvcam_controls_aspect_menu,
+        .ops = &akvcam_controls_ops
+    },
+    {
+        .id = AKVCAM_CID_SWAP_RGB,
+        .type = V4L2_CTRL_TYPE_BOOLEAN,
+        .name = "Swap Read and Blue",
+        .max = 1,
+        .step = 1,
+        .ops = &akvcam_controls_ops
+    },
+    {.id = 0},
+};
+
 int akvcam_controls_control_changed(struct v4l2_ctrl *control);
 
 akvcam_controls_t akvcam_controls_new(AKVCAM_DEVICE_TYPE device_type)
@@ -105,6 +144,8 @@ akvcam_controls_t akvcam_controls_new(AKVCAM_DEVICE_TYPE device_type)
     // Initialize controls with default values.
     if (device_type == AKVCAM_DEVICE_TYPE_OUTPUT)
         control_params = akvcam_controls_output;
+    else if (device_type == AKVCAM_DEVICE_TYPE_M2M)
+        control_params = akvcam_controls_m2m;
     else
         control_params = akvcam_controls_capture;
 
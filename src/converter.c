@@ -26,6 +26,7 @@
 #include "format.h"
 #include "format_specs.h"
 #include "frame.h"
+#include "trace.h"
 #include "utils.h"
 
 #define SCALE_EMULT 8
@@ -86,9 +87,15 @@ typedef struct
     akvcam_format_t output_format;
     akvcam_format_t output_convert_format;
     akvcam_frame_t output_frame;
+    akvcam_frame_t last_input;
 
     akvcam_rect input_rect;
 
+    int64_t color_adjust[12];
+    int color_adjust_shift;
+    bool has_color_adjust;
+    bool color_adjusted;
+
     AKVCAM_YUV_COLOR_SPACE yuv_color_space;
     AKVCAM_YUV_COLOR_SPACE_TYPE yuv_color_space_type;
     AKVCAM_SCALING_MODE scaling_mode;
@@ -214,6 +221,12 @@ struct akvcam_converter
     AKVCAM_YUV_COLOR_SPACE_TYPE yuv_color_space_type;
     AKVCAM_SCALING_MODE scaling_mode;
     AKVCAM_ASPECT_RATIO_MODE aspect_ratio_mode;
+    int64_t color_adjust[12];
+    int color_adjust_shift;
+    bool has_color_adjust;
+    akvcam_rect input_rect;
+    int32_t device_num;
+    bool damage_tracking;
 };
 
 akvcam_frame_t akvcam_converter_private_convert(akvcam_converter_t self,
@@ -223,6 +236,10 @@ void akvcam_converter_private_convert_fast_8bits(akvcam_converter_t self,
                                                  akvcam_frame_convert_parameters_ct fc,
                                                  akvcam_frame_ct src,
                                                  akvcam_frame_t dst);
+bool akvcam_converter_private_color_adjust_changed(akvcam_converter_ct self,
+                                                   akvcam_frame_convert_parameters_ct fc);
+bool akvcam_converter_private_is_cropping(akvcam_converter_ct self,
+                                          akvcam_format_ct format);
 void akvcam_frame_convert_parameters_init(akvcam_frame_convert_parameters_t fc,
                                           size_t size);
 void akvcam_frame_convert_parameters_copy(akvcam_frame_convert_parameters_t fc,
@@ -235,10 +252,13 @@ void akvcam_frame_convert_parameters_configure(akvcam_frame_convert_parameters_t
                                                akvcam_format_ct oformat,
                                                akvcam_color_convert_t color_convert,
                                                AKVCAM_YUV_COLOR_SPACE yuv_color_space,
-                                               AKVCAM_YUV_COLOR_SPACE_TYPE yuv_color_space_type);
+                                               AKVCAM_YUV_COLOR_SPACE_TYPE yuv_color_space_type,
+                                               const int64_t *color_adjust,
+                                               int color_adjust_shift);
 void akvcam_frame_convert_parameters_configure_scaling(akvcam_frame_convert_parameters_t fc,
                                                        akvcam_format_ct iformat,
                                                        akvcam_format_ct oformat,
+                                                       akvcam_rect_ct input_rect,
                                                        AKVCAM_ASPECT_RATIO_MODE aspect_ratio_mode);
 void akvcam_frame_convert_parameters_allocate_buffers(akvcam_frame_convert_parameters_t fc,
                                                       akvcam_format_ct oformat);
@@ -247,6 +267,11 @@ void akvcam_frame_convert_parameters_allocate_dl_buffers(akvcam_frame_convert_pa
                                                          akvcam_format_ct oformat);
 void akvcam_frame_convert_parameters_clear_buffers(akvcam_frame_convert_parameters_t fc);
 void akvcam_frame_convert_parameters_clear_dl_buffers(akvcam_frame_convert_parameters_t fc);
+bool akvcam_frame_convert_parameters_can_track_damage(akvcam_frame_convert_parameters_ct fc);
+void akvcam_frame_convert_parameters_damaged_rows(akvcam_frame_convert_parameters_t fc,
+                                                  akvcam_frame_ct frame);
+void akvcam_frame_convert_parameters_keep_input(akvcam_frame_convert_parameters_t fc,
+                                                akvcam_frame_ct frame);
 
 /* Color blending functions
  *
@@ -7725,6 +7750,10 @@ akvcam_converter_t akvcam_converter_new(void)
     self->yuv_color_space_type = AKVCAM_YUV_COLOR_SPACE_TYPE_STUDIO_SWING;
     self->scaling_mode = AKVCAM_SCALING_MODE_FAST;
     self->aspect_ratio_mode = AKVCAM_ASPECT_RATIO_MODE_IGNORE;
+    self->color_adjust_shift = 0;
+    self->has_color_adjust = false;
+    self->device_num = -1;
+    self->damage_tracking = false;
 
     return self;
 }
@@ -7741,6 +7770,12 @@ akvcam_converter_t akvcam_converter_new_copy(akvcam_converter_ct other)
     self->yuv_color_space_type = other->yuv_color_space_type;
     self->scaling_mode = other->scaling_mode;
     self->aspect_ratio_mode = other->aspect_ratio_mode;
+    memcpy(self->color_adjust, other->color_adjust, sizeof(self->color_adjust));
+    self->color_adjust_shift = other->color_adjust_shift;
+    self->has_color_adjust = other->has_color_adjust;
+    self->input_rect = other->input_rect;
+    self->device_num = -1;
+    self->damage_tracking = other->damage_tracking;
 
     return self;
 }
@@ -7778,6 +7813,10 @@ void akvcam_converter_copy(akvcam_converter_t self, akvcam_converter_ct other)
         self->yuv_color_space_type = other->yuv_color_space_type;
         self->scaling_mode = other->scaling_mode;
         self->aspect_ratio_mode = other->aspect_ratio_mode;
+        memcpy(self->color_adjust, other->color_adjust, sizeof(self->color_adjust));
+        self->color_adjust_shift = other->color_adjust_shift;
+        self->has_color_adjust = other->has_color_adjust;
+        self->input_rect = other->input_rect;
     } else {
         if (self->output_format)
             akvcam_format_delete(self->output_format);
@@ -7787,6 +7826,10 @@ void akvcam_converter_copy(akvcam_converter_t self, akvcam_converter_ct other)
         self->yuv_color_space_type = AKVCAM_YUV_COLOR_SPACE_TYPE_STUDIO_SWING;
         self->scaling_mode = AKVCAM_SCALING_MODE_FAST;
         self->aspect_ratio_mode = AKVCAM_ASPECT_RATIO_MODE_IGNORE;
+        memset(self->color_adjust, 0, sizeof(self->color_adjust));
+        self->color_adjust_shift = 0;
+        self->has_color_adjust = false;
+        memset(&self->input_rect, 0, sizeof(akvcam_rect));
     }
 }
 
@@ -7845,12 +7888,77 @@ void akvcam_converter_set_aspect_ratio_mode(akvcam_converter_t self,
     self->aspect_ratio_mode = aspect_ratio_mode;
 }
 
+void akvcam_converter_set_color_adjust(akvcam_converter_t self,
+                                       const int64_t *color_matrix,
+                                       int shift)
+{
+    int i;
+
+    memset(self->color_adjust, 0, sizeof(self->color_adjust));
+    self->color_adjust_shift = 0;
+    self->has_color_adjust = false;
+
+    if (!color_matrix)
+        return;
+
+    // An identity matrix is the same as no adjustment at all.
+    for (i = 0; i < 12; i++) {
+        int64_t identity = i % 5 == 0? 1LL << shift: 0;
+
+        if (color_matrix[i] != identity) {
+            self->has_color_adjust = true;
+
+            break;
+        }
+    }
+
+    if (!self->has_color_adjust)
+        return;
+
+    memcpy(self->color_adjust, color_matrix, sizeof(self->color_adjust));
+    self->color_adjust_shift = shift;
+}
+
+void akvcam_converter_set_input_rect(akvcam_converter_t self,
+                                     const struct v4l2_rect *rect)
+{
+    if (rect) {
+        self->input_rect.x = rect->left;
+        self->input_rect.y = rect->top;
+        self->input_rect.width = (int) rect->width;
+        self->input_rect.height = (int) rect->height;
+    } else {
+        memset(&self->input_rect, 0, sizeof(akvcam_rect));
+    }
+}
+
 void akvcam_converter_set_cache_index(akvcam_converter_t self,
                                       int index)
 {
     self->cache_index = index;
 }
 
+// Only used for identifying the device in the trace events.
+void akvcam_converter_set_device_num(akvcam_converter_t self, int32_t num)
+{
+    self->device_num = num;
+}
+
+bool akvcam_converter_damage_tracking(akvcam_converter_ct self)
+{
+    return self->damage_tracking;
+}
+
+/* Only convert the rows that changed since the last frame. Worth it for
+ * mostly static frames, but it costs a copy and a comparison of every
+ * input frame, so it's disabled by default.
+ */
+void akvcam_converter_set_damage_tracking(akvcam_converter_t self,
+                                          bool damage_tracking)
+{
+    self->damage_tracking = damage_tracking;
+}
+
 bool akvcam_converter_begin(akvcam_converter_t self)
 {
     self->cache_index = 0;
@@ -7867,20 +7975,33 @@ akvcam_frame_t akvcam_converter_convert(akvcam_converter_t self,
                                         akvcam_frame_ct frame)
 {
     akvcam_format_t format;
+    akvcam_frame_t converted;
 
     if (!frame)
         return NULL;
 
     format = akvcam_frame_format_nr(frame);
+    trace_akvcam_convert_start(self->device_num, akvcam_frame_size(frame));
 
-    if (akvcam_format_fourcc(format) == akvcam_format_fourcc(self->output_format)
+    if (!self->has_color_adjust
+        && !akvcam_converter_private_is_cropping(self, format)
+        && akvcam_format_fourcc(format) == akvcam_format_fourcc(self->output_format)
         && akvcam_format_width(format) == akvcam_format_width(self->output_format)
         && akvcam_format_height(format) == akvcam_format_height(self->output_format)) {
-
-        return akvcam_frame_new_copy(frame);
+        converted = akvcam_frame_new_copy(frame);
+    } else {
+        converted = akvcam_converter_private_convert(self,
+                                                     frame,
+                                                     self->output_format);
     }
 
-    return akvcam_converter_private_convert(self, frame, self->output_format);
+    if (converted)
+        akvcam_frame_copy_metadata(converted, frame);
+
+    trace_akvcam_convert_end(self->device_num,
+                             converted? akvcam_frame_size(converted): 0);
+
+    return converted;
 }
 
 void akvcam_converter_reset(akvcam_converter_t self)
@@ -7965,6 +8086,9 @@ akvcam_frame_t akvcam_converter_private_convert(akvcam_converter_t self,
     static const int max_cache_alloc = 1 << 16;
     akvcam_frame_convert_parameters_t fc;
     akvcam_format_t frame_format;
+    int ymin;
+    int ymax;
+    bool tracking;
 
     if (self->cache_index >= max_cache_alloc)
         return NULL;
@@ -7996,16 +8120,22 @@ akvcam_frame_t akvcam_converter_private_convert(akvcam_converter_t self,
         || self->yuv_color_space != fc->yuv_color_space
         || self->yuv_color_space_type != fc->yuv_color_space_type
         || self->scaling_mode != fc->scaling_mode
-        || self->aspect_ratio_mode != fc->aspect_ratio_mode) {
+        || self->aspect_ratio_mode != fc->aspect_ratio_mode
+        || memcmp(&self->input_rect, &fc->input_rect, sizeof(akvcam_rect))
+        || akvcam_converter_private_color_adjust_changed(self, fc)) {
         akvcam_frame_convert_parameters_configure(fc,
                                                   frame_format,
                                                   output_format,
                                                   fc->color_convert,
                                                   self->yuv_color_space,
-                                                  self->yuv_color_space_type);
+                                                  self->yuv_color_space_type,
+                                                  self->has_color_adjust?
+                                                      self->color_adjust: NULL,
+                                                  self->color_adjust_shift);
         akvcam_frame_convert_parameters_configure_scaling(fc,
                                                           frame_format,
                                                           output_format,
+                                                          &self->input_rect,
                                                           self->aspect_ratio_mode);
 
         if (fc->input_format)
@@ -8021,34 +8151,63 @@ akvcam_frame_t akvcam_converter_private_convert(akvcam_converter_t self,
         fc->yuv_color_space_type = self->yuv_color_space_type;
         fc->scaling_mode = self->scaling_mode;
         fc->aspect_ratio_mode = self->aspect_ratio_mode;
+        memcpy(fc->color_adjust, self->color_adjust, sizeof(fc->color_adjust));
+        fc->color_adjust_shift = self->color_adjust_shift;
+        fc->has_color_adjust = self->has_color_adjust;
+        fc->input_rect = self->input_rect;
+
+        // The output frame was reset, convert the next frame completely.
+        akvcam_frame_delete(fc->last_input);
+        fc->last_input = NULL;
     }
 
 
-    if (akvcam_format_is_same_format(fc->output_convert_format, frame_format)) {
+    if (!fc->color_adjusted
+        && !akvcam_converter_private_is_cropping(self, frame_format)
+        && akvcam_format_is_same_format(fc->output_convert_format, frame_format)) {
         self->cache_index++;
 
         return akvcam_frame_new_copy(frame);
     }
 
-    if (fc->fast_convertion) {
-        akvcam_converter_private_convert_fast_8bits(self,
-                                                    fc,
-                                                    frame,
-                                                    fc->output_frame);
-    } else {
-        switch (fc->convert_data_types) {
-        DEFINE_CONVERT_FUNC(8 , 8 )
-        DEFINE_CONVERT_FUNC(8 , 16)
-        DEFINE_CONVERT_FUNC(8 , 32)
-        DEFINE_CONVERT_FUNC(16, 8 )
-        DEFINE_CONVERT_FUNC(16, 16)
-        DEFINE_CONVERT_FUNC(16, 32)
-        DEFINE_CONVERT_FUNC(32, 8 )
-        DEFINE_CONVERT_FUNC(32, 16)
-        DEFINE_CONVERT_FUNC(32, 32)
+    ymin = fc->ymin;
+    ymax = fc->ymax;
+    tracking = self->damage_tracking
+               && akvcam_frame_convert_parameters_can_track_damage(fc);
+
+    if (tracking)
+        akvcam_frame_convert_parameters_damaged_rows(fc, frame);
+
+    if (fc->ymin < fc->ymax) {
+        if (fc->fast_convertion) {
+            akvcam_converter_private_convert_fast_8bits(self,
+                                                        fc,
+                                                        frame,
+                                                        fc->output_frame);
+        } else {
+            switch (fc->convert_data_types) {
+            DEFINE_CONVERT_FUNC(8 , 8 )
+            DEFINE_CONVERT_FUNC(8 , 16)
+            DEFINE_CONVERT_FUNC(8 , 32)
+            DEFINE_CONVERT_FUNC(16, 8 )
+            DEFINE_CONVERT_FUNC(16, 16)
+            DEFINE_CONVERT_FUNC(16, 32)
+            DEFINE_CONVERT_FUNC(32, 8 )
+            DEFINE_CONVERT_FUNC(32, 16)
+            DEFINE_CONVERT_FUNC(32, 32)
+            }
         }
     }
 
+    fc->ymin = ymin;
+    fc->ymax = ymax;
+
+    if (tracking) {
+        akvcam_frame_convert_parameters_keep_input(fc, frame);
+    } else if (fc->last_input) {
+        akvcam_frame_delete(fc->last_input);
+        fc->last_input = NULL;
+    }
     self->cache_index++;
 
     return akvcam_frame_new_copy(fc->output_frame);
@@ -8118,6 +8277,36 @@ void akvcam_converter_private_convert_fast_8bits(akvcam_converter_t self,
     }
 }
 
+bool akvcam_converter_private_color_adjust_changed(akvcam_converter_ct self,
+                                                   akvcam_frame_convert_parameters_ct fc)
+{
+    if (self->has_color_adjust != fc->has_color_adjust)
+        return true;
+
+    if (!self->has_color_adjust)
+        return false;
+
+    return self->color_adjust_shift != fc->color_adjust_shift
+           || memcmp(self->color_adjust,
+                     fc->color_adjust,
+                     sizeof(self->color_adjust)) != 0;
+}
+
+bool akvcam_converter_private_is_cropping(akvcam_converter_ct self,
+                                          akvcam_format_ct format)
+{
+    int width = akvcam_format_width(format);
+    int height = akvcam_format_height(format);
+
+    if (self->input_rect.width < 1 || self->input_rect.height < 1)
+        return false;
+
+    return self->input_rect.x > 0
+           || self->input_rect.y > 0
+           || self->input_rect.width < width
+           || self->input_rect.height < height;
+}
+
 void akvcam_frame_convert_parameters_init(akvcam_frame_convert_parameters_t fc,
                                           size_t size)
 {
@@ -8128,6 +8317,12 @@ void akvcam_frame_convert_parameters_init(akvcam_frame_convert_parameters_t fc,
         .output_format = NULL,
         .output_convert_format = NULL,
         .output_frame = NULL,
+        .last_input = NULL,
+
+        .color_adjust = {0},
+        .color_adjust_shift = 0,
+        .has_color_adjust = false,
+        .color_adjusted = false,
 
         .yuv_color_space = AKVCAM_YUV_COLOR_SPACE_ITUR_BT601,
         .yuv_color_space_type = AKVCAM_YUV_COLOR_SPACE_TYPE_STUDIO_SWING,
@@ -8260,6 +8455,8 @@ void akvcam_frame_convert_parameters_init(akvcam_frame_convert_parameters_t fc,
         if (fci->output_frame)
             akvcam_frame_delete(fci->output_frame);
 
+        akvcam_frame_delete(fci->last_input);
+
         memcpy(fci,
                &akvcam_fc_initializer,
                sizeof(akvcam_frame_convert_parameters));
@@ -8297,6 +8494,8 @@ void akvcam_frame_convert_parameters_copy(akvcam_frame_convert_parameters_t fc,
         if (fci->output_frame)
             akvcam_frame_delete(fci->output_frame);
 
+        akvcam_frame_delete(fci->last_input);
+
         memcpy(fci,
                otheri,
                sizeof(akvcam_frame_convert_parameters));
@@ -8306,6 +8505,9 @@ void akvcam_frame_convert_parameters_copy(akvcam_frame_convert_parameters_t fc,
         fci->output_format = akvcam_format_new_copy(otheri->output_format);
         fci->output_convert_format = akvcam_format_new_copy(otheri->output_convert_format);
         fci->output_frame = akvcam_frame_new_copy(otheri->output_frame);
+        fci->last_input = otheri->last_input?
+                              akvcam_frame_new_copy(otheri->last_input):
+                              NULL;
     }
 }
 
@@ -8332,6 +8534,8 @@ void akvcam_frame_convert_parameters_delete(akvcam_frame_convert_parameters_t *f
 
             if (fci->output_frame)
                 akvcam_frame_delete(fci->output_frame);
+
+            akvcam_frame_delete(fci->last_input);
         }
 
         kfree(*fc);
@@ -8348,7 +8552,9 @@ void akvcam_frame_convert_parameters_configure(akvcam_frame_convert_parameters_t
                                                akvcam_format_ct oformat,
                                                akvcam_color_convert_t color_convert,
                                                AKVCAM_YUV_COLOR_SPACE yuv_color_space,
-                                               AKVCAM_YUV_COLOR_SPACE_TYPE yuv_color_space_type)
+                                               AKVCAM_YUV_COLOR_SPACE_TYPE yuv_color_space_type,
+                                               const int64_t *color_adjust,
+                                               int color_adjust_shift)
 {
     __u32 ifourcc = akvcam_format_fourcc(iformat);
     __u32 ofourcc = akvcam_format_fourcc(oformat);
@@ -8396,7 +8602,25 @@ void akvcam_frame_convert_parameters_configure(akvcam_frame_convert_parameters_t
                                              yuv_color_space);
     akvcam_color_convert_set_yuv_color_space_type(color_convert,
                                                   yuv_color_space_type);
-    akvcam_color_convert_load_matrix(color_convert, ispecs, ospecs);
+
+    /* The color adjustments are folded into the conversion matrix, the
+     * vector conversion only uses the diagonal of the matrix, so use the full
+     * matrix instead.
+     */
+    fc->color_adjusted = color_adjust && icomponents == 3;
+
+    if (fc->color_adjusted) {
+        akvcam_color_convert_load_adjusted_matrix(color_convert,
+                                                  ispecs,
+                                                  ospecs,
+                                                  color_adjust,
+                                                  color_adjust_shift);
+
+        if (fc->convert_type == AKVCAM_CONVERT_TYPE_VECTOR)
+            fc->convert_type = AKVCAM_CONVERT_TYPE_3TO3;
+    } else {
+        akvcam_color_convert_load_matrix(color_convert, ispecs, ospecs);
+    }
 
     fc->comp_xi = NULL;
     fc->comp_yi = NULL;
@@ -8532,6 +8756,7 @@ void akvcam_frame_convert_parameters_configure(akvcam_frame_convert_parameters_t
 void akvcam_frame_convert_parameters_configure_scaling(akvcam_frame_convert_parameters_t fc,
                                                        akvcam_format_ct iformat,
                                                        akvcam_format_ct oformat,
+                                                       akvcam_rect_ct input_rect,
                                                        AKVCAM_ASPECT_RATIO_MODE aspect_ratio_mode)
 {
     int x;
@@ -8559,6 +8784,14 @@ void akvcam_frame_convert_parameters_configure_scaling(akvcam_frame_convert_para
     int oheight;
     struct v4l2_fract frame_rate;
 
+    // Only convert the source region inside the input rectangle.
+    if (input_rect->width > 0 && input_rect->height > 0) {
+        irect.x = akvcam_bound(0, input_rect->x, irect.width - 1);
+        irect.y = akvcam_bound(0, input_rect->y, irect.height - 1);
+        irect.width = akvcam_bound(1, input_rect->width, irect.width - irect.x);
+        irect.height = akvcam_bound(1, input_rect->height, irect.height - irect.y);
+    }
+
     if (output_convert_format_fourcc == 0)
         output_convert_format_fourcc = akvcam_format_fourcc(iformat);
 
@@ -8962,3 +9195,115 @@ void akvcam_frame_convert_parameters_clear_dl_buffers(akvcam_frame_convert_param
         fc->dl_src_width_offset_a = NULL;
     }
 }
+
+/* Downscaling works on the integral image of the whole input, and the byte
+ * swapping works on the whole output, those always convert everything.
+ */
+bool akvcam_frame_convert_parameters_can_track_damage(akvcam_frame_convert_parameters_ct fc)
+{
+    return fc->resize_mode != AKVCAM_RESIZE_MODE_DOWN
+           && fc->to_endian == __BYTE_ORDER__;
+}
+
+/* Compare the frame with the last converted one and reduce the output rows
+ * range to the rows depending on the input rows that changed, the rest of
+ * the output frame still holds the result of the previous conversion.
+ */
+void akvcam_frame_convert_parameters_damaged_rows(akvcam_frame_convert_parameters_t fc,
+                                                  akvcam_frame_ct frame)
+{
+    akvcam_format_t format = akvcam_frame_format_nr(frame);
+    size_t height = akvcam_format_height(format);
+    size_t first = height;
+    size_t last = 0;
+    size_t plane;
+    int align = 1;
+    int y0 = fc->ymax;
+    int y1 = fc->ymin;
+    int y;
+
+    if (!fc->last_input
+        || akvcam_frame_size(fc->last_input) != akvcam_frame_size(frame))
+        return;
+
+    for (plane = 0; plane < akvcam_format_planes(format); plane++) {
+        const uint8_t *data = akvcam_frame_plane_const_data(frame, plane);
+        const uint8_t *last_data =
+                akvcam_frame_plane_const_data(fc->last_input, plane);
+        size_t line_size = akvcam_format_line_size(format, plane);
+        size_t height_div = akvcam_format_height_div(format, plane);
+        size_t lines = height >> height_div;
+        size_t top;
+        size_t bottom;
+
+        for (top = 0; top < lines; top++)
+            if (memcmp(data + top * line_size,
+                       last_data + top * line_size,
+                       line_size))
+                break;
+
+        if (top >= lines)
+            continue;
+
+        for (bottom = lines; bottom > top + 1; bottom--)
+            if (memcmp(data + (bottom - 1) * line_size,
+                       last_data + (bottom - 1) * line_size,
+                       line_size))
+                break;
+
+        first = akvcam_min(first, top << height_div);
+        last = akvcam_max(last, bottom << height_div);
+    }
+
+    // Map the changed input rows to the output rows reading from them.
+    for (y = fc->ymin; y < fc->ymax; y++)
+        if (fc->src_height_1[y] >= (int) first
+            && fc->src_height[y] < (int) last) {
+            y0 = akvcam_min(y0, y);
+            y1 = y + 1;
+        }
+
+    /* Subsampled output planes are written from several rows, keep the
+     * range aligned to them.
+     */
+    if (fc->comp_xo)
+        align = akvcam_max(align, 1 << fc->comp_xo->height_div);
+
+    if (fc->comp_yo)
+        align = akvcam_max(align, 1 << fc->comp_yo->height_div);
+
+    if (fc->comp_zo)
+        align = akvcam_max(align, 1 << fc->comp_zo->height_div);
+
+    if (fc->comp_ao)
+        align = akvcam_max(align, 1 << fc->comp_ao->height_div);
+
+    if (y0 < y1) {
+        y0 = akvcam_max(fc->ymin, y0 - y0 % align);
+        y1 = akvcam_min(fc->ymax, y1 + (align - y1 % align) % align);
+    }
+
+    fc->ymin = y0;
+    fc->ymax = y1;
+}
+
+/* Keep a private copy of the converted frame, the producers may draw the
+ * next frame over the same object.
+ */
+void akvcam_frame_convert_parameters_keep_input(akvcam_frame_convert_parameters_t fc,
+                                                akvcam_frame_ct frame)
+{
+    if (fc->last_input
+        && akvcam_format_is_same_format(akvcam_frame_format_nr(fc->last_input),
+                                        akvcam_frame_format_nr(frame))
+        && akvcam_frame_size(fc->last_input) == akvcam_frame_size(frame)) {
+        memcpy(akvcam_frame_data(fc->last_input),
+               akvcam_frame_const_data(frame),
+               akvcam_frame_size(frame));
+
+        return;
+    }
+
+    akvcam_frame_delete(fc->last_input);
+    fc->last_input = akvcam_frame_new_copy(frame);
+}
@@ -20,6 +20,7 @@
 #define AKVCAM_CONVERTER_H
 
 #include <linux/types.h>
+#include <linux/videodev2.h>
 
 #include "converter_types.h"
 #include "color_convert_types.h"
@@ -48,8 +49,17 @@ void akvcam_converter_set_scaling_mode(akvcam_converter_t self,
 AKVCAM_ASPECT_RATIO_MODE akvcam_converter_aspect_ratio_mode(akvcam_converter_ct self);
 void akvcam_converter_set_aspect_ratio_mode(akvcam_converter_t self,
                                             AKVCAM_ASPECT_RATIO_MODE aspect_ratio_mode);
+void akvcam_converter_set_color_adjust(akvcam_converter_t self,
+                                       const int64_t *color_matrix,
+                                       int shift);
+void akvcam_converter_set_input_rect(akvcam_converter_t self,
+                                     const struct v4l2_rect *rect);
 void akvcam_converter_set_cache_index(akvcam_converter_t self,
                                       int index);
+void akvcam_converter_set_device_num(akvcam_converter_t self, int32_t num);
+bool akvcam_converter_damage_tracking(akvcam_converter_ct self);
+void akvcam_converter_set_damage_tracking(akvcam_converter_t self,
+                                          bool damage_tracking);
 bool akvcam_converter_begin(akvcam_converter_t self);
 void akvcam_converter_end(akvcam_converter_t self);
 akvcam_frame_t akvcam_converter_convert(akvcam_converter_t self,
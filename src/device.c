@@ -16,26 +16,42 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define AKVCAM_LOG_CATEGORY AKVCAM_LOG_CATEGORY_DEVICE
+
 #include <linux/delay.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/mutex.h>
-#include <linux/random.h>
 #include <linux/slab.h>
+#include <linux/version.h>
+#include <linux/wait.h>
+#include <linux/xxhash.h>
 #include <media/v4l2-device.h>
+#include <media/v4l2-fh.h>
 #include <media/v4l2-ioctl.h>
 #include <media/videobuf2-v4l2.h>
 
 #include "device.h"
 #include "attributes.h"
 #include "buffers.h"
+#include "compositor.h"
 #include "controls.h"
 #include "converter.h"
 #include "format.h"
+#include "format_specs.h"
 #include "frame.h"
 #include "frame_filter.h"
+#include "frame_pyramid.h"
+#include "frame_queue.h"
+#include "frame_ring.h"
 #include "ioctl.h"
 #include "list.h"
+#include "rate_converter.h"
 #include "log.h"
+#include "rendition_cache.h"
+#include "stats.h"
+#include "test_pattern.h"
+#include "trace.h"
 
 struct akvcam_device
 {
@@ -47,14 +63,30 @@ struct akvcam_device
     akvcam_controls_t controls;
     akvcam_devices_list_t connected_devices;
     akvcam_buffers_t buffers;
-    akvcam_frame_t current_frame;
+    akvcam_list_tt(akvcam_buffers_t) readers;
+    akvcam_frame_queue_t frame_queue;
+    akvcam_frame_ring_t frame_ring;
+    akvcam_compositor_t compositor;
+    akvcam_rate_converter_t rate_converter;
     akvcam_frame_ct default_frame;
+    akvcam_frame_ct converted_default_source;
+    akvcam_frame_t converted_default_frame;
+    akvcam_format_t converted_default_format;
+    akvcam_rendition_controls converted_default_controls;
+    bool converted_default_direct;
+    akvcam_rendition_cache_t rendition_cache;
+    akvcam_frame_pyramid_t frame_pyramid;
+    akvcam_test_pattern_t test_pattern;
+    akvcam_stats_t stats;
     akvcam_frame_filter_ct frame_filter;
     akvcam_converter_t in_video_converter;
     akvcam_converter_t out_video_converter;
     struct mutex device_mutex;
     struct mutex frame_mutex;
     struct mutex clock_mutex;
+    struct mutex readers_mutex;
+    struct mutex streaming_mutex;
+    wait_queue_head_t frame_wait;
     struct v4l2_device v4l2_dev;
     struct video_device *vdev;
     struct task_struct *thread;
@@ -62,7 +94,15 @@ struct akvcam_device
     enum v4l2_buf_type buffer_type;
     AKVCAM_RW_MODE rw_mode;
     bool direct_mode;
+    bool deduplicate;
+    bool negotiate;
+    bool shared;
+    size_t streaming_readers;
+    AKVCAM_CLOCK_MODE clock_mode;
+    bool frame_ready;
     int32_t videonr;
+    uint64_t frame_sequence;
+    uint64_t frame_hash;
 
     // Capture controls
     int brightness;
@@ -80,8 +120,21 @@ struct akvcam_device
     bool vertical_flip;
     AKVCAM_SCALING_MODE scaling;
     AKVCAM_ASPECT_RATIO_MODE aspect_ratio;
+
+    // Crop rectangle and the source size it refers to
+    struct v4l2_rect crop;
+    struct v4l2_rect crop_bounds;
 };
 
+/* In shared mode every open of the device gets its own buffers queue, all
+ * of them filled with the same frames.
+ */
+typedef struct
+{
+    struct v4l2_fh fh;
+    akvcam_buffers_t buffers;
+} akvcam_device_reader, *akvcam_device_reader_t;
+
 typedef int (*akvcam_thread_t)(void *data);
 static const struct v4l2_file_operations akvcam_device_fops;
 
@@ -93,8 +146,43 @@ void akvcam_device_clock_run_once(akvcam_device_t self);
 int akvcam_device_clock_start(akvcam_device_t self);
 void akvcam_device_clock_stop(akvcam_device_t self);
 int akvcam_device_clock_timeout(akvcam_device_t self);
+bool akvcam_device_producer_streaming(akvcam_device_ct self);
 akvcam_frame_t akvcam_device_frame_apply_adjusts(akvcam_device_ct self,
                                                  akvcam_frame_ct frame);
+bool akvcam_device_frame_crop(akvcam_device_ct self,
+                              akvcam_format_ct format,
+                              struct v4l2_rect *rect);
+void akvcam_device_rendition_controls(akvcam_device_ct self,
+                                      akvcam_rendition_controls_t controls);
+akvcam_frame_t akvcam_device_converted_default_frame(akvcam_device_t self,
+                                                     akvcam_frame_ct source);
+int akvcam_device_write_frame(akvcam_device_t self,
+                              akvcam_frame_t frame,
+                              akvcam_frame_ct metadata);
+bool akvcam_device_back_pressured(akvcam_device_t self);
+bool akvcam_device_frame_unchanged(akvcam_device_t self,
+                                   akvcam_frame_ct frame);
+bool akvcam_device_adjusting(akvcam_device_ct self);
+bool akvcam_device_passthrough(akvcam_device_ct self, akvcam_frame_ct frame);
+int akvcam_device_frame_ring_mapped(akvcam_device_t self);
+int akvcam_device_frame_ring_unmapped(akvcam_device_t self);
+int akvcam_device_write_shared_frame(akvcam_device_t self,
+                                     akvcam_frame_t frame,
+                                     akvcam_frame_ct metadata);
+int akvcam_device_reader_streaming_started(akvcam_device_t self);
+int akvcam_device_reader_streaming_stopped(akvcam_device_t self);
+int akvcam_device_open(struct file *filp);
+int akvcam_device_release(struct file *filp);
+ssize_t akvcam_device_read(struct file *filp,
+                           char __user *data,
+                           size_t size,
+                           loff_t *offset);
+ssize_t akvcam_device_write(struct file *filp,
+                            const char __user *data,
+                            size_t size,
+                            loff_t *offset);
+int akvcam_device_mmap(struct file *filp, struct vm_area_struct *vma);
+__poll_t akvcam_device_poll(struct file *filp, struct poll_table_struct *wait);
 
 akvcam_device_t akvcam_device_new(const char *name,
                                   const char *description,
@@ -117,17 +205,26 @@ akvcam_device_t akvcam_device_new(const char *name,
                      akvcam_format_new_copy(akvcam_list_front(formats));
     self->controls = akvcam_controls_new(type);
     self->connected_devices = akvcam_list_new();
+    self->readers = akvcam_list_new();
     multiplanar = akvcam_format_have_multiplanar(formats);
     self->buffer_type = akvcam_device_v4l2_from_device_type(type, multiplanar);
     self->buffers = akvcam_buffers_new(rw_mode, self->buffer_type);
-    self->current_frame = NULL;
+    self->frame_queue = akvcam_frame_queue_new();
+    self->rate_converter = akvcam_rate_converter_new();
     self->default_frame = default_frame;
+    self->rendition_cache = akvcam_rendition_cache_new();
+    self->frame_pyramid = akvcam_frame_pyramid_new();
+    self->test_pattern = akvcam_test_pattern_new();
+    self->stats = akvcam_stats_new();
     self->frame_filter = frame_filter;
     self->rw_mode = rw_mode;
     self->videonr = -1;
     mutex_init(&self->device_mutex);
     mutex_init(&self->frame_mutex);
     mutex_init(&self->clock_mutex);
+    mutex_init(&self->readers_mutex);
+    mutex_init(&self->streaming_mutex);
+    init_waitqueue_head(&self->frame_wait);
 
     self->in_video_converter = akvcam_converter_new();
     self->out_video_converter = akvcam_converter_new();
@@ -149,9 +246,19 @@ static void akvcam_device_free(struct kref *ref)
 
     akvcam_converter_delete(self->in_video_converter);
     akvcam_converter_delete(self->out_video_converter);
-    akvcam_frame_delete(self->current_frame);
+    akvcam_frame_queue_delete(self->frame_queue);
+    akvcam_frame_ring_delete(self->frame_ring);
+    akvcam_compositor_delete(self->compositor);
+    akvcam_rate_converter_delete(self->rate_converter);
+    akvcam_frame_delete(self->converted_default_frame);
+    akvcam_format_delete(self->converted_default_format);
+    akvcam_rendition_cache_delete(self->rendition_cache);
+    akvcam_frame_pyramid_delete(self->frame_pyramid);
+    akvcam_test_pattern_delete(self->test_pattern);
     akvcam_buffers_delete(self->buffers);
     akvcam_device_unregister(self);
+    akvcam_stats_delete(self->stats);
+    akvcam_list_delete(self->readers);
     akvcam_list_delete(self->connected_devices);
     akvcam_controls_delete(self->controls);
     akvcam_format_delete(self->format);
@@ -200,7 +307,7 @@ bool akvcam_device_register(akvcam_device_t self)
             self->vdev->ioctl_ops = akvcam_ioctl_ops();
             self->vdev->tvnorms = V4L2_STD_ALL;
             self->vdev->release = video_device_release_empty;
-            self->vdev->queue = queue;
+            self->vdev->queue = self->shared? NULL: queue;
             self->vdev->lock = &self->device_mutex;
             self->vdev->ctrl_handler =
                     self->direct_mode?
@@ -217,6 +324,13 @@ bool akvcam_device_register(akvcam_device_t self)
                 v4l2_device_unregister(&self->v4l2_dev);
                 video_device_release(self->vdev);
                 self->vdev = NULL;
+            } else {
+                akvcam_buffers_set_device_num(self->buffers, self->vdev->num);
+                akvcam_converter_set_device_num(self->in_video_converter,
+                                                self->vdev->num);
+                akvcam_converter_set_device_num(self->out_video_converter,
+                                                self->vdev->num);
+                akvcam_stats_debugfs_add(self->stats, self->vdev->num);
             }
         } else {
             v4l2_device_unregister(&self->v4l2_dev);
@@ -233,6 +347,7 @@ void akvcam_device_unregister(akvcam_device_t self)
     if (!self->vdev)
         return;
 
+    akvcam_stats_debugfs_remove(self->stats);
     video_unregister_device(self->vdev);
     video_device_release(self->vdev);
     self->vdev = NULL;
@@ -287,9 +402,230 @@ void akvcam_device_set_direct_mode(akvcam_device_t self, bool direct_mode)
     self->direct_mode = direct_mode;
 }
 
+bool akvcam_device_deduplicate(akvcam_device_ct self)
+{
+    return self->deduplicate;
+}
+
+void akvcam_device_set_deduplicate(akvcam_device_t self, bool deduplicate)
+{
+    self->deduplicate = deduplicate;
+}
+
+bool akvcam_device_damage_tracking(akvcam_device_ct self)
+{
+    return akvcam_converter_damage_tracking(self->in_video_converter);
+}
+
+void akvcam_device_set_damage_tracking(akvcam_device_t self,
+                                       bool damage_tracking)
+{
+    akvcam_converter_set_damage_tracking(self->in_video_converter,
+                                         damage_tracking);
+    akvcam_converter_set_damage_tracking(self->out_video_converter,
+                                         damage_tracking);
+}
+
+bool akvcam_device_negotiate(akvcam_device_ct self)
+{
+    return self->negotiate;
+}
+
+void akvcam_device_set_negotiate(akvcam_device_t self, bool negotiate)
+{
+    self->negotiate = negotiate;
+}
+
+bool akvcam_device_shared(akvcam_device_ct self)
+{
+    return self->shared;
+}
+
+void akvcam_device_set_shared(akvcam_device_t self, bool shared)
+{
+    // The queue of the device can't be swapped once registered.
+    if (self->type != AKVCAM_DEVICE_TYPE_CAPTURE || self->vdev)
+        return;
+
+    self->shared = shared;
+}
+
+bool akvcam_device_compose(akvcam_device_ct self)
+{
+    return self->compositor != NULL;
+}
+
+void akvcam_device_set_compose(akvcam_device_t self, bool compose)
+{
+    if (self->type != AKVCAM_DEVICE_TYPE_CAPTURE
+        || compose == (self->compositor != NULL))
+        return;
+
+    if (compose) {
+        self->compositor = akvcam_compositor_new();
+    } else {
+        akvcam_compositor_delete(self->compositor);
+        self->compositor = NULL;
+    }
+}
+
+bool akvcam_device_add_compose_source(akvcam_device_t self,
+                                      akvcam_device_ct output,
+                                      const struct v4l2_rect *rect,
+                                      int z)
+{
+    if (!self->compositor)
+        return false;
+
+    return akvcam_compositor_add_source(self->compositor, output, rect, z);
+}
+
+akvcam_compositor_t akvcam_device_compositor_nr(akvcam_device_ct self)
+{
+    return self->compositor;
+}
+
+void akvcam_device_set_overlay(akvcam_device_t self,
+                               akvcam_overlay_t overlay)
+{
+    if (self->type != AKVCAM_DEVICE_TYPE_CAPTURE)
+        return;
+
+    akvcam_buffers_set_overlay(self->buffers, overlay);
+}
+
+AKVCAM_CLOCK_MODE akvcam_device_clock_mode(akvcam_device_ct self)
+{
+    return self->clock_mode;
+}
+
+void akvcam_device_set_clock_mode(akvcam_device_t self,
+                                  AKVCAM_CLOCK_MODE clock_mode)
+{
+    self->clock_mode = clock_mode;
+}
+
+AKVCAM_TEST_PATTERN akvcam_device_test_pattern(akvcam_device_ct self)
+{
+    return akvcam_test_pattern_pattern(self->test_pattern);
+}
+
+bool akvcam_device_timestamp_copy(akvcam_device_ct self)
+{
+    return akvcam_buffers_timestamp_copy(self->buffers);
+}
+
+void akvcam_device_set_timestamp_copy(akvcam_device_t self,
+                                      bool timestamp_copy)
+{
+    akvcam_buffers_set_timestamp_copy(self->buffers, timestamp_copy);
+}
+
+AKVCAM_MEMORY_BACKEND akvcam_device_memory_backend(akvcam_device_ct self)
+{
+    return akvcam_buffers_memory_backend(self->buffers);
+}
+
+void akvcam_device_set_memory_backend(akvcam_device_t self,
+                                      AKVCAM_MEMORY_BACKEND backend,
+                                      struct device *dma_device)
+{
+    akvcam_buffers_set_memory_backend(self->buffers, backend, dma_device);
+}
+
+size_t akvcam_device_frame_ring_slots(akvcam_device_ct self)
+{
+    return self->frame_ring? akvcam_frame_ring_slots(self->frame_ring): 0;
+}
+
+void akvcam_device_set_frame_ring_slots(akvcam_device_t self, size_t slots)
+{
+    if (self->type != AKVCAM_DEVICE_TYPE_OUTPUT
+        || self->frame_ring
+        || slots < 1)
+        return;
+
+    self->frame_ring = akvcam_frame_ring_new(slots, self->formats);
+    akvcam_frame_ring_set_format(self->frame_ring, self->format);
+    akvcam_connect(frame_ring, self->frame_ring, mapped, self, akvcam_device_frame_ring_mapped);
+    akvcam_connect(frame_ring, self->frame_ring, unmapped, self, akvcam_device_frame_ring_unmapped);
+}
+
+void akvcam_device_set_frame_queue(akvcam_device_t self,
+                                   size_t depth,
+                                   AKVCAM_FRAME_QUEUE_POLICY policy)
+{
+    if (!mutex_lock_interruptible(&self->frame_mutex)) {
+        akvcam_frame_queue_set_depth(self->frame_queue, depth);
+        akvcam_frame_queue_set_policy(self->frame_queue, policy);
+        mutex_unlock(&self->frame_mutex);
+    }
+}
+
+void akvcam_device_set_rate_conversion(akvcam_device_t self,
+                                       AKVCAM_RATE_CONVERSION mode)
+{
+    if (!mutex_lock_interruptible(&self->frame_mutex)) {
+        akvcam_rate_converter_set_mode(self->rate_converter, mode);
+        mutex_unlock(&self->frame_mutex);
+    }
+}
+
+void akvcam_device_set_test_pattern(akvcam_device_t self,
+                                    AKVCAM_TEST_PATTERN pattern)
+{
+    akvcam_test_pattern_set_pattern(self->test_pattern, pattern);
+}
+
+/* With negotiation enabled, the formats matching the active format of the
+ * output device are listed first, so clients picking the first format, or
+ * asking for the nearest one, land on a format that needs no conversion.
+ */
 akvcam_formats_list_t akvcam_device_formats(akvcam_device_ct self)
 {
-    return akvcam_list_new_copy(self->formats);
+    akvcam_formats_list_t formats;
+    akvcam_format_t preferred;
+    akvcam_list_element_t it = NULL;
+    size_t pass;
+
+    preferred = akvcam_device_preferred_format(self);
+
+    if (!preferred)
+        return akvcam_list_new_copy(self->formats);
+
+    formats = akvcam_list_new();
+
+    for (pass = 0; pass < 2; pass++)
+        for (;;) {
+            akvcam_format_t format = akvcam_list_next(self->formats, &it);
+
+            if (!it)
+                break;
+
+            if (akvcam_format_is_same_format(format, preferred) == (pass == 0))
+                akvcam_list_push_back(formats,
+                                      format,
+                                      akvcam_list_element_copier(it),
+                                      akvcam_list_element_deleter(it));
+        }
+
+    akvcam_format_delete(preferred);
+
+    return formats;
+}
+
+akvcam_format_t akvcam_device_preferred_format(akvcam_device_ct self)
+{
+    akvcam_device_t output;
+
+    if (!self->negotiate
+        || self->type != AKVCAM_DEVICE_TYPE_CAPTURE
+        || akvcam_list_empty(self->connected_devices))
+        return NULL;
+
+    output = akvcam_list_front(self->connected_devices);
+
+    return akvcam_format_new_copy(output->format);
 }
 
 akvcam_format_t akvcam_device_format_nr(akvcam_device_ct self)
@@ -304,8 +640,70 @@ akvcam_format_t akvcam_device_format(akvcam_device_ct self)
 
 void akvcam_device_set_format(akvcam_device_t self, akvcam_format_t format)
 {
+    akvcam_list_element_t it = NULL;
+
     akvcam_format_copy(self->format, format);
     akvcam_buffers_set_format(self->buffers, format);
+    mutex_lock(&self->readers_mutex);
+
+    for (;;) {
+        akvcam_buffers_t buffers = akvcam_list_next(self->readers, &it);
+
+        if (!it)
+            break;
+
+        akvcam_buffers_set_format(buffers, format);
+    }
+
+    mutex_unlock(&self->readers_mutex);
+
+    if (self->frame_ring)
+        akvcam_frame_ring_set_format(self->frame_ring, format);
+}
+
+/* The crop rectangle refers to the frames coming from the output device,
+ * or to the capture format if it isn't connected.
+ */
+void akvcam_device_crop_bounds(akvcam_device_ct self, struct v4l2_rect *rect)
+{
+    akvcam_device_t output_device = akvcam_list_front(self->connected_devices);
+    akvcam_format_t format = output_device? output_device->format: self->format;
+
+    rect->left = 0;
+    rect->top = 0;
+    rect->width = (__u32) akvcam_format_width(format);
+    rect->height = (__u32) akvcam_format_height(format);
+}
+
+void akvcam_device_crop(akvcam_device_ct self, struct v4l2_rect *rect)
+{
+    if (self->crop.width < 1 || self->crop.height < 1)
+        akvcam_device_crop_bounds(self, rect);
+    else
+        *rect = self->crop;
+}
+
+void akvcam_device_set_crop(akvcam_device_t self, struct v4l2_rect *rect)
+{
+    struct v4l2_rect bounds;
+
+    akvcam_device_crop_bounds(self, &bounds);
+
+    if (bounds.width < 1 || bounds.height < 1)
+        return;
+
+    rect->width = akvcam_bound(1, rect->width, bounds.width);
+    rect->height = akvcam_bound(1, rect->height, bounds.height);
+    rect->left = akvcam_bound(0, rect->left, (__s32) (bounds.width - rect->width));
+    rect->top = akvcam_bound(0, rect->top, (__s32) (bounds.height - rect->height));
+
+    // Cropping the whole frame is the same as not cropping.
+    if (rect->width == bounds.width && rect->height == bounds.height)
+        memset(&self->crop, 0, sizeof(struct v4l2_rect));
+    else
+        self->crop = *rect;
+
+    self->crop_bounds = bounds;
 }
 
 akvcam_controls_t akvcam_device_controls_nr(akvcam_device_ct self)
@@ -428,11 +826,35 @@ int akvcam_device_controls_updated(akvcam_device_t self, __u32 id, __s32 value)
 
 int akvcam_device_stop_streaming(akvcam_device_t self)
 {
+    akvcam_list_element_t it = NULL;
+
+    // The producer may still be feeding frames through the ring.
+    if (self->frame_ring && akvcam_frame_ring_mapped(self->frame_ring))
+        return 0;
+
     akvcam_device_clock_stop(self);
 
+    // Clear the area of this output in the composited captures.
+    if (self->type == AKVCAM_DEVICE_TYPE_OUTPUT)
+        for (;;) {
+            akvcam_device_t capture_device =
+                    akvcam_list_next(self->connected_devices, &it);
+
+            if (!it)
+                break;
+
+            if (capture_device->compositor) {
+                akvcam_compositor_set_frame(capture_device->compositor,
+                                            self,
+                                            NULL);
+                wake_up_interruptible(&capture_device->frame_wait);
+            }
+        }
+
     if (!mutex_lock_interruptible(&self->frame_mutex)) {
-        akvcam_frame_delete(self->current_frame);
-        self->current_frame = NULL;
+        akvcam_frame_queue_clear(self->frame_queue);
+        akvcam_rate_converter_reset(self->rate_converter);
+        self->frame_ready = false;
         mutex_unlock(&self->frame_mutex);
     }
 
@@ -454,6 +876,16 @@ akvcam_devices_list_t akvcam_device_connected_devices(akvcam_device_ct self)
     return akvcam_list_ref(self->connected_devices);
 }
 
+akvcam_frame_pyramid_t akvcam_device_frame_pyramid_nr(akvcam_device_ct self)
+{
+    return self->frame_pyramid;
+}
+
+akvcam_stats_t akvcam_device_stats_nr(akvcam_device_ct self)
+{
+    return self->stats;
+}
+
 __u32 akvcam_device_caps(akvcam_device_ct self)
 {
     __u32 caps = 0;
@@ -491,7 +923,9 @@ __u32 akvcam_device_caps(akvcam_device_ct self)
 
 void akvcam_device_clock_run_once(akvcam_device_t self)
 {
-    bool using_default = false;
+    akvcam_frame_ct placeholder = NULL;
+    uint64_t sequence = 0;
+    uint64_t tick_start = ktime_get_ns();
 
     akpr_function();
 
@@ -503,68 +937,148 @@ void akvcam_device_clock_run_once(akvcam_device_t self)
         int result;
 
         if (!mutex_lock_interruptible(&self->frame_mutex)) {
-            if (output_device
+            /* Inter coded frames can't be repeated, wait for the next one
+             * instead of reading the last frame again.
+             */
+            if (!self->compositor
+                && output_device
                 && output_device->thread != NULL
-                && self->current_frame) {
-                akpr_debug("Reading current frame.\n");
-                frame = akvcam_frame_new_copy(self->current_frame);
+                && (!akvcam_format_is_inter_coded(self->format)
+                    || akvcam_frame_queue_size(self->frame_queue) > 0)) {
+                akpr_debug("Reading queued frame.\n");
+                frame = akvcam_frame_queue_pop(self->frame_queue, &sequence);
             }
 
+            self->frame_ready =
+                    frame && akvcam_frame_queue_size(self->frame_queue) > 0;
+
             mutex_unlock(&self->frame_mutex);
         }
 
+        if (self->compositor) {
+            akpr_debug("Composing frame.\n");
+            frame = akvcam_compositor_frame(self->compositor,
+                                            self->format,
+                                            self->scaling,
+                                            self->aspect_ratio);
+        }
+
+        // No frame from the output, using a default frame or a test pattern.
         if (!frame) {
-            if (self->default_frame && akvcam_frame_size(self->default_frame) > 0) {
+            akvcam_stats_count(self->stats,
+                               AKVCAM_STATS_COUNTER_DEFAULT_FRAMES);
+
+            if (akvcam_format_is_compressed(self->format)) {
+                akpr_debug("No placeholder for compressed formats.\n");
+            } else if (self->default_frame && akvcam_frame_size(self->default_frame) > 0) {
                 akpr_debug("Reading default frame.\n");
-                frame = akvcam_frame_new_copy(self->default_frame);
-                using_default = true;
+                placeholder = self->default_frame;
             } else {
-                akpr_debug("Generating random frame.\n");
-                frame = akvcam_frame_new(self->format);
-                get_random_bytes(akvcam_frame_data(frame),
-                                 (int) akvcam_frame_size(frame));
+                akpr_debug("Generating test pattern.\n");
+                frame = akvcam_test_pattern_frame(self->test_pattern,
+                                                  self->format);
+
+                if (akvcam_test_pattern_is_static(self->test_pattern))
+                    placeholder = frame;
             }
         }
 
-        if (self->direct_mode) {
+        if (!frame && !placeholder) {
+            // Leave the clients waiting until the producer sends a frame.
+            result = 0;
+            adjusted_frame = NULL;
+        } else if (placeholder) {
+            /* The default frame is static, so it's converted once and
+             * written as-is until the format or the controls change.
+             */
+            adjusted_frame =
+                    akvcam_device_converted_default_frame(self, placeholder);
+            result = akvcam_device_write_frame(self, adjusted_frame, NULL);
+        } else if (self->direct_mode) {
             /* In direct mode: skip all adjustments and format conversion,
              * write the frame as-is directly to the capture buffer.
-             * Exception: The default frames must still be converted to the
-             * capture device format because they may have been created in a
-             * different pixel format. */
-            if (!using_default) {
-                /* Frame came from the output device - formats are guaranteed
-                 * to match (enforced at connect time), copy directly. */
-                result = akvcam_buffers_write_frame(self->buffers, frame);
-            } else {
-                /* Fallback frame: convert to capture format first. */
-                akvcam_frame_t converted;
-
-                akvcam_converter_set_output_format(self->out_video_converter, self->format);
-                akvcam_converter_set_scaling_mode(self->out_video_converter, self->scaling);
-                akvcam_converter_set_aspect_ratio_mode(self->out_video_converter, self->aspect_ratio);
-
-                akvcam_converter_begin(self->out_video_converter);
-                converted =
-                    akvcam_converter_convert(self->out_video_converter, frame);
-                akvcam_converter_end(self->out_video_converter);
-                result = akvcam_buffers_write_frame(self->buffers, converted);
-                akvcam_frame_delete(converted);
+             * Frame came from the output device - formats are guaranteed
+             * to match (enforced at connect time), copy directly. */
+            result = akvcam_device_write_frame(self, frame, NULL);
+            adjusted_frame = NULL;
+        } else if (self->compositor && !akvcam_device_adjusting(self)) {
+            /* The composited frame is already rendered in the capture
+             * format.
+             */
+            result = akvcam_device_write_frame(self, frame, NULL);
+            adjusted_frame = NULL;
+        } else if (akvcam_device_passthrough(self, frame)) {
+            /* The negotiated format matches the frames from the output
+             * device and there is nothing to adjust, this is the same as
+             * direct mode.
+             */
+            result = akvcam_device_write_frame(self, frame, NULL);
+            adjusted_frame = NULL;
+        } else if (akvcam_format_is_compressed(self->format)
+                   || akvcam_format_is_compressed(akvcam_frame_format_nr(frame))) {
+            /* Compressed frames can't be converted nor adjusted, they are
+             * only passed through when the formats match.
+             */
+            result = akvcam_format_is_same_format(akvcam_frame_format_nr(frame),
+                                                  self->format)?
+                        akvcam_device_write_frame(self, frame, NULL):
+                        -EINVAL;
+            adjusted_frame = NULL;
+        } else if (sequence > 0) {
+            /* Share the rendered frame between the capture devices having
+             * the same format and controls. Unchanged frames from the
+             * producer keep the same sequence, so the last rendition is
+             * reused instead of converting the frame again.
+             */
+            akvcam_rendition_controls controls;
+            akvcam_frame_t source = akvcam_frame_ref(frame);
+
+            /* Downscale from the smallest pyramid level that is still
+             * larger than the capture format instead of the full source.
+             */
+            if (self->scaling == AKVCAM_SCALING_MODE_LINEAR
+                && akvcam_list_size(output_device->connected_devices) > 1) {
+                akvcam_frame_t level =
+                        akvcam_frame_pyramid_level(output_device->frame_pyramid,
+                                                   frame,
+                                                   sequence,
+                                                   akvcam_format_width(self->format),
+                                                   akvcam_format_height(self->format));
+
+                if (level) {
+                    akvcam_frame_delete(source);
+                    source = level;
+                }
             }
 
-            adjusted_frame = NULL;
+            akvcam_device_rendition_controls(self, &controls);
+            adjusted_frame =
+                akvcam_rendition_cache_frame(output_device->rendition_cache,
+                                             self->format,
+                                             &controls,
+                                             sequence,
+                                             source,
+                                             (akvcam_rendition_render_t)
+                                             akvcam_device_frame_apply_adjusts,
+                                             self);
+            akvcam_frame_delete(source);
+
+            /* The rendition may come from an older frame with the same
+             * content, take the timestamp from the current one.
+             */
+            result = akvcam_device_write_frame(self, adjusted_frame, frame);
         } else {
             adjusted_frame = akvcam_device_frame_apply_adjusts(self, frame);
-            result = akvcam_buffers_write_frame(self->buffers, adjusted_frame);
+            result = akvcam_device_write_frame(self, adjusted_frame, NULL);
         }
 
         akvcam_frame_delete(frame);
 
-        if (result < 0) {
+        if (result < 0 && akpr_enabled(LOGLEVEL_ERR)) {
             char *error_str = kzalloc(AKVCAM_MAX_STRING_SIZE, GFP_KERNEL);
 
             akvcam_string_from_error(result, error_str, AKVCAM_MAX_STRING_SIZE);
-            akpr_err("Failed writing frame: %s.\n", error_str);
+            akpr_err_ratelimited("Failed writing frame: %s.\n", error_str);
             kfree(error_str);
         }
 
@@ -572,9 +1086,28 @@ void akvcam_device_clock_run_once(akvcam_device_t self)
             akvcam_frame_delete(adjusted_frame);
     } else {
         akvcam_list_element_t it = NULL;
-        akvcam_frame_t frame = akvcam_buffers_read_frame(self->buffers);
+        akvcam_frame_t frame = NULL;
+
+        /* Leave the frame in the output queue while a back-pressured
+         * capture still has no room for it.
+         */
+        if (!akvcam_device_back_pressured(self)) {
+            if (self->frame_ring)
+                frame = akvcam_frame_ring_read_frame(self->frame_ring);
+
+            if (!frame)
+                frame = akvcam_buffers_read_frame(self->buffers);
+        }
 
         if (frame) {
+            akvcam_stats_count(self->stats,
+                               AKVCAM_STATS_COUNTER_FRAMES_RECEIVED);
+
+            if (!akvcam_device_frame_unchanged(self, frame))
+                self->frame_sequence++;
+
+            sequence = self->frame_sequence;
+
             for (;;) {
                 akvcam_device_t capture_device =
                         akvcam_list_next(self->connected_devices, &it);
@@ -583,15 +1116,75 @@ void akvcam_device_clock_run_once(akvcam_device_t self)
                     break;
 
                 if (!mutex_lock_interruptible(&capture_device->frame_mutex)) {
-                    akvcam_frame_delete(capture_device->current_frame);
-                    capture_device->current_frame = akvcam_frame_new_copy(frame);
+                    akvcam_frame_t frames[AKVCAM_RATE_CONVERTER_MAX_FRAMES];
+                    size_t n;
+                    size_t i;
+
+                    if (capture_device->compositor) {
+                        /* The compositor keeps the last frame of each
+                         * source, and draws them at the capture rate.
+                         */
+                        akvcam_compositor_set_frame(capture_device->compositor,
+                                                    self,
+                                                    frame);
+                        n = 1;
+                    } else if (akvcam_format_is_inter_coded(capture_device->format)) {
+                        /* Dropping or repeating inter coded frames corrupts
+                         * the stream, they are delivered 1:1 and the output
+                         * is held back while the queue is full.
+                         */
+                        akvcam_frame_queue_push(capture_device->frame_queue,
+                                                frame,
+                                                sequence);
+                        n = 1;
+                    } else {
+                        /* Frames dropped by the rate converter never reach
+                         * the capture, so they are never converted.
+                         */
+                        akvcam_rate_converter_set_rates(capture_device->rate_converter,
+                                                        akvcam_format_frame_rate(self->format),
+                                                        akvcam_format_frame_rate(capture_device->format));
+                        n = akvcam_rate_converter_convert(capture_device->rate_converter,
+                                                          frame,
+                                                          frames);
+
+                        for (i = 0; i < n; i++) {
+                            // Blended frames are unique to this capture, don't share them.
+                            if (!akvcam_frame_queue_push(capture_device->frame_queue,
+                                                         frames[i],
+                                                         frames[i] == frame? sequence: 0))
+                                akvcam_stats_count(capture_device->stats,
+                                                   AKVCAM_STATS_COUNTER_FRAMES_DROPPED);
+
+                            akvcam_frame_delete(frames[i]);
+                        }
+                    }
+
+                    if (n > 0)
+                        capture_device->frame_ready = true;
+
                     mutex_unlock(&capture_device->frame_mutex);
+
+                    if (n > 0)
+                        wake_up_interruptible(&capture_device->frame_wait);
+
+                    trace_akvcam_frame_handoff(akvcam_device_num(self),
+                                               akvcam_device_num(capture_device),
+                                               sequence,
+                                               akvcam_frame_size(frame));
                 }
             }
 
             akvcam_frame_delete(frame);
+            akvcam_stats_record(self->stats,
+                                AKVCAM_STATS_STAGE_READ,
+                                ktime_get_ns() - tick_start);
         }
     }
+
+    akvcam_stats_record(self->stats,
+                        AKVCAM_STATS_STAGE_TICK,
+                        ktime_get_ns() - tick_start);
 }
 
 int akvcam_device_clock_start(akvcam_device_t self)
@@ -642,6 +1235,31 @@ int akvcam_device_clock_timeout(akvcam_device_t self)
         tsleep /= frame_rate.numerator;
 
     while (!kthread_should_stop()) {
+        /* In producer clock mode the capture emits a frame as soon as the
+         * output device hands one over, the frame period is only used as a
+         * watchdog for sending the placeholder frame when there is no
+         * producer.
+         */
+        if (self->clock_mode == AKVCAM_CLOCK_MODE_PRODUCER
+            && self->type == AKVCAM_DEVICE_TYPE_CAPTURE) {
+            long ready =
+                wait_event_interruptible_timeout(self->frame_wait,
+                                                 self->frame_ready
+                                                 || kthread_should_stop(),
+                                                 msecs_to_jiffies(tsleep));
+
+            if (kthread_should_stop())
+                break;
+
+            // Don't repeat the last frame while the producer is running late.
+            if (ready == 0 && akvcam_device_producer_streaming(self))
+                continue;
+
+            akvcam_device_clock_run_once(self);
+
+            continue;
+        }
+
         akvcam_device_clock_run_once(self);
 
         /* In direct_mode output devices, yield immediately to minimise
@@ -655,16 +1273,34 @@ int akvcam_device_clock_timeout(akvcam_device_t self)
     return 0;
 }
 
+bool akvcam_device_producer_streaming(akvcam_device_ct self)
+{
+    akvcam_list_element_t it = NULL;
+
+    // Any of the composited outputs keeps the capture waiting for frames.
+    for (;;) {
+        akvcam_device_t output_device =
+                akvcam_list_next(self->connected_devices, &it);
+
+        if (!it)
+            break;
+
+        if (output_device->thread != NULL)
+            return true;
+
+        if (!self->compositor)
+            break;
+    }
+
+    return false;
+}
+
 akvcam_frame_t akvcam_device_frame_apply_adjusts(akvcam_device_ct self,
                                                  akvcam_frame_ct frame)
 {
-    bool horizontal_flip = self->horizontal_flip != self->horizontal_mirror;
-    bool vertical_flip = self->vertical_flip != self->vertical_mirror;
-    akvcam_format_t frame_fmt;
-    akvcam_format_t iformat;
-    akvcam_frame_t iframe;
-    akvcam_frame_t oframe;
-    struct v4l2_fract frame_rate;
+    akvcam_rendition_controls controls;
+    struct v4l2_rect crop;
+    bool cropping;
 
     akpr_function();
 
@@ -682,53 +1318,523 @@ akvcam_frame_t akvcam_device_frame_apply_adjusts(akvcam_device_ct self,
     akpr_debug("scaling: %s\n", akvcam_converter_scaling_mode_to_string(self->scaling));
     akpr_debug("aspect_ratio: %s\n", akvcam_converter_aspect_ratio_mode_to_string(self->aspect_ratio));
 
-    frame_fmt = akvcam_frame_format_nr(frame);
-    frame_rate = akvcam_format_frame_rate(frame_fmt);
-    iformat = akvcam_format_new(V4L2_PIX_FMT_ARGB32,
-                                akvcam_format_width(frame_fmt),
-                                akvcam_format_height(frame_fmt),
-                                &frame_rate);
-    akvcam_converter_set_output_format(self->in_video_converter, iformat);
-    akvcam_converter_set_scaling_mode(self->in_video_converter, self->scaling);
-    akvcam_converter_set_aspect_ratio_mode(self->in_video_converter, self->aspect_ratio);
-    akvcam_format_delete(iformat);
-
-    akvcam_converter_begin(self->in_video_converter);
-    iframe = akvcam_converter_convert(self->in_video_converter, frame);
-    akvcam_converter_end(self->in_video_converter);
-
-    akvcam_frame_filter_mirror(iframe,
-                               horizontal_flip,
-                               vertical_flip);
-    akvcam_frame_filter_apply(self->frame_filter,
-                              iframe,
-                              self->hue,
-                              self->saturation,
-                              self->brightness,
-                              self->contrast,
-                              self->gamma,
-                              self->gray,
-                              self->swap_rgb);
-
-    akvcam_converter_set_output_format(self->out_video_converter, self->format);
-    akvcam_converter_set_scaling_mode(self->out_video_converter, self->scaling);
-    akvcam_converter_set_aspect_ratio_mode(self->out_video_converter, self->aspect_ratio);
-
-    akvcam_converter_begin(self->out_video_converter);
-    oframe = akvcam_converter_convert(self->out_video_converter, iframe);
-    akvcam_converter_end(self->out_video_converter);
-    akvcam_frame_delete(iframe);
-
-    return oframe;
+    akvcam_device_rendition_controls(self, &controls);
+    cropping = akvcam_device_frame_crop(self,
+                                        akvcam_frame_format_nr(frame),
+                                        &crop);
+
+    return akvcam_frame_filter_render(self->frame_filter,
+                                      frame,
+                                      self->format,
+                                      &controls,
+                                      cropping? &crop: NULL,
+                                      self->in_video_converter,
+                                      self->out_video_converter,
+                                      self->stats,
+                                      akvcam_device_num(self));
+}
+
+/* Maps the crop rectangle to the size of the frame being converted, which
+ * may be a pyramid level or the default frame instead of the source frame.
+ */
+bool akvcam_device_frame_crop(akvcam_device_ct self,
+                              akvcam_format_ct format,
+                              struct v4l2_rect *rect)
+{
+    size_t width = akvcam_format_width(format);
+    size_t height = akvcam_format_height(format);
+
+    if (self->crop.width < 1
+        || self->crop.height < 1
+        || self->crop_bounds.width < 1
+        || self->crop_bounds.height < 1)
+        return false;
+
+    rect->left = (__s32) (self->crop.left * width / self->crop_bounds.width);
+    rect->top = (__s32) (self->crop.top * height / self->crop_bounds.height);
+    rect->width = (__u32) akvcam_max(1, self->crop.width * width / self->crop_bounds.width);
+    rect->height = (__u32) akvcam_max(1, self->crop.height * height / self->crop_bounds.height);
+
+    return true;
+}
+
+bool akvcam_device_adjusting(akvcam_device_ct self)
+{
+    return self->brightness
+           || self->contrast
+           || self->gamma
+           || self->saturation
+           || self->hue
+           || self->gray
+           || self->swap_rgb
+           || self->horizontal_flip != self->horizontal_mirror
+           || self->vertical_flip != self->vertical_mirror
+           || (self->crop.width > 0 && self->crop.height > 0);
+}
+
+bool akvcam_device_passthrough(akvcam_device_ct self, akvcam_frame_ct frame)
+{
+    if (!self->negotiate || akvcam_device_adjusting(self))
+        return false;
+
+    return akvcam_format_is_same_format(akvcam_frame_format_nr(frame),
+                                        self->format);
+}
+
+void akvcam_device_rendition_controls(akvcam_device_ct self,
+                                      akvcam_rendition_controls_t controls)
+{
+    controls->brightness = self->brightness;
+    controls->contrast = self->contrast;
+    controls->gamma = self->gamma;
+    controls->saturation = self->saturation;
+    controls->hue = self->hue;
+    controls->gray = self->gray;
+    controls->horizontal_flip = self->horizontal_flip != self->horizontal_mirror;
+    controls->vertical_flip = self->vertical_flip != self->vertical_mirror;
+    controls->swap_rgb = self->swap_rgb;
+    controls->scaling = self->scaling;
+    controls->aspect_ratio = self->aspect_ratio;
+    controls->crop = self->crop;
+}
+
+akvcam_frame_t akvcam_device_converted_default_frame(akvcam_device_t self,
+                                                     akvcam_frame_ct source)
+{
+    akvcam_rendition_controls controls;
+    akvcam_frame_t frame;
+
+    akvcam_device_rendition_controls(self, &controls);
+
+    if (self->converted_default_frame
+        && self->converted_default_source == source
+        && self->converted_default_direct == self->direct_mode
+        && akvcam_format_is_same_format(self->converted_default_format,
+                                        self->format)
+        && akvcam_rendition_controls_equals(&self->converted_default_controls,
+                                            &controls))
+        return akvcam_frame_ref(self->converted_default_frame);
+
+    akpr_debug("Converting default frame.\n");
+
+    if (self->direct_mode) {
+        /* The default frames must still be converted to the capture device
+         * format because they may have been created in a different pixel
+         * format. */
+        akvcam_converter_set_output_format(self->out_video_converter, self->format);
+        akvcam_converter_set_scaling_mode(self->out_video_converter, self->scaling);
+        akvcam_converter_set_aspect_ratio_mode(self->out_video_converter, self->aspect_ratio);
+        akvcam_converter_set_color_adjust(self->out_video_converter, NULL, 0);
+        akvcam_converter_set_input_rect(self->out_video_converter, NULL);
+
+        akvcam_converter_begin(self->out_video_converter);
+        frame = akvcam_converter_convert(self->out_video_converter, source);
+        akvcam_converter_end(self->out_video_converter);
+    } else {
+        frame = akvcam_device_frame_apply_adjusts(self, source);
+    }
+
+    akvcam_frame_delete(self->converted_default_frame);
+    self->converted_default_source = source;
+    self->converted_default_frame = frame;
+    akvcam_format_delete(self->converted_default_format);
+    self->converted_default_format = akvcam_format_new_copy(self->format);
+    self->converted_default_controls = controls;
+    self->converted_default_direct = self->direct_mode;
+
+    return akvcam_frame_ref(frame);
+}
+
+int akvcam_device_write_frame(akvcam_device_t self,
+                              akvcam_frame_t frame,
+                              akvcam_frame_ct metadata)
+{
+    uint64_t start = ktime_get_ns();
+    int result;
+
+    if (!metadata)
+        metadata = frame;
+
+    if (!frame)
+        result = -EINVAL;
+    else if (self->shared)
+        result = akvcam_device_write_shared_frame(self, frame, metadata);
+    else
+        result = akvcam_buffers_write_frame(self->buffers, frame, metadata);
+
+    akvcam_stats_record(self->stats,
+                        AKVCAM_STATS_STAGE_WRITE,
+                        ktime_get_ns() - start);
+
+    if (result >= 0) {
+        uint64_t timestamp = akvcam_frame_timestamp(metadata);
+        uint64_t now = ktime_get_ns();
+
+        akvcam_stats_count(self->stats, AKVCAM_STATS_COUNTER_FRAMES_DELIVERED);
+
+        /* Frames coming from a producer carry its buffer timestamp, ignore
+         * timestamps that aren't in the monotonic clock domain.
+         */
+        if (timestamp > 0 && timestamp <= now)
+            akvcam_stats_record_latency(self->stats, now - timestamp);
+    } else if (result == -EAGAIN)
+        akvcam_stats_count(self->stats, AKVCAM_STATS_COUNTER_FRAMES_DROPPED);
+    else
+        akvcam_stats_count(self->stats, AKVCAM_STATS_COUNTER_ERRORS);
+
+    return result;
+}
+
+bool akvcam_device_back_pressured(akvcam_device_t self)
+{
+    akvcam_list_element_t it = NULL;
+    bool back_pressured = false;
+
+    for (;;) {
+        akvcam_device_t capture_device =
+                akvcam_list_next(self->connected_devices, &it);
+
+        if (!it || back_pressured)
+            break;
+
+        if (!akvcam_device_streaming(capture_device))
+            continue;
+
+        if (!mutex_lock_interruptible(&capture_device->frame_mutex)) {
+            back_pressured =
+                (akvcam_frame_queue_policy(capture_device->frame_queue)
+                    == AKVCAM_FRAME_QUEUE_POLICY_BACK_PRESSURE
+                 || akvcam_format_is_inter_coded(capture_device->format))
+                && akvcam_frame_queue_full(capture_device->frame_queue);
+            mutex_unlock(&capture_device->frame_mutex);
+        }
+    }
+
+    return back_pressured;
+}
+
+bool akvcam_device_frame_unchanged(akvcam_device_t self,
+                                   akvcam_frame_ct frame)
+{
+    size_t size = akvcam_frame_bytes_used(frame);
+    uint64_t hash;
+    bool unchanged;
+
+    if (!self->deduplicate || size < 1)
+        return false;
+
+    hash = xxh64(akvcam_frame_const_data(frame), size, size);
+    unchanged = self->frame_sequence > 0 && hash == self->frame_hash;
+    self->frame_hash = hash;
+
+    return unchanged;
+}
+
+/* The frame is converted once per tick and copied to every reader, the
+ * frame is delivered if at least one of them had a free buffer.
+ */
+int akvcam_device_write_shared_frame(akvcam_device_t self,
+                                     akvcam_frame_t frame,
+                                     akvcam_frame_ct metadata)
+{
+    akvcam_list_element_t it = NULL;
+    int result;
+
+    result = mutex_lock_interruptible(&self->readers_mutex);
+
+    if (result)
+        return result;
+
+    result = -EAGAIN;
+
+    for (;;) {
+        akvcam_buffers_t buffers = akvcam_list_next(self->readers, &it);
+        int reader_result;
+
+        if (!it)
+            break;
+
+        reader_result = akvcam_buffers_write_frame(buffers, frame, metadata);
+
+        if (result < 0)
+            result = reader_result;
+    }
+
+    mutex_unlock(&self->readers_mutex);
+
+    return result;
+}
+
+/* The clock runs while at least one reader is streaming.
+ *
+ * The reader count and the clock are only touched under streaming_mutex. The
+ * clock thread never takes it, while it can be waiting for readers_mutex, so
+ * the clock must not be started or stopped while holding readers_mutex.
+ */
+int akvcam_device_reader_streaming_started(akvcam_device_t self)
+{
+    int result = 0;
+
+    mutex_lock(&self->streaming_mutex);
+
+    if (self->streaming_readers < 1)
+        result = akvcam_device_clock_start(self);
+
+    if (!result)
+        self->streaming_readers++;
+
+    mutex_unlock(&self->streaming_mutex);
+
+    return result;
+}
+
+int akvcam_device_reader_streaming_stopped(akvcam_device_t self)
+{
+    mutex_lock(&self->streaming_mutex);
+
+    if (self->streaming_readers > 0) {
+        self->streaming_readers--;
+
+        if (self->streaming_readers < 1)
+            akvcam_device_stop_streaming(self);
+    }
+
+    mutex_unlock(&self->streaming_mutex);
+
+    return 0;
+}
+
+struct vb2_queue *akvcam_device_file_queue(akvcam_device_ct self,
+                                           struct file *filp)
+{
+    akvcam_device_reader_t reader;
+
+    if (!self->shared)
+        return NULL;
+
+    reader = container_of(filp->private_data, akvcam_device_reader, fh);
+
+    return akvcam_buffers_vb2_queue(reader->buffers);
+}
+
+// Tell if a reader other than the caller has buffers allocated.
+bool akvcam_device_readers_busy(akvcam_device_t self, struct file *filp)
+{
+    struct vb2_queue *own_queue = akvcam_device_file_queue(self, filp);
+    akvcam_list_element_t it = NULL;
+    bool busy = false;
+
+    if (!self->shared)
+        return false;
+
+    mutex_lock(&self->readers_mutex);
+
+    for (;;) {
+        akvcam_buffers_t buffers = akvcam_list_next(self->readers, &it);
+        struct vb2_queue *queue;
+
+        if (!it)
+            break;
+
+        queue = akvcam_buffers_vb2_queue(buffers);
+
+        if (queue != own_queue && vb2_is_busy(queue)) {
+            busy = true;
+
+            break;
+        }
+    }
+
+    mutex_unlock(&self->readers_mutex);
+
+    return busy;
+}
+
+int akvcam_device_open(struct file *filp)
+{
+    akvcam_device_t self = video_drvdata(filp);
+    akvcam_device_reader_t reader;
+    int result;
+
+    if (!self->shared)
+        return v4l2_fh_open(filp);
+
+    reader = kzalloc(sizeof(akvcam_device_reader), GFP_KERNEL);
+
+    if (!reader)
+        return -ENOMEM;
+
+    reader->buffers = akvcam_buffers_new_copy(self->buffers);
+    akvcam_buffers_set_lock(reader->buffers, &self->device_mutex);
+    result = vb2_queue_init(akvcam_buffers_vb2_queue(reader->buffers));
+
+    if (result) {
+        akvcam_buffers_delete(reader->buffers);
+        kfree(reader);
+
+        return result;
+    }
+
+    akvcam_connect(buffers, reader->buffers, streaming_started, self, akvcam_device_reader_streaming_started);
+    akvcam_connect(buffers, reader->buffers, streaming_stopped, self, akvcam_device_reader_streaming_stopped);
+    v4l2_fh_init(&reader->fh, video_devdata(filp));
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 18, 0)
+    filp->private_data = &reader->fh;
+    v4l2_fh_add(&reader->fh);
+#else
+    v4l2_fh_add(&reader->fh, filp);
+#endif
+
+    mutex_lock(&self->readers_mutex);
+    akvcam_list_push_back(self->readers,
+                          reader->buffers,
+                          (akvcam_copy_t) akvcam_buffers_ref,
+                          (akvcam_delete_t) akvcam_buffers_delete);
+    mutex_unlock(&self->readers_mutex);
+
+    return 0;
+}
+
+int akvcam_device_release(struct file *filp)
+{
+    akvcam_device_t self = video_drvdata(filp);
+    akvcam_device_reader_t reader;
+    akvcam_list_element_t it = NULL;
+
+    if (!self->shared)
+        return vb2_fop_release(filp);
+
+    reader = container_of(filp->private_data, akvcam_device_reader, fh);
+    mutex_lock(&self->device_mutex);
+    vb2_queue_release(akvcam_buffers_vb2_queue(reader->buffers));
+    mutex_unlock(&self->device_mutex);
+    mutex_lock(&self->readers_mutex);
+
+    for (;;) {
+        akvcam_buffers_t buffers = akvcam_list_next(self->readers, &it);
+
+        if (!it)
+            break;
+
+        if (buffers == reader->buffers) {
+            akvcam_list_erase(self->readers, it);
+
+            break;
+        }
+    }
+
+    mutex_unlock(&self->readers_mutex);
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 18, 0)
+    v4l2_fh_del(&reader->fh);
+#else
+    v4l2_fh_del(&reader->fh, filp);
+#endif
+    v4l2_fh_exit(&reader->fh);
+    akvcam_buffers_delete(reader->buffers);
+    kfree(reader);
+
+    return 0;
+}
+
+ssize_t akvcam_device_read(struct file *filp,
+                           char __user *data,
+                           size_t size,
+                           loff_t *offset)
+{
+    akvcam_device_t self = video_drvdata(filp);
+    struct vb2_queue *queue = akvcam_device_file_queue(self, filp);
+    ssize_t result;
+
+    if (!queue)
+        return vb2_fop_read(filp, data, size, offset);
+
+    if (mutex_lock_interruptible(&self->device_mutex))
+        return -ERESTARTSYS;
+
+    result = vb2_read(queue, data, size, offset, filp->f_flags & O_NONBLOCK);
+    mutex_unlock(&self->device_mutex);
+
+    return result;
+}
+
+ssize_t akvcam_device_write(struct file *filp,
+                            const char __user *data,
+                            size_t size,
+                            loff_t *offset)
+{
+    akvcam_device_t self = video_drvdata(filp);
+
+    // Only capture devices can be shared.
+    if (self->shared)
+        return -EINVAL;
+
+    return vb2_fop_write(filp, data, size, offset);
+}
+
+int akvcam_device_frame_ring_mapped(akvcam_device_t self)
+{
+    if (!akvcam_device_streaming(self))
+        return akvcam_device_clock_start(self);
+
+    return 0;
+}
+
+int akvcam_device_frame_ring_unmapped(akvcam_device_t self)
+{
+    struct vb2_queue *queue = akvcam_buffers_vb2_queue(self->buffers);
+
+    if (!vb2_is_streaming(queue))
+        akvcam_device_stop_streaming(self);
+
+    return 0;
+}
+
+int akvcam_device_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    akvcam_device_t self = video_drvdata(filp);
+
+    if (self->frame_ring
+        && vma->vm_pgoff == AKVCAM_FRAME_RING_MMAP_OFFSET >> PAGE_SHIFT) {
+        struct vb2_queue *queue = akvcam_buffers_vb2_queue(self->buffers);
+
+        // Writing to the ring is the same as queuing buffers.
+        if (queue->owner && queue->owner != filp->private_data)
+            return -EBUSY;
+
+        return akvcam_frame_ring_mmap(self->frame_ring, vma);
+    }
+
+    if (self->shared)
+        return vb2_mmap(akvcam_device_file_queue(self, filp), vma);
+
+    return vb2_fop_mmap(filp, vma);
+}
+
+__poll_t akvcam_device_poll(struct file *filp, struct poll_table_struct *wait)
+{
+    akvcam_device_t self = video_drvdata(filp);
+
+    /* Producers using the ring don't stream through the queue, wake them
+     * when a slot gets free instead.
+     */
+    if (self->frame_ring && akvcam_frame_ring_mapped(self->frame_ring))
+        return akvcam_frame_ring_poll(self->frame_ring, filp, wait);
+
+    if (self->shared)
+        return vb2_poll(akvcam_device_file_queue(self, filp), filp, wait);
+
+    return vb2_fop_poll(filp, wait);
 }
 
 static const struct v4l2_file_operations akvcam_device_fops = {
-    .owner          = THIS_MODULE    ,
-    .open           = v4l2_fh_open   ,
-    .release        = vb2_fop_release,
-    .unlocked_ioctl = video_ioctl2   ,
-    .read           = vb2_fop_read   ,
-    .write          = vb2_fop_write  ,
-    .mmap           = vb2_fop_mmap   ,
-    .poll           = vb2_fop_poll   ,
+    .owner          = THIS_MODULE          ,
+    .open           = akvcam_device_open   ,
+    .release        = akvcam_device_release,
+    .unlocked_ioctl = video_ioctl2         ,
+    .read           = akvcam_device_read   ,
+    .write          = akvcam_device_write  ,
+    .mmap           = akvcam_device_mmap   ,
+    .poll           = akvcam_device_poll   ,
 };
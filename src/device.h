@@ -21,12 +21,21 @@
 
 #include "device_types.h"
 #include "buffers_types.h"
+#include "compositor_types.h"
 #include "controls_types.h"
 #include "format_types.h"
 #include "frame_filter_types.h"
+#include "frame_pyramid_types.h"
+#include "frame_queue_types.h"
+#include "rate_converter_types.h"
 #include "frame_types.h"
+#include "overlay_types.h"
+#include "stats_types.h"
+#include "test_pattern_types.h"
 
+struct device;
 struct file;
+struct vb2_queue;
 
 // public
 akvcam_device_t akvcam_device_new(const char *name,
@@ -50,19 +59,66 @@ enum v4l2_buf_type akvcam_device_v4l2_type(akvcam_device_ct self);
 AKVCAM_RW_MODE akvcam_device_rw_mode(akvcam_device_ct self);
 bool akvcam_device_direct_mode(akvcam_device_ct self);
 void akvcam_device_set_direct_mode(akvcam_device_t self, bool direct_mode);
+bool akvcam_device_deduplicate(akvcam_device_ct self);
+void akvcam_device_set_deduplicate(akvcam_device_t self, bool deduplicate);
+bool akvcam_device_damage_tracking(akvcam_device_ct self);
+void akvcam_device_set_damage_tracking(akvcam_device_t self,
+                                       bool damage_tracking);
+bool akvcam_device_negotiate(akvcam_device_ct self);
+void akvcam_device_set_negotiate(akvcam_device_t self, bool negotiate);
+bool akvcam_device_shared(akvcam_device_ct self);
+void akvcam_device_set_shared(akvcam_device_t self, bool shared);
+bool akvcam_device_compose(akvcam_device_ct self);
+void akvcam_device_set_compose(akvcam_device_t self, bool compose);
+bool akvcam_device_add_compose_source(akvcam_device_t self,
+                                      akvcam_device_ct output,
+                                      const struct v4l2_rect *rect,
+                                      int z);
+akvcam_compositor_t akvcam_device_compositor_nr(akvcam_device_ct self);
+void akvcam_device_set_overlay(akvcam_device_t self,
+                               akvcam_overlay_t overlay);
+AKVCAM_CLOCK_MODE akvcam_device_clock_mode(akvcam_device_ct self);
+void akvcam_device_set_clock_mode(akvcam_device_t self,
+                                  AKVCAM_CLOCK_MODE clock_mode);
+bool akvcam_device_timestamp_copy(akvcam_device_ct self);
+void akvcam_device_set_timestamp_copy(akvcam_device_t self,
+                                      bool timestamp_copy);
+AKVCAM_MEMORY_BACKEND akvcam_device_memory_backend(akvcam_device_ct self);
+void akvcam_device_set_memory_backend(akvcam_device_t self,
+                                      AKVCAM_MEMORY_BACKEND backend,
+                                      struct device *dma_device);
+size_t akvcam_device_frame_ring_slots(akvcam_device_ct self);
+void akvcam_device_set_frame_ring_slots(akvcam_device_t self, size_t slots);
+void akvcam_device_set_frame_queue(akvcam_device_t self,
+                                   size_t depth,
+                                   AKVCAM_FRAME_QUEUE_POLICY policy);
+void akvcam_device_set_rate_conversion(akvcam_device_t self,
+                                       AKVCAM_RATE_CONVERSION mode);
+AKVCAM_TEST_PATTERN akvcam_device_test_pattern(akvcam_device_ct self);
+void akvcam_device_set_test_pattern(akvcam_device_t self,
+                                    AKVCAM_TEST_PATTERN pattern);
 akvcam_formats_list_t akvcam_device_formats(akvcam_device_ct self);
+akvcam_format_t akvcam_device_preferred_format(akvcam_device_ct self);
 akvcam_format_t akvcam_device_format_nr(akvcam_device_ct self);
 akvcam_format_t akvcam_device_format(akvcam_device_ct self);
 void akvcam_device_set_format(akvcam_device_t self,
                               akvcam_format_t format);
+void akvcam_device_crop_bounds(akvcam_device_ct self, struct v4l2_rect *rect);
+void akvcam_device_crop(akvcam_device_ct self, struct v4l2_rect *rect);
+void akvcam_device_set_crop(akvcam_device_t self, struct v4l2_rect *rect);
 akvcam_controls_t akvcam_device_controls_nr(akvcam_device_ct self);
 akvcam_controls_t akvcam_device_controls(akvcam_device_ct self);
 akvcam_buffers_t akvcam_device_buffers_nr(akvcam_device_ct self);
 akvcam_buffers_t akvcam_device_buffers(akvcam_device_ct self);
 bool akvcam_device_streaming(akvcam_device_ct self);
+struct vb2_queue *akvcam_device_file_queue(akvcam_device_ct self,
+                                           struct file *filp);
+bool akvcam_device_readers_busy(akvcam_device_t self, struct file *filp);
 akvcam_devices_list_t akvcam_device_connected_devices_nr(akvcam_device_ct self);
 akvcam_devices_list_t akvcam_device_connected_devices(akvcam_device_ct self);
 __u32 akvcam_device_caps(akvcam_device_ct self);
+akvcam_frame_pyramid_t akvcam_device_frame_pyramid_nr(akvcam_device_ct self);
+akvcam_stats_t akvcam_device_stats_nr(akvcam_device_ct self);
 
 // public static
 AKVCAM_DEVICE_TYPE akvcam_device_type_from_v4l2(enum v4l2_buf_type type);
@@ -39,6 +39,13 @@ typedef enum
 {
     AKVCAM_DEVICE_TYPE_CAPTURE,
     AKVCAM_DEVICE_TYPE_OUTPUT,
+    AKVCAM_DEVICE_TYPE_M2M,
 } AKVCAM_DEVICE_TYPE;
 
+typedef enum
+{
+    AKVCAM_CLOCK_MODE_FREE_RUNNING,
+    AKVCAM_CLOCK_MODE_PRODUCER,
+} AKVCAM_CLOCK_MODE;
+
 #endif // AKVCAM_DEVICE_TYPES_H
@@ -16,21 +16,30 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <linux/dma-mapping.h>
+#include <linux/platform_device.h>
 #include <linux/slab.h>
 #include <linux/version.h>
 #include <linux/videodev2.h>
 
 #include "driver.h"
 #include "buffers.h"
+#include "compositor.h"
 #include "device.h"
 #include "format.h"
 #include "format_specs.h"
 #include "frame.h"
 #include "frame_filter.h"
+#include "frame_queue.h"
 #include "list.h"
 #include "log.h"
+#include "m2m.h"
+#include "overlay.h"
 #include "proc.h"
+#include "rate_converter.h"
 #include "settings.h"
+#include "stats.h"
+#include "test_pattern.h"
 
 typedef struct
 {
@@ -45,8 +54,11 @@ typedef struct
     char name[AKVCAM_MAX_STRING_SIZE];
     char description[AKVCAM_MAX_STRING_SIZE];
     akvcam_devices_list_t devices;
+    akvcam_m2ms_list_t converters;
     akvcam_frame_t default_frame;
     akvcam_frame_filter_t frame_filter;
+    AKVCAM_TEST_PATTERN test_pattern;
+    struct platform_device *dma_device;
 } akvcam_driver, *akvcam_driver_t;
 
 static akvcam_driver_t akvcam_driver_global = NULL;
@@ -54,6 +66,9 @@ static akvcam_driver_t akvcam_driver_global = NULL;
 bool akvcam_driver_register(void);
 void akvcam_driver_unregister(void);
 akvcam_frame_t akvcam_driver_load_default_frame(akvcam_settings_t settings);
+struct device *akvcam_driver_dma_device(void);
+AKVCAM_TEST_PATTERN akvcam_driver_read_test_pattern(akvcam_settings_t settings);
+bool akvcam_driver_read_fast_color_adjust(akvcam_settings_t settings);
 akvcam_matrix_t akvcam_driver_read_formats(akvcam_settings_t settings);
 akvcam_formats_list_t akvcam_driver_read_format(akvcam_settings_t settings);
 akvcam_devices_list_t akvcam_driver_read_devices(akvcam_settings_t settings,
@@ -62,6 +77,11 @@ akvcam_device_t akvcam_driver_read_device(akvcam_settings_t settings,
                                           akvcam_matrix_t available_formats);
 akvcam_formats_list_t akvcam_driver_read_device_formats(akvcam_settings_t settings,
                                                         akvcam_matrix_t available_formats);
+AKVCAM_RW_MODE akvcam_driver_read_rw_mode(akvcam_settings_t settings);
+akvcam_m2ms_list_t akvcam_driver_read_converters(akvcam_settings_t settings,
+                                                 akvcam_matrix_t available_formats);
+akvcam_m2m_t akvcam_driver_read_converter(akvcam_settings_t settings,
+                                          akvcam_matrix_t available_formats);
 void akvcam_driver_connect_devices(akvcam_settings_t settings,
                                    akvcam_devices_list_t devices);
 bool akvcam_driver_contains_node(const u32 *connections,
@@ -70,6 +90,7 @@ bool akvcam_driver_contains_node(const u32 *connections,
 void akvcam_driver_print_devices(void);
 void akvcam_driver_print_formats(akvcam_device_ct device);
 void akvcam_driver_print_connections(akvcam_device_ct device);
+void akvcam_driver_print_converters(void);
 akvcam_driver_rw_mode_strings_ct akvcam_driver_rw_mode_strs(void);
 
 int akvcam_driver_init(const char *name, const char *description)
@@ -91,6 +112,7 @@ int akvcam_driver_init(const char *name, const char *description)
     snprintf(akvcam_driver_global->description, AKVCAM_MAX_STRING_SIZE, "%s", description);
     akvcam_driver_global->default_frame = NULL;
     akvcam_driver_global->devices = NULL;
+    akvcam_driver_global->converters = NULL;
     akvcam_driver_global->frame_filter = akvcam_frame_filter_new();
     akpr_info("Reading settings\n");
     settings = akvcam_settings_new();
@@ -100,21 +122,30 @@ int akvcam_driver_init(const char *name, const char *description)
 
         akvcam_driver_global->default_frame =
                 akvcam_driver_load_default_frame(settings);
+        akvcam_driver_global->test_pattern =
+                akvcam_driver_read_test_pattern(settings);
+        akvcam_frame_filter_set_fast_color_adjust(akvcam_driver_global->frame_filter,
+                                                  akvcam_driver_read_fast_color_adjust(settings));
         available_formats = akvcam_driver_read_formats(settings);
         akvcam_driver_global->devices =
                 akvcam_driver_read_devices(settings, available_formats);
+        akvcam_driver_global->converters =
+                akvcam_driver_read_converters(settings, available_formats);
         akvcam_list_delete(available_formats);
         akvcam_driver_connect_devices(settings, akvcam_driver_global->devices);
     } else {
         akpr_err("Error reading settings\n");
         akvcam_driver_global->default_frame = NULL;
         akvcam_driver_global->devices = akvcam_list_new();
+        akvcam_driver_global->converters = akvcam_list_new();
     }
 
     akvcam_settings_delete(settings);
+    akvcam_stats_debugfs_init();
     akvcam_driver_register();
     proc_create(akvcam_proc_file_name(), 0, NULL, akvcam_proc_info());
     akvcam_driver_print_devices();
+    akvcam_driver_print_converters();
 
     return 0;
 }
@@ -128,7 +159,13 @@ void akvcam_driver_uninit(void)
 
     remove_proc_entry(akvcam_proc_file_name(), NULL);
     akvcam_driver_unregister();
+    akvcam_stats_debugfs_uninit();
+    akvcam_list_delete(akvcam_driver_global->converters);
     akvcam_list_delete(akvcam_driver_global->devices);
+
+    if (akvcam_driver_global->dma_device)
+        platform_device_unregister(akvcam_driver_global->dma_device);
+
     akvcam_frame_delete(akvcam_driver_global->default_frame);
     akvcam_frame_filter_delete(akvcam_driver_global->frame_filter);
     kfree(akvcam_driver_global);
@@ -202,6 +239,21 @@ bool akvcam_driver_register(void)
         }
     }
 
+    // Converters are optional, a failing one doesn't stop the driver.
+    element = NULL;
+
+    for (;;) {
+        akvcam_m2m_t converter =
+                akvcam_list_next(akvcam_driver_global->converters, &element);
+
+        if (!element)
+            break;
+
+        if (!akvcam_m2m_register(converter))
+            akpr_warning("Failed to register converter '%s'\n",
+                         akvcam_m2m_description(converter));
+    }
+
     return true;
 }
 
@@ -218,6 +270,51 @@ void akvcam_driver_unregister(void)
 
         akvcam_device_unregister(device);
     }
+
+    element = NULL;
+
+    for (;;) {
+        akvcam_m2m_t converter =
+                akvcam_list_next(akvcam_driver_global->converters, &element);
+
+        if (!element)
+            break;
+
+        akvcam_m2m_unregister(converter);
+    }
+}
+
+/* The DMA memory backends allocate the buffers for a device, so a platform
+ * device is created for the first camera using one of them.
+ */
+struct device *akvcam_driver_dma_device(void)
+{
+    struct platform_device *pdev;
+
+    if (akvcam_driver_global->dma_device)
+        return &akvcam_driver_global->dma_device->dev;
+
+    pdev = platform_device_register_simple(akvcam_driver_global->name,
+                                           PLATFORM_DEVID_NONE,
+                                           NULL,
+                                           0);
+
+    if (IS_ERR(pdev)) {
+        akpr_err("Can't create the DMA device\n");
+
+        return NULL;
+    }
+
+    if (dma_coerce_mask_and_coherent(&pdev->dev, DMA_BIT_MASK(64))) {
+        akpr_err("Can't set the DMA mask\n");
+        platform_device_unregister(pdev);
+
+        return NULL;
+    }
+
+    akvcam_driver_global->dma_device = pdev;
+
+    return &pdev->dev;
 }
 
 akvcam_frame_t  akvcam_driver_load_default_frame(akvcam_settings_t settings)
@@ -241,6 +338,36 @@ akvcam_frame_t  akvcam_driver_load_default_frame(akvcam_settings_t settings)
     return frame;
 }
 
+AKVCAM_TEST_PATTERN akvcam_driver_read_test_pattern(akvcam_settings_t settings)
+{
+    AKVCAM_TEST_PATTERN pattern;
+
+    akvcam_settings_begin_group(settings, "General");
+    pattern =
+        akvcam_test_pattern_from_string(akvcam_settings_value(settings,
+                                                              "test_pattern"));
+    akvcam_settings_end_group(settings);
+    akpr_info("Test pattern: %s\n", akvcam_test_pattern_to_string(pattern));
+
+    return pattern;
+}
+
+bool akvcam_driver_read_fast_color_adjust(akvcam_settings_t settings)
+{
+    bool fast_color_adjust = false;
+
+    akvcam_settings_begin_group(settings, "General");
+
+    if (akvcam_settings_contains(settings, "fast_color_adjust"))
+        fast_color_adjust =
+                akvcam_settings_value_bool(settings, "fast_color_adjust");
+
+    akvcam_settings_end_group(settings);
+    akpr_info("Fast color adjust: %s\n", fast_color_adjust? "true": "false");
+
+    return fast_color_adjust;
+}
+
 akvcam_matrix_t akvcam_driver_read_formats(akvcam_settings_t settings)
 {
     akvcam_matrix_t formats_matrix = akvcam_list_new();
@@ -392,15 +519,11 @@ akvcam_device_t akvcam_driver_read_device(akvcam_settings_t settings,
 {
     akvcam_device_t device;
     AKVCAM_DEVICE_TYPE type;
-    akvcam_string_list_t modes;
     AKVCAM_RW_MODE mode;
     char *type_str;
     char *description;
     akvcam_formats_list_t formats;
-    akvcam_driver_rw_mode_strings_ct rw_mode_strings =
-            akvcam_driver_rw_mode_strs();
     char *rw_mode_str;
-    size_t i;
 
     akpr_info("Reading device\n");
 
@@ -416,21 +539,7 @@ akvcam_device_t akvcam_driver_read_device(akvcam_settings_t settings,
         return NULL;
     }
 
-    modes = akvcam_settings_value_list(settings, "mode", ",");
-    mode = 0;
-
-    for (i = 0; akvcam_strlen(rw_mode_strings[i].str) > 0; i++)
-        if (akvcam_list_contains(modes,
-                                 rw_mode_strings[i].str,
-                                 (akvcam_are_equals_t) akvcam_driver_strings_are_equals)) {
-            mode |= rw_mode_strings[i].rw_mode;
-        }
-
-    akvcam_list_delete(modes);
-
-    if (!mode)
-        mode |= AKVCAM_RW_MODE_MMAP | AKVCAM_RW_MODE_USERPTR;
-
+    mode = akvcam_driver_read_rw_mode(settings);
     rw_mode_str = kzalloc(AKVCAM_MAX_STRING_SIZE, GFP_KERNEL);
     akvcam_string_from_rw_mode(mode, rw_mode_str, AKVCAM_MAX_STRING_SIZE);
     akpr_info("Device mode: %s\n", rw_mode_str);
@@ -467,6 +576,88 @@ akvcam_device_t akvcam_driver_read_device(akvcam_settings_t settings,
         akvcam_device_set_direct_mode(device,
                                       akvcam_settings_value_bool(settings, "direct_mode"));
 
+    if (akvcam_settings_contains(settings, "deduplicate"))
+        akvcam_device_set_deduplicate(device,
+                                      akvcam_settings_value_bool(settings, "deduplicate"));
+
+    if (type == AKVCAM_DEVICE_TYPE_CAPTURE
+        && akvcam_settings_contains(settings, "damage_tracking"))
+        akvcam_device_set_damage_tracking(device,
+                                          akvcam_settings_value_bool(settings, "damage_tracking"));
+
+    if (akvcam_settings_contains(settings, "negotiate"))
+        akvcam_device_set_negotiate(device,
+                                    akvcam_settings_value_bool(settings, "negotiate"));
+
+    if (akvcam_settings_contains(settings, "shared"))
+        akvcam_device_set_shared(device,
+                                 akvcam_settings_value_bool(settings, "shared"));
+
+    if (akvcam_settings_contains(settings, "compose"))
+        akvcam_device_set_compose(device,
+                                  akvcam_settings_value_bool(settings, "compose"));
+
+    if (akvcam_settings_contains(settings, "overlay")) {
+        const char *overlay_file = akvcam_settings_value(settings, "overlay");
+        akvcam_overlay_t overlay = akvcam_overlay_new();
+
+        if (akvcam_overlay_load(overlay, overlay_file)) {
+            akvcam_string_list_t position =
+                    akvcam_settings_value_list(settings, "overlay_position", ",");
+
+            if (akvcam_list_size(position) == 2)
+                akvcam_overlay_set_position(overlay,
+                                            akvcam_settings_to_uint32(akvcam_list_at(position, 0)),
+                                            akvcam_settings_to_uint32(akvcam_list_at(position, 1)));
+
+            akvcam_list_delete(position);
+            akvcam_device_set_overlay(device, overlay);
+        } else {
+            akpr_warning("Failed loading overlay: %s\n", overlay_file);
+        }
+
+        akvcam_overlay_delete(overlay);
+    }
+
+    if (akvcam_settings_contains(settings, "clock_mode")) {
+        const char *clock_mode = akvcam_settings_value(settings, "clock_mode");
+
+        akvcam_device_set_clock_mode(device,
+                                     strcmp(clock_mode, "producer") == 0?
+                                        AKVCAM_CLOCK_MODE_PRODUCER:
+                                        AKVCAM_CLOCK_MODE_FREE_RUNNING);
+    }
+
+    akvcam_device_set_test_pattern(device, akvcam_driver_global->test_pattern);
+
+    if (akvcam_settings_contains(settings, "timestamp_copy"))
+        akvcam_device_set_timestamp_copy(device,
+                                         akvcam_settings_value_bool(settings, "timestamp_copy"));
+
+    if (akvcam_settings_contains(settings, "queue_depth")
+        || akvcam_settings_contains(settings, "queue_policy"))
+        akvcam_device_set_frame_queue(device,
+                                      akvcam_settings_value_uint32(settings, "queue_depth"),
+                                      akvcam_frame_queue_policy_from_string(akvcam_settings_value(settings, "queue_policy")));
+
+    if (akvcam_settings_contains(settings, "rate_conversion"))
+        akvcam_device_set_rate_conversion(device,
+                                          akvcam_rate_converter_mode_from_string(akvcam_settings_value(settings, "rate_conversion")));
+
+    if (akvcam_settings_contains(settings, "memory")) {
+        AKVCAM_MEMORY_BACKEND backend =
+                akvcam_buffers_memory_backend_from_string(akvcam_settings_value(settings, "memory"));
+
+        if (backend != AKVCAM_MEMORY_BACKEND_VMALLOC)
+            akvcam_device_set_memory_backend(device,
+                                             backend,
+                                             akvcam_driver_dma_device());
+    }
+
+    if (akvcam_settings_contains(settings, "ring_slots"))
+        akvcam_device_set_frame_ring_slots(device,
+                                           akvcam_settings_value_uint32(settings, "ring_slots"));
+
     if (akvcam_settings_contains(settings, "videonr"))
         akvcam_device_set_num(device,
                               akvcam_settings_value_int32(settings, "videonr"));
@@ -514,6 +705,113 @@ akvcam_formats_list_t akvcam_driver_read_device_formats(akvcam_settings_t settin
     return formats;
 }
 
+AKVCAM_RW_MODE akvcam_driver_read_rw_mode(akvcam_settings_t settings)
+{
+    akvcam_string_list_t modes;
+    AKVCAM_RW_MODE mode = 0;
+    akvcam_driver_rw_mode_strings_ct rw_mode_strings =
+            akvcam_driver_rw_mode_strs();
+    size_t i;
+
+    modes = akvcam_settings_value_list(settings, "mode", ",");
+
+    for (i = 0; akvcam_strlen(rw_mode_strings[i].str) > 0; i++)
+        if (akvcam_list_contains(modes,
+                                 rw_mode_strings[i].str,
+                                 (akvcam_are_equals_t) akvcam_driver_strings_are_equals)) {
+            mode |= rw_mode_strings[i].rw_mode;
+        }
+
+    akvcam_list_delete(modes);
+
+    if (!mode)
+        mode |= AKVCAM_RW_MODE_MMAP | AKVCAM_RW_MODE_USERPTR;
+
+    return mode;
+}
+
+akvcam_m2ms_list_t akvcam_driver_read_converters(akvcam_settings_t settings,
+                                                 akvcam_matrix_t available_formats)
+{
+    akvcam_m2ms_list_t converters = akvcam_list_new();
+    size_t n_converters;
+    size_t i;
+
+    akvcam_settings_begin_group(settings, "Converters");
+    n_converters = akvcam_settings_begin_array(settings, "converters");
+
+    for (i = 0; i < n_converters; i++) {
+        akvcam_m2m_t converter;
+        akvcam_settings_set_array_index(settings, i);
+        converter = akvcam_driver_read_converter(settings, available_formats);
+
+        if (converter) {
+            akvcam_list_push_back(converters,
+                                  converter,
+                                  (akvcam_copy_t) akvcam_m2m_ref,
+                                  (akvcam_delete_t) akvcam_m2m_delete);
+            akvcam_m2m_delete(converter);
+        }
+    }
+
+    akvcam_settings_end_array(settings);
+    akvcam_settings_end_group(settings);
+
+    return converters;
+}
+
+akvcam_m2m_t akvcam_driver_read_converter(akvcam_settings_t settings,
+                                          akvcam_matrix_t available_formats)
+{
+    akvcam_m2m_t converter;
+    AKVCAM_RW_MODE mode;
+    char *description;
+    akvcam_formats_list_t formats;
+    size_t i;
+
+    akpr_info("Reading converter\n");
+
+    description = akvcam_settings_value(settings, "description");
+
+    if (akvcam_strlen(description) < 1) {
+        pr_err("Converter description is empty\n");
+
+        return NULL;
+    }
+
+    // Converters can't be read or written, only streamed.
+    mode = akvcam_driver_read_rw_mode(settings) & ~AKVCAM_RW_MODE_READWRITE;
+
+    if (!mode)
+        mode |= AKVCAM_RW_MODE_MMAP | AKVCAM_RW_MODE_USERPTR;
+
+    formats = akvcam_driver_read_device_formats(settings, available_formats);
+
+    // Compressed frames can't be converted.
+    for (i = akvcam_list_size(formats); i > 0; i--)
+        if (akvcam_format_is_compressed(akvcam_list_at(formats, i - 1)))
+            akvcam_list_erase(formats, akvcam_list_it(formats, i - 1));
+
+    if (akvcam_list_empty(formats)) {
+        pr_err("Can't read converter formats\n");
+        akvcam_list_delete(formats);
+
+        return NULL;
+    }
+
+    converter = akvcam_m2m_new(description,
+                               mode,
+                               formats,
+                               akvcam_driver_global->frame_filter);
+    akvcam_list_delete(formats);
+
+    if (akvcam_settings_contains(settings, "videonr"))
+        akvcam_m2m_set_num(converter,
+                           akvcam_settings_value_int32(settings, "videonr"));
+
+    return converter;
+}
+
 void akvcam_driver_connect_devices(akvcam_settings_t settings,
                                    akvcam_devices_list_t devices)
 {
@@ -534,11 +832,36 @@ void akvcam_driver_connect_devices(akvcam_settings_t settings,
     for (i = 0; i < n_connections; i++) {
         akvcam_string_list_t connections;
         size_t n_nodes;
+        struct v4l2_rect rect;
+        bool have_rect = false;
+        int z;
 
         akvcam_settings_set_array_index(settings, i);
         connections = akvcam_settings_value_list(settings, "connection", ":");
         n_nodes = akvcam_list_size(connections);
 
+        // Area and stacking order of the output in composited captures.
+        if (akvcam_settings_contains(settings, "rect")) {
+            akvcam_string_list_t rect_values =
+                    akvcam_settings_value_list(settings, "rect", ",");
+
+            if (akvcam_list_size(rect_values) == 4) {
+                rect.left = akvcam_settings_to_int32(akvcam_list_at(rect_values, 0));
+                rect.top = akvcam_settings_to_int32(akvcam_list_at(rect_values, 1));
+                rect.width = akvcam_settings_to_uint32(akvcam_list_at(rect_values, 2));
+                rect.height = akvcam_settings_to_uint32(akvcam_list_at(rect_values, 3));
+                have_rect = true;
+            } else {
+                akpr_warning("Invalid rect in connection %zu\n", i + 1);
+            }
+
+            akvcam_list_delete(rect_values);
+        }
+
+        z = akvcam_settings_contains(settings, "z")?
+                akvcam_settings_value_int32(settings, "z"):
+                (int) i;
+
         if (n_nodes < 2) {
             akpr_warning("No valid connection defined\n");
             akvcam_list_delete(connections);
@@ -605,7 +928,8 @@ void akvcam_driver_connect_devices(akvcam_settings_t settings,
                     device = akvcam_list_at(devices, connections_index[j] - 1);
                     connected_outputs = akvcam_device_connected_devices_nr(device);
 
-                    if (akvcam_list_empty(connected_outputs)) {
+                    if (akvcam_list_empty(connected_outputs)
+                        || akvcam_device_compose(device)) {
                         // Warn if direct_mode settings are inconsistent.
                         if (akvcam_device_direct_mode(output)
                             != akvcam_device_direct_mode(device)) {
@@ -633,6 +957,20 @@ void akvcam_driver_connect_devices(akvcam_settings_t settings,
                             }
                         }
 
+                        // Composited captures take several outputs.
+                        if (akvcam_device_compose(device)
+                            && !akvcam_device_add_compose_source(device,
+                                                                 output,
+                                                                 have_rect? &rect: NULL,
+                                                                 z)) {
+                            akpr_warning("Connection between %u and %u rejected, "
+                                         "too many composited outputs\n",
+                                         connections_index[0] - 1,
+                                         connections_index[j] - 1);
+
+                            continue;
+                        }
+
                         akvcam_list_push_back(connected_outputs,
                                               output,
                                               (akvcam_copy_t) akvcam_device_ref,
@@ -712,6 +1050,34 @@ void akvcam_driver_print_devices(void)
 
         akpr_info("\tDirect mode: %s\n",
                   akvcam_device_direct_mode(device)? "yes": "no");
+        akpr_info("\tShared: %s\n",
+                  akvcam_device_shared(device)? "yes": "no");
+
+        if (akvcam_device_compose(device)) {
+            akvcam_compositor_t compositor = akvcam_device_compositor_nr(device);
+            struct v4l2_rect rect;
+            int z;
+
+            akpr_info("\tCompose:\n");
+
+            for (i = 0; akvcam_compositor_source_rect(compositor, i, &rect, &z); i++)
+                if (rect.width > 0 && rect.height > 0)
+                    akpr_info("\t\t%ux%u+%d+%d z=%d\n",
+                              rect.width,
+                              rect.height,
+                              rect.left,
+                              rect.top,
+                              z);
+                else
+                    akpr_info("\t\tFull frame z=%d\n", z);
+        }
+
+        akpr_info("\tMemory: %s\n",
+                  akvcam_buffers_memory_backend_to_string(akvcam_device_memory_backend(device)));
+
+        if (akvcam_device_frame_ring_slots(device) > 0)
+            akpr_info("\tRing slots: %zu\n",
+                      akvcam_device_frame_ring_slots(device));
 
         akpr_info("\tModes:\n");
         rw_mode = akvcam_device_rw_mode(device);
@@ -774,6 +1140,46 @@ void akvcam_driver_print_connections(akvcam_device_ct device)
     }
 }
 
+void akvcam_driver_print_converters(void)
+{
+    akvcam_list_element_t it = NULL;
+
+    if (!akvcam_driver_global
+        || !akvcam_driver_global->converters
+        || akvcam_list_empty(akvcam_driver_global->converters))
+        return;
+
+    akpr_info("Converters:\n");
+    akpr_info("\n");
+
+    for (;;) {
+        akvcam_m2m_t converter =
+                akvcam_list_next(akvcam_driver_global->converters, &it);
+        akvcam_formats_list_t formats;
+        akvcam_list_element_t format_it = NULL;
+
+        if (!it)
+            break;
+
+        akpr_info("Device: /dev/video%d\n", akvcam_m2m_num(converter));
+        akpr_info("\tDescription: %s\n", akvcam_m2m_description(converter));
+        akpr_info("\tFormats:\n");
+        formats = akvcam_m2m_formats(converter);
+
+        for (;;) {
+            akvcam_format_t format = akvcam_list_next(formats, &format_it);
+
+            if (!format_it)
+                break;
+
+            akpr_info("\t\t%s\n", akvcam_format_to_string(format));
+        }
+
+        akvcam_list_delete(formats);
+        akpr_info("\n");
+    }
+}
+
 akvcam_driver_rw_mode_strings_ct akvcam_driver_rw_mode_strs(void)
 {
     static const akvcam_driver_rw_mode_strings rw_mode_strings[] = {
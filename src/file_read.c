@@ -195,10 +195,43 @@ size_t akvcam_file_read(akvcam_file_t self, void *data, size_t size)
 {
     loff_t offset;
     char read_block[AKVCAM_READ_BLOCK];
+    size_t buffered;
 
     if (!self->is_open || size < 1)
         return 0;
 
+    /* Large reads take the buffered data first, and read the rest straight
+     * from the file into the caller buffer.
+     */
+    buffered = akvcam_rbuffer_data_size(self->buffer);
+
+    if (buffered < size && size - buffered >= AKVCAM_READ_BLOCK) {
+        size_t copied = buffered;
+
+        if (copied > 0)
+            akvcam_rbuffer_dequeue_bytes(self->buffer, data, &copied, false);
+
+        while (copied < size && self->file_bytes_read < self->size) {
+            ssize_t bytes_read;
+
+            offset = (loff_t) self->file_bytes_read;
+            bytes_read = kernel_read(self->filp,
+                                     (char *) data + copied,
+                                     size - copied,
+                                     &offset);
+
+            if (bytes_read < 1)
+                break;
+
+            copied += (size_t) bytes_read;
+            self->file_bytes_read += (size_t) bytes_read;
+        }
+
+        self->bytes_read += copied;
+
+        return copied;
+    }
+
     while (self->file_bytes_read < self->size
            && akvcam_rbuffer_data_size(self->buffer) < size) {
         ssize_t bytes_read;
@@ -247,6 +247,16 @@ bool akvcam_format_is_valid(akvcam_format_ct self)
             && self->frame_rate.denominator > 0;
 }
 
+bool akvcam_format_is_compressed(akvcam_format_ct self)
+{
+    return akvcam_fourcc_is_compressed(self->fourcc);
+}
+
+bool akvcam_format_is_inter_coded(akvcam_format_ct self)
+{
+    return akvcam_fourcc_is_inter_coded(self->fourcc);
+}
+
 bool akvcam_format_is_same_format(akvcam_format_ct self, akvcam_format_ct other)
 {
     return self->fourcc == other->fourcc
@@ -590,6 +600,13 @@ static void akvcam_format_private_update_params(akvcam_format_t self,
         self->bpp += plane->bits_size;
     }
 
+    // Compressed frames don't have lines, only a payload.
+    if (specs->type == AKVCAM_VIDEO_FORMAT_TYPE_COMPRESSED)
+        for (i = 0; i < specs->nplanes; ++i) {
+            self->line_size[i] = 0;
+            self->bytes_used[i] = 0;
+        }
+
     // Align total data size for buffer allocation
     self->data_size = akvcam_align_up(self->data_size, (size_t)self->align);
 }
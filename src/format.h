@@ -51,6 +51,8 @@ size_t akvcam_format_bytes_used(akvcam_format_ct self, size_t plane);
 size_t akvcam_format_width_div(akvcam_format_ct self, size_t plane);
 size_t akvcam_format_height_div(akvcam_format_ct self, size_t plane);
 bool akvcam_format_is_valid(akvcam_format_ct self);
+bool akvcam_format_is_compressed(akvcam_format_ct self);
+bool akvcam_format_is_inter_coded(akvcam_format_ct self);
 bool akvcam_format_is_same_format(akvcam_format_ct self, akvcam_format_ct other);
 const char *akvcam_format_to_string(akvcam_format_t self);
 
@@ -25,6 +25,7 @@
 #define VFT_RGB     AKVCAM_VIDEO_FORMAT_TYPE_RGB
 #define VFT_YUV     AKVCAM_VIDEO_FORMAT_TYPE_YUV
 #define VFT_GRAY    AKVCAM_VIDEO_FORMAT_TYPE_GRAY
+#define VFT_COMP    AKVCAM_VIDEO_FORMAT_TYPE_COMPRESSED
 
 #define CT_END AKVCAM_COMPONENT_TYPE_UNKNOWN
 #define CT_R   AKVCAM_COMPONENT_TYPE_R
@@ -420,6 +421,37 @@ static const akvcam_format_specs akvcam_format_specs_table[] = {
         {1, {{CT_V, 1, 0, 0, 1, 8, 1, 0}}, 4}
        }},
 
+     // Compressed formats (up to 2 bytes per pixel of payload)
+
+      {V4L2_PIX_FMT_MJPEG,
+       "MJPG",
+       VFT_COMP,
+       __BYTE_ORDER__,
+       1,
+       {{0, {}, 16}
+       }},
+      {V4L2_PIX_FMT_JPEG,
+       "JPEG",
+       VFT_COMP,
+       __BYTE_ORDER__,
+       1,
+       {{0, {}, 16}
+       }},
+      {V4L2_PIX_FMT_H264,
+       "H264",
+       VFT_COMP,
+       __BYTE_ORDER__,
+       1,
+       {{0, {}, 16}
+       }},
+      {V4L2_PIX_FMT_HEVC,
+       "HEVC",
+       VFT_COMP,
+       __BYTE_ORDER__,
+       1,
+       {{0, {}, 16}
+       }},
+
      // End
 
       {0,
@@ -485,7 +517,8 @@ bool akvcam_format_specs_contains(akvcam_format_specs_ct self,
 
 size_t akvcam_format_specs_byte_depth(akvcam_format_specs_ct self)
 {
-    if (self->type == AKVCAM_VIDEO_FORMAT_TYPE_UNKNOWN)
+    if (self->type == AKVCAM_VIDEO_FORMAT_TYPE_UNKNOWN
+        || self->type == AKVCAM_VIDEO_FORMAT_TYPE_COMPRESSED)
         return 0;
     else if (self->type == AKVCAM_VIDEO_FORMAT_TYPE_RGB)
         return akvcam_format_specs_component(self, AKVCAM_COMPONENT_TYPE_R)->byte_depth;
@@ -495,7 +528,8 @@ size_t akvcam_format_specs_byte_depth(akvcam_format_specs_ct self)
 
 size_t akvcam_format_specs_depth(akvcam_format_specs_ct self)
 {
-     if (self->type == AKVCAM_VIDEO_FORMAT_TYPE_UNKNOWN)
+     if (self->type == AKVCAM_VIDEO_FORMAT_TYPE_UNKNOWN
+         || self->type == AKVCAM_VIDEO_FORMAT_TYPE_COMPRESSED)
          return 0;
      else if (self->type == AKVCAM_VIDEO_FORMAT_TYPE_RGB)
         return akvcam_format_specs_component(self, AKVCAM_COMPONENT_TYPE_R)->depth;
@@ -536,6 +570,11 @@ size_t akvcam_format_specs_main_components(akvcam_format_specs_ct self)
     return n;
 }
 
+bool akvcam_format_specs_is_compressed(akvcam_format_specs_ct self)
+{
+    return self && self->type == AKVCAM_VIDEO_FORMAT_TYPE_COMPRESSED;
+}
+
 bool akvcam_format_specs_is_fast(akvcam_format_specs_ct self)
 {
     size_t cur_depth = 0;
@@ -626,6 +665,19 @@ __u32 akvcam_fourcc_from_string(const char *fourcc_str)
     return 0;
 }
 
+bool akvcam_fourcc_is_compressed(__u32 fourcc)
+{
+    return akvcam_format_specs_is_compressed(akvcam_format_specs_from_fixel_format(fourcc));
+}
+
+// Frames of these formats may depend on the previous ones.
+bool akvcam_fourcc_is_inter_coded(__u32 fourcc)
+{
+    return akvcam_fourcc_is_compressed(fourcc)
+           && fourcc != V4L2_PIX_FMT_MJPEG
+           && fourcc != V4L2_PIX_FMT_JPEG;
+}
+
 const char *akvcam_string_from_fourcc(__u32 fourcc)
 {
     akvcam_format_specs_ct specs =
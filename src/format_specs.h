@@ -34,6 +34,7 @@ size_t akvcam_format_specs_byte_depth(akvcam_format_specs_ct self);
 size_t akvcam_format_specs_depth(akvcam_format_specs_ct self);
 size_t akvcam_format_specs_number_of_components(akvcam_format_specs_ct self);
 size_t akvcam_format_specs_main_components(akvcam_format_specs_ct self);
+bool akvcam_format_specs_is_compressed(akvcam_format_specs_ct self);
 bool akvcam_format_specs_is_fast(akvcam_format_specs_ct self);
 size_t akvcam_plane_pixel_size(akvcam_plane_ct plane);
 size_t akvcam_plane_width_div(akvcam_plane_ct plane);
@@ -42,6 +43,8 @@ uint64_t akvcam_color_component_max(akvcam_color_component_ct color_component);
 
 // public static
 __u32 akvcam_fourcc_from_string(const char *fourcc_str);
+bool akvcam_fourcc_is_compressed(__u32 fourcc);
+bool akvcam_fourcc_is_inter_coded(__u32 fourcc);
 const char *akvcam_string_from_fourcc(__u32 fourcc);
 __u32 akvcam_default_input_pixel_format(void);
 __u32 akvcam_default_output_pixel_format(void);
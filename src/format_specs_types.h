@@ -26,7 +26,8 @@ typedef enum
     AKVCAM_VIDEO_FORMAT_TYPE_UNKNOWN,
     AKVCAM_VIDEO_FORMAT_TYPE_RGB,
     AKVCAM_VIDEO_FORMAT_TYPE_YUV,
-    AKVCAM_VIDEO_FORMAT_TYPE_GRAY
+    AKVCAM_VIDEO_FORMAT_TYPE_GRAY,
+    AKVCAM_VIDEO_FORMAT_TYPE_COMPRESSED
 } AKVCAM_VIDEO_FORMAT_TYPE;
 
 typedef enum
@@ -16,8 +16,11 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define AKVCAM_LOG_CATEGORY AKVCAM_LOG_CATEGORY_FRAME
+
 #include <linux/kref.h>
 #include <linux/slab.h>
+#include <linux/swab.h>
 #include <linux/videodev2.h>
 #include <linux/vmalloc.h>
 
@@ -30,6 +33,7 @@
 #include "utils.h"
 
 #define MAX_PLANES 4
+#define AKVCAM_BMP_READ_BLOCK (1 << 20)
 
 typedef enum
 {
@@ -140,6 +144,9 @@ struct akvcam_frame
     uint8_t *data;
     uint8_t *planes[MAX_PLANES];
     akvcam_fill_parameters_t fc;
+    uint64_t timestamp;
+    uint32_t sequence;
+    size_t bytes_used;
 };
 
 /* Fill functions */
@@ -486,6 +493,12 @@ static bool akvcam_frame_load_rle8(akvcam_frame_t self,
                                    const akvcam_bmp_image_header *image_header,
                                    const akvcam_palette_pixel *palette,
                                    bool top_down);
+static bool akvcam_frame_load_rows(akvcam_frame_t self,
+                                   akvcam_file_t bmp_file,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   uint16_t bit_count,
+                                   bool top_down);
 static void akvcam_frame_private_update_planes(akvcam_frame_t self);
 void akvcam_frame_private_clear(akvcam_frame_t self);
 static akvcam_fill_parameters_t akvcam_fill_parameters_new(void);
@@ -535,6 +548,9 @@ akvcam_frame_t akvcam_frame_new_copy(akvcam_frame_ct other)
     if (self->fc)
         kref_get(&self->fc->ref);
 
+    self->timestamp = other->timestamp;
+    self->sequence = other->sequence;
+    self->bytes_used = other->bytes_used;
     akvcam_frame_private_update_planes(self);
 
     return self;
@@ -568,6 +584,12 @@ akvcam_frame_t akvcam_frame_ref(akvcam_frame_t self)
     return self;
 }
 
+// Tells if someone else holds a reference to the frame.
+bool akvcam_frame_is_shared(akvcam_frame_ct self)
+{
+    return kref_read(&self->ref) > 1;
+}
+
 void akvcam_frame_copy(akvcam_frame_t self, akvcam_frame_ct other)
 {
     size_t data_size;
@@ -593,9 +615,41 @@ void akvcam_frame_copy(akvcam_frame_t self, akvcam_frame_ct other)
     if (self->fc)
         kref_get(&self->fc->ref);
 
+    self->timestamp = other->timestamp;
+    self->sequence = other->sequence;
+    self->bytes_used = other->bytes_used;
     akvcam_frame_private_update_planes(self);
 }
 
+/* Timestamp, in ns, and sequence of the buffer the frame was originally
+ * read from, 0 if the frame was not produced by an output device.
+ */
+uint64_t akvcam_frame_timestamp(akvcam_frame_ct self)
+{
+    return self->timestamp;
+}
+
+void akvcam_frame_set_timestamp(akvcam_frame_t self, uint64_t timestamp)
+{
+    self->timestamp = timestamp;
+}
+
+uint32_t akvcam_frame_sequence(akvcam_frame_ct self)
+{
+    return self->sequence;
+}
+
+void akvcam_frame_set_sequence(akvcam_frame_t self, uint32_t sequence)
+{
+    self->sequence = sequence;
+}
+
+void akvcam_frame_copy_metadata(akvcam_frame_t self, akvcam_frame_ct other)
+{
+    self->timestamp = other->timestamp;
+    self->sequence = other->sequence;
+}
+
 akvcam_format_t akvcam_frame_format_nr(akvcam_frame_ct self)
 {
     return self->format;
@@ -611,6 +665,21 @@ size_t akvcam_frame_size(akvcam_frame_ct self)
     return akvcam_format_size(self->format);
 }
 
+/* Compressed frames only fill part of the data, 0 means the whole frame is
+ * used.
+ */
+size_t akvcam_frame_bytes_used(akvcam_frame_ct self)
+{
+    size_t size = akvcam_frame_size(self);
+
+    return self->bytes_used > 0? akvcam_min(self->bytes_used, size): size;
+}
+
+void akvcam_frame_set_bytes_used(akvcam_frame_t self, size_t bytes_used)
+{
+    self->bytes_used = bytes_used;
+}
+
 const char *akvcam_frame_const_data(akvcam_frame_ct self)
 {
     return (char *) self->data;
@@ -657,7 +726,6 @@ bool akvcam_frame_load(akvcam_frame_t self, const char *file_name)
     uint8_t *line;
     uint32_t x;
     uint32_t y;
-    uint8_t pixel[4];
     bool top_down;
     size_t data_size;
     struct v4l2_fract frame_rate = {0, 0};
@@ -806,33 +874,14 @@ bool akvcam_frame_load(akvcam_frame_t self, const char *file_name)
              break;
 
         case 24:
-            for (y = 0; y < height; y++) {
-                uint32_t line_y = top_down? y: height - y - 1;
-                line = akvcam_frame_line(self, 0, line_y);
-
-                for (x = 0; x < width; x++) {
-                    akvcam_file_read(bmp_file, (char *) pixel, 3);
-                    line[4 * x + 0] = 0xff;     // A
-                    line[4 * x + 1] = pixel[2]; // R
-                    line[4 * x + 2] = pixel[1]; // G
-                    line[4 * x + 3] = pixel[0]; // B
-                }
-            }
-
-            break;
-
         case 32:
-            for (y = 0; y < height; y++) {
-                uint32_t line_y = top_down? y: height - y - 1;
-                line = akvcam_frame_line(self, 0, line_y);
-
-                for (x = 0; x < width; x++) {
-                    akvcam_file_read(bmp_file, (char *) pixel, 4);
-                    line[4 * x + 0] = pixel[3]; // A
-                    line[4 * x + 1] = pixel[2]; // R
-                    line[4 * x + 2] = pixel[1]; // G
-                    line[4 * x + 3] = pixel[0]; // B
-                }
+            if (!akvcam_frame_load_rows(self,
+                                        bmp_file,
+                                        width,
+                                        height,
+                                        bit_count,
+                                        top_down)) {
+                goto akvcam_frame_load_failed;
             }
 
             break;
@@ -914,6 +963,129 @@ void akvcam_frame_fill_rgba(akvcam_frame_t self, uint32_t color)
     }
 }
 
+/* Copy a frame with the same pixel format into this one, with its top left
+ * corner at (x, y). The parts falling outside of the frame are clipped.
+ */
+void akvcam_frame_blit(akvcam_frame_t self,
+                       akvcam_frame_ct frame,
+                       size_t x,
+                       size_t y)
+{
+    akvcam_format_specs_ct specs;
+    size_t width;
+    size_t height;
+    size_t plane;
+
+    if (!self->data
+        || !frame->data
+        || akvcam_format_fourcc(self->format)
+           != akvcam_format_fourcc(frame->format))
+        return;
+
+    specs = akvcam_format_specs_from_fixel_format(akvcam_format_fourcc(self->format));
+
+    if (!specs || akvcam_format_specs_is_compressed(specs))
+        return;
+
+    if (x >= akvcam_format_width(self->format)
+        || y >= akvcam_format_height(self->format))
+        return;
+
+    width = akvcam_min(akvcam_format_width(frame->format),
+                       akvcam_format_width(self->format) - x);
+    height = akvcam_min(akvcam_format_height(frame->format),
+                        akvcam_format_height(self->format) - y);
+
+    for (plane = 0; plane < specs->nplanes; plane++) {
+        size_t bits_size = specs->planes[plane].bits_size;
+        size_t width_div = akvcam_format_width_div(self->format, plane);
+        size_t height_div = akvcam_format_height_div(self->format, plane);
+        size_t dst_line_size = akvcam_format_line_size(self->format, plane);
+        size_t src_line_size = akvcam_format_line_size(frame->format, plane);
+        size_t line_size = bits_size * (width >> width_div) / 8;
+        size_t lines = height >> height_div;
+        uint8_t *dst = akvcam_frame_line(self, plane, y)
+                       + bits_size * (x >> width_div) / 8;
+        const uint8_t *src = frame->planes[plane];
+        size_t i;
+
+        for (i = 0; i < lines; i++) {
+            memcpy(dst, src, line_size);
+            dst += dst_line_size;
+            src += src_line_size;
+        }
+    }
+}
+
+/* Read the 24 and 32 bpp pixels in blocks of rows, and convert each row
+ * from BGR(A) to ARGB in a single pass.
+ */
+static bool akvcam_frame_load_rows(akvcam_frame_t self,
+                                   akvcam_file_t bmp_file,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   uint16_t bit_count,
+                                   bool top_down)
+{
+    size_t pixel_size = bit_count / 8;
+    size_t row_size = akvcam_align_up(pixel_size * width, (size_t) 4);
+    size_t block_rows = akvcam_max(AKVCAM_BMP_READ_BLOCK / row_size, (size_t) 1);
+    uint8_t *rows;
+    uint32_t y = 0;
+
+    block_rows = akvcam_min(block_rows, (size_t) height);
+    rows = vmalloc(block_rows * row_size);
+
+    if (!rows) {
+        akpr_err("Failed to allocate row buffer\n");
+
+        return false;
+    }
+
+    while (y < height) {
+        size_t n_rows = akvcam_min(block_rows, (size_t) (height - y));
+        size_t min_size = n_rows * row_size;
+        size_t i;
+
+        // Some writers don't pad the last row of the file.
+        if (y + n_rows == height)
+            min_size = row_size * (n_rows - 1) + pixel_size * width;
+
+        if (akvcam_file_read(bmp_file, rows, n_rows * row_size) < min_size) {
+            akpr_err("Unexpected end of bitmap file\n");
+            vfree(rows);
+
+            return false;
+        }
+
+        for (i = 0; i < n_rows; i++, y++) {
+            const uint8_t *row = rows + i * row_size;
+            uint8_t *line = akvcam_frame_line(self, 0, top_down? y: height - y - 1);
+            uint32_t x;
+
+            if (bit_count == 32) {
+                // BGRA to ARGB is a byte swap of each pixel.
+                const __u32 *src = (const __u32 *) row;
+                __u32 *dst = (__u32 *) line;
+
+                for (x = 0; x < width; x++)
+                    dst[x] = swab32(src[x]);
+            } else {
+                for (x = 0; x < width; x++) {
+                    line[4 * x + 0] = 0xff;             // A
+                    line[4 * x + 1] = row[3 * x + 2];   // R
+                    line[4 * x + 2] = row[3 * x + 1];   // G
+                    line[4 * x + 3] = row[3 * x];       // B
+                }
+            }
+        }
+    }
+
+    vfree(rows);
+
+    return true;
+}
+
 static bool akvcam_frame_load_rle8(akvcam_frame_t self,
                                    akvcam_file_t bmp_file,
                                    const akvcam_bmp_image_header *image_header,
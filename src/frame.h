@@ -29,11 +29,19 @@ akvcam_frame_t akvcam_frame_new(akvcam_format_t format);
 akvcam_frame_t akvcam_frame_new_copy(akvcam_frame_ct other);
 void akvcam_frame_delete(akvcam_frame_t self);
 akvcam_frame_t akvcam_frame_ref(akvcam_frame_t self);
+bool akvcam_frame_is_shared(akvcam_frame_ct self);
 
 void akvcam_frame_copy(akvcam_frame_t self, akvcam_frame_ct other);
+uint64_t akvcam_frame_timestamp(akvcam_frame_ct self);
+void akvcam_frame_set_timestamp(akvcam_frame_t self, uint64_t timestamp);
+uint32_t akvcam_frame_sequence(akvcam_frame_ct self);
+void akvcam_frame_set_sequence(akvcam_frame_t self, uint32_t sequence);
+void akvcam_frame_copy_metadata(akvcam_frame_t self, akvcam_frame_ct other);
 akvcam_format_t akvcam_frame_format_nr(akvcam_frame_ct self);
 akvcam_format_t akvcam_frame_format(akvcam_frame_ct self);
 size_t akvcam_frame_size(akvcam_frame_ct self);
+size_t akvcam_frame_bytes_used(akvcam_frame_ct self);
+void akvcam_frame_set_bytes_used(akvcam_frame_t self, size_t bytes_used);
 const char *akvcam_frame_const_data(akvcam_frame_ct self);
 char *akvcam_frame_data(akvcam_frame_ct self);
 const uint8_t *akvcam_frame_plane_const_data(akvcam_frame_ct self,
@@ -45,5 +53,9 @@ const uint8_t *akvcam_frame_const_line(akvcam_frame_ct self,
 uint8_t *akvcam_frame_line(akvcam_frame_ct self, size_t plane, size_t y);
 bool akvcam_frame_load(akvcam_frame_t self, const char *file_name);
 void akvcam_frame_fill_rgba(akvcam_frame_t self, uint32_t color);
+void akvcam_frame_blit(akvcam_frame_t self,
+                       akvcam_frame_ct frame,
+                       size_t x,
+                       size_t y);
 
 #endif // AKVCAM_FRAME_H
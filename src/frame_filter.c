@@ -16,15 +16,23 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define AKVCAM_LOG_CATEGORY AKVCAM_LOG_CATEGORY_FRAME
+
+#include <linux/fixp-arith.h>
 #include <linux/kref.h>
+#include <linux/ktime.h>
 #include <linux/slab.h>
 #include <linux/videodev2.h>
 #include <linux/vmalloc.h>
 
 #include "frame_filter.h"
+#include "converter.h"
 #include "frame.h"
 #include "format.h"
+#include "format_specs.h"
 #include "log.h"
+#include "stats.h"
+#include "trace.h"
 #include "utils.h"
 
 struct akvcam_frame_filter
@@ -32,6 +40,7 @@ struct akvcam_frame_filter
     struct kref ref;
     uint8_t *contrast_table;
     uint8_t *gamma_table;
+    bool fast_color_adjust;
 };
 
 void akvcam_rgb_to_hsl(int r, int g, int b, int *h, int *s, int *l);
@@ -39,6 +48,10 @@ void akvcam_hsl_to_rgb(int h, int s, int l, int *r, int *g, int *b);
 void akvcam_init_contrast_table(akvcam_frame_filter_t self);
 void akvcam_init_gamma_table(akvcam_frame_filter_t self);
 int akvcam_grayval(int r, int g, int b);
+void akvcam_color_matrix_multiply(const int64_t *a,
+                                  const int64_t *b,
+                                  int shift,
+                                  int64_t *result);
 
 akvcam_frame_filter_t akvcam_frame_filter_new(void)
 {
@@ -79,6 +92,17 @@ akvcam_frame_filter_t akvcam_frame_filter_ref(akvcam_frame_filter_t self)
     return self;
 }
 
+bool akvcam_frame_filter_fast_color_adjust(akvcam_frame_filter_ct self)
+{
+    return self->fast_color_adjust;
+}
+
+void akvcam_frame_filter_set_fast_color_adjust(akvcam_frame_filter_t self,
+                                               bool fast_color_adjust)
+{
+    self->fast_color_adjust = fast_color_adjust;
+}
+
 void akvcam_frame_filter_swap_rgb(akvcam_frame_filter_ct self,
                                   akvcam_frame_t frame)
 {
@@ -437,6 +461,268 @@ void akvcam_frame_filter_mirror(akvcam_frame_t frame,
     }
 }
 
+/* Build the affine transform equivalent to akvcam_frame_filter_apply, as a
+ * 3x4 matrix working over 8 bits RGB values:
+ *
+ * | r' |   | m00 m01 m02 m03 |   | r |
+ * | g' | = | m10 m11 m12 m13 | * | g | >> shift
+ * | b' |   | m20 m21 m22 m23 |   | b |
+ *                                | 1 |
+ *
+ * Gray and RGB swapping are linear and need no intermediate clamping.
+ * Hue, saturation, luminance and contrast are not: the filters work in HSL
+ * space and clamp the values after each step, while the matrix rotates hue
+ * around the gray axis, scales saturation preserving luma, and only clamps at
+ * the end. Those are only folded if fast_color_adjust is enabled, otherwise
+ * the function returns false and the filters must be applied instead. Gamma
+ * can't be expressed as a matrix.
+ */
+bool akvcam_frame_filter_color_matrix(akvcam_frame_filter_ct self,
+                                      int hue,
+                                      int saturation,
+                                      int luminance,
+                                      int contrast,
+                                      int gamma,
+                                      bool gray,
+                                      bool swap_rgb,
+                                      int64_t *color_matrix,
+                                      int *shift)
+{
+    static const int matrix_shift = 16;
+    int64_t one = 1LL << matrix_shift;
+    int64_t wr = 11 * one / 32;
+    int64_t wg = 16 * one / 32;
+    int64_t wb = 5 * one / 32;
+    int64_t matrix[12];
+    int i;
+
+    if (gamma != 0)
+        return false;
+
+    if (!self->fast_color_adjust
+        && (akvcam_mod(hue, 360) != 0
+            || saturation != 0
+            || luminance != 0
+            || contrast != 0))
+        return false;
+
+    memset(color_matrix, 0, 12 * sizeof(int64_t));
+    color_matrix[0] = one;
+    color_matrix[5] = one;
+    color_matrix[10] = one;
+    *shift = matrix_shift;
+
+    if (saturation != 0) {
+        int64_t k = (255 + akvcam_bound(-255, saturation, 255)) * one / 255;
+        int64_t w[3] = {wr, wg, wb};
+
+        for (i = 0; i < 12; i++) {
+            int row = i / 4;
+            int col = i % 4;
+
+            if (col == 3)
+                matrix[i] = 0;
+            else
+                matrix[i] = ((one - k) * w[col] >> matrix_shift)
+                            + (row == col? k: 0);
+        }
+
+        akvcam_color_matrix_multiply(matrix, color_matrix, matrix_shift, color_matrix);
+    }
+
+    hue = akvcam_mod(hue, 360);
+
+    if (hue != 0) {
+        int64_t c = fixp_cos32(hue) >> (31 - matrix_shift);
+        int64_t t = (one - c) / 3;
+
+        // sin(hue) / sqrt(3)
+        int64_t q = (fixp_sin32(hue) >> (31 - matrix_shift)) * 37837 >> 16;
+
+        matrix[0] = c + t; matrix[1]  = t - q; matrix[2]  = t + q; matrix[3]  = 0;
+        matrix[4] = t + q; matrix[5]  = c + t; matrix[6]  = t - q; matrix[7]  = 0;
+        matrix[8] = t - q; matrix[9]  = t + q; matrix[10] = c + t; matrix[11] = 0;
+
+        akvcam_color_matrix_multiply(matrix, color_matrix, matrix_shift, color_matrix);
+    }
+
+    if (luminance != 0) {
+        luminance = akvcam_bound(-255, luminance, 255);
+        color_matrix[3] += luminance * one;
+        color_matrix[7] += luminance * one;
+        color_matrix[11] += luminance * one;
+    }
+
+    if (contrast != 0) {
+        int64_t f;
+
+        contrast = akvcam_bound(-255, contrast, 255);
+        f = 259 * (255 + contrast) * one / (255 * (259 - contrast));
+        memset(matrix, 0, sizeof(matrix));
+        matrix[0] = f;
+        matrix[5] = f;
+        matrix[10] = f;
+        matrix[3] = 128 * (one - f);
+        matrix[7] = 128 * (one - f);
+        matrix[11] = 128 * (one - f);
+
+        akvcam_color_matrix_multiply(matrix, color_matrix, matrix_shift, color_matrix);
+    }
+
+    if (gray) {
+        for (i = 0; i < 3; i++) {
+            matrix[4 * i + 0] = wr;
+            matrix[4 * i + 1] = wg;
+            matrix[4 * i + 2] = wb;
+            matrix[4 * i + 3] = 0;
+        }
+
+        akvcam_color_matrix_multiply(matrix, color_matrix, matrix_shift, color_matrix);
+    }
+
+    if (swap_rgb) {
+        memset(matrix, 0, sizeof(matrix));
+        matrix[2] = one;
+        matrix[5] = one;
+        matrix[8] = one;
+
+        akvcam_color_matrix_multiply(matrix, color_matrix, matrix_shift, color_matrix);
+    }
+
+    return true;
+}
+
+/* Render the frame in the given format applying the controls. If the
+ * adjustments can be expressed as a color matrix, they are folded into the
+ * format conversion and the frame is converted in a single pass, otherwise
+ * the frame is converted to ARGB, filtered, and converted to the final
+ * format. The crop rectangle is relative to the frame, and the stats are
+ * optional.
+ */
+akvcam_frame_t akvcam_frame_filter_render(akvcam_frame_filter_ct self,
+                                          akvcam_frame_ct frame,
+                                          akvcam_format_ct format,
+                                          akvcam_rendition_controls_ct controls,
+                                          const struct v4l2_rect *crop,
+                                          akvcam_converter_t in_converter,
+                                          akvcam_converter_t out_converter,
+                                          akvcam_stats_t stats,
+                                          int32_t device_num)
+{
+    akvcam_format_t frame_fmt = akvcam_frame_format_nr(frame);
+    akvcam_format_t iformat;
+    akvcam_format_specs_ct ispecs;
+    akvcam_frame_t iframe;
+    akvcam_frame_t oframe;
+    struct v4l2_fract frame_rate;
+    int64_t color_matrix[12];
+    int color_shift = 0;
+    uint64_t convert_time;
+    uint64_t start;
+
+    ispecs = akvcam_format_specs_from_fixel_format(akvcam_format_fourcc(frame_fmt));
+
+    if (!controls->horizontal_flip
+        && !controls->vertical_flip
+        && ispecs
+        && akvcam_format_specs_main_components(ispecs) == 3
+        && akvcam_frame_filter_color_matrix(self,
+                                            controls->hue,
+                                            controls->saturation,
+                                            controls->brightness,
+                                            controls->contrast,
+                                            controls->gamma,
+                                            controls->gray,
+                                            controls->swap_rgb,
+                                            color_matrix,
+                                            &color_shift)) {
+        akvcam_converter_set_output_format(out_converter, format);
+        akvcam_converter_set_scaling_mode(out_converter, controls->scaling);
+        akvcam_converter_set_aspect_ratio_mode(out_converter, controls->aspect_ratio);
+        akvcam_converter_set_color_adjust(out_converter,
+                                          color_matrix,
+                                          color_shift);
+        akvcam_converter_set_input_rect(out_converter, crop);
+
+        start = ktime_get_ns();
+        akvcam_converter_begin(out_converter);
+        oframe = akvcam_converter_convert(out_converter, frame);
+        akvcam_converter_end(out_converter);
+
+        if (stats)
+            akvcam_stats_record(stats,
+                                AKVCAM_STATS_STAGE_CONVERT,
+                                ktime_get_ns() - start);
+
+        return oframe;
+    }
+
+    frame_rate = akvcam_format_frame_rate(frame_fmt);
+
+    /* Crop before filtering, so the filters only process the region that
+     * will be shown.
+     */
+    iformat = akvcam_format_new(V4L2_PIX_FMT_ARGB32,
+                                crop? crop->width: akvcam_format_width(frame_fmt),
+                                crop? crop->height: akvcam_format_height(frame_fmt),
+                                &frame_rate);
+    akvcam_converter_set_output_format(in_converter, iformat);
+    akvcam_converter_set_input_rect(in_converter, crop);
+    akvcam_converter_set_scaling_mode(in_converter, controls->scaling);
+    akvcam_converter_set_aspect_ratio_mode(in_converter, controls->aspect_ratio);
+    akvcam_format_delete(iformat);
+
+    start = ktime_get_ns();
+    akvcam_converter_begin(in_converter);
+    iframe = akvcam_converter_convert(in_converter, frame);
+    akvcam_converter_end(in_converter);
+    convert_time = ktime_get_ns() - start;
+
+    if (!iframe)
+        return NULL;
+
+    start = ktime_get_ns();
+    akvcam_frame_filter_mirror(iframe,
+                               controls->horizontal_flip,
+                               controls->vertical_flip);
+    trace_akvcam_filter_start(device_num, akvcam_frame_size(iframe));
+    akvcam_frame_filter_apply(self,
+                              iframe,
+                              controls->hue,
+                              controls->saturation,
+                              controls->brightness,
+                              controls->contrast,
+                              controls->gamma,
+                              controls->gray,
+                              controls->swap_rgb);
+    trace_akvcam_filter_end(device_num, akvcam_frame_size(iframe));
+
+    if (stats)
+        akvcam_stats_record(stats,
+                            AKVCAM_STATS_STAGE_FILTER,
+                            ktime_get_ns() - start);
+
+    akvcam_converter_set_output_format(out_converter, format);
+    akvcam_converter_set_scaling_mode(out_converter, controls->scaling);
+    akvcam_converter_set_aspect_ratio_mode(out_converter, controls->aspect_ratio);
+    akvcam_converter_set_color_adjust(out_converter, NULL, 0);
+    akvcam_converter_set_input_rect(out_converter, NULL);
+
+    start = ktime_get_ns();
+    akvcam_converter_begin(out_converter);
+    oframe = akvcam_converter_convert(out_converter, iframe);
+    akvcam_converter_end(out_converter);
+
+    if (stats)
+        akvcam_stats_record(stats,
+                            AKVCAM_STATS_STAGE_CONVERT,
+                            convert_time + ktime_get_ns() - start);
+
+    akvcam_frame_delete(iframe);
+
+    return oframe;
+}
+
 void akvcam_rgb_to_hsl(int r, int g, int b, int *h, int *s, int *l)
 {
     int max = akvcam_max(r, akvcam_max(g, b));
@@ -614,3 +900,27 @@ int akvcam_grayval(int r, int g, int b)
 {
     return (11 * r + 16 * g + 5 * b) >> 5;
 }
+
+// Compose two affine 3x4 matrices, b is applied first and then a.
+void akvcam_color_matrix_multiply(const int64_t *a,
+                                  const int64_t *b,
+                                  int shift,
+                                  int64_t *result)
+{
+    int64_t matrix[12];
+    int i;
+    int j;
+
+    for (i = 0; i < 3; i++) {
+        const int64_t *arow = a + 4 * i;
+
+        for (j = 0; j < 4; j++)
+            matrix[4 * i + j] = (arow[0] * b[j]
+                                 + arow[1] * b[4 + j]
+                                 + arow[2] * b[8 + j]) >> shift;
+
+        matrix[4 * i + 3] += arow[3];
+    }
+
+    memcpy(result, matrix, sizeof(matrix));
+}
@@ -22,12 +22,19 @@
 #include <linux/types.h>
 
 #include "frame_filter_types.h"
+#include "converter_types.h"
+#include "format_types.h"
 #include "frame_types.h"
+#include "rendition_cache_types.h"
+#include "stats_types.h"
 
 // public
 akvcam_frame_filter_t akvcam_frame_filter_new(void);
 void akvcam_frame_filter_delete(akvcam_frame_filter_t self);
 akvcam_frame_filter_t akvcam_frame_filter_ref(akvcam_frame_filter_t self);
+bool akvcam_frame_filter_fast_color_adjust(akvcam_frame_filter_ct self);
+void akvcam_frame_filter_set_fast_color_adjust(akvcam_frame_filter_t self,
+                                               bool fast_color_adjust);
 
 void akvcam_frame_filter_swap_rgb(akvcam_frame_filter_ct self,
                                   akvcam_frame_t frame);
@@ -53,6 +60,25 @@ void akvcam_frame_filter_apply(akvcam_frame_filter_ct self,
                                int gamma,
                                bool gray,
                                bool swap_rgb);
+bool akvcam_frame_filter_color_matrix(akvcam_frame_filter_ct self,
+                                      int hue,
+                                      int saturation,
+                                      int luminance,
+                                      int contrast,
+                                      int gamma,
+                                      bool gray,
+                                      bool swap_rgb,
+                                      int64_t *color_matrix,
+                                      int *shift);
+akvcam_frame_t akvcam_frame_filter_render(akvcam_frame_filter_ct self,
+                                          akvcam_frame_ct frame,
+                                          akvcam_format_ct format,
+                                          akvcam_rendition_controls_ct controls,
+                                          const struct v4l2_rect *crop,
+                                          akvcam_converter_t in_converter,
+                                          akvcam_converter_t out_converter,
+                                          akvcam_stats_t stats,
+                                          int32_t device_num);
 
 // public static
 void akvcam_frame_filter_mirror(akvcam_frame_t frame,
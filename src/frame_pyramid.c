@@ -0,0 +1,259 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <linux/kernel.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/videodev2.h>
+
+#include "frame_pyramid.h"
+#include "converter.h"
+#include "format.h"
+#include "frame.h"
+
+// Each level halves the resolution of the previous one.
+#define AKVCAM_FRAME_PYRAMID_LEVELS 5
+
+typedef struct
+{
+    akvcam_converter_t converter;
+    akvcam_frame_t frame;
+    uint64_t sequence;
+    size_t width;
+    size_t height;
+    uint64_t renders;
+    uint64_t render_time;
+} akvcam_frame_pyramid_level_t;
+
+struct akvcam_frame_pyramid
+{
+    struct kref ref;
+    struct mutex mutex;
+    akvcam_frame_pyramid_level_t levels[AKVCAM_FRAME_PYRAMID_LEVELS];
+};
+
+bool akvcam_frame_pyramid_render_level(akvcam_frame_pyramid_level_t *level,
+                                       akvcam_frame_ct frame,
+                                       uint64_t sequence,
+                                       size_t width,
+                                       size_t height);
+
+akvcam_frame_pyramid_t akvcam_frame_pyramid_new(void)
+{
+    size_t i;
+    akvcam_frame_pyramid_t self =
+            kzalloc(sizeof(struct akvcam_frame_pyramid), GFP_KERNEL);
+    kref_init(&self->ref);
+    mutex_init(&self->mutex);
+
+    for (i = 0; i < AKVCAM_FRAME_PYRAMID_LEVELS; i++) {
+        self->levels[i].converter = akvcam_converter_new();
+        akvcam_converter_set_scaling_mode(self->levels[i].converter,
+                                          AKVCAM_SCALING_MODE_LINEAR);
+        akvcam_converter_set_aspect_ratio_mode(self->levels[i].converter,
+                                               AKVCAM_ASPECT_RATIO_MODE_IGNORE);
+    }
+
+    return self;
+}
+
+static void akvcam_frame_pyramid_free(struct kref *ref)
+{
+    size_t i;
+    akvcam_frame_pyramid_t self =
+            container_of(ref, struct akvcam_frame_pyramid, ref);
+
+    for (i = 0; i < AKVCAM_FRAME_PYRAMID_LEVELS; i++) {
+        akvcam_frame_delete(self->levels[i].frame);
+        akvcam_converter_delete(self->levels[i].converter);
+    }
+
+    kfree(self);
+}
+
+void akvcam_frame_pyramid_delete(akvcam_frame_pyramid_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_frame_pyramid_free);
+}
+
+akvcam_frame_pyramid_t akvcam_frame_pyramid_ref(akvcam_frame_pyramid_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+akvcam_frame_t akvcam_frame_pyramid_level(akvcam_frame_pyramid_t self,
+                                          akvcam_frame_ct frame,
+                                          uint64_t sequence,
+                                          size_t width,
+                                          size_t height)
+{
+    akvcam_format_t format;
+    akvcam_frame_ct source = frame;
+    akvcam_frame_t result = NULL;
+    size_t frame_width;
+    size_t frame_height;
+    size_t depth = 0;
+    size_t i;
+
+    if (!frame)
+        return NULL;
+
+    format = akvcam_frame_format_nr(frame);
+    frame_width = akvcam_format_width(format);
+    frame_height = akvcam_format_height(format);
+
+    /* Pick the smallest level that is still at least as big as the requested
+     * size, so the final scaling step is always a downscale.
+     */
+    for (i = 1; i <= AKVCAM_FRAME_PYRAMID_LEVELS; i++) {
+        size_t level_width = (frame_width >> i) & ~(size_t) 1;
+        size_t level_height = (frame_height >> i) & ~(size_t) 1;
+
+        if (level_width < width || level_height < height)
+            break;
+
+        depth = i;
+    }
+
+    if (depth < 1)
+        return NULL;
+
+    if (mutex_lock_interruptible(&self->mutex))
+        return NULL;
+
+    // Every level is built from the previous one.
+    for (i = 0; i < depth; i++) {
+        akvcam_frame_pyramid_level_t *level = self->levels + i;
+
+        if (!akvcam_frame_pyramid_render_level(level,
+                                               source,
+                                               sequence,
+                                               (frame_width >> (i + 1)) & ~(size_t) 1,
+                                               (frame_height >> (i + 1)) & ~(size_t) 1))
+            break;
+
+        source = level->frame;
+    }
+
+    if (i == depth)
+        result = akvcam_frame_ref((akvcam_frame_t) source);
+
+    mutex_unlock(&self->mutex);
+
+    return result;
+}
+
+void akvcam_frame_pyramid_clear(akvcam_frame_pyramid_t self)
+{
+    size_t i;
+
+    mutex_lock(&self->mutex);
+
+    for (i = 0; i < AKVCAM_FRAME_PYRAMID_LEVELS; i++) {
+        akvcam_frame_delete(self->levels[i].frame);
+        self->levels[i].frame = NULL;
+        self->levels[i].sequence = 0;
+        akvcam_converter_reset(self->levels[i].converter);
+    }
+
+    mutex_unlock(&self->mutex);
+}
+
+size_t akvcam_frame_pyramid_stats(akvcam_frame_pyramid_t self,
+                                  char *buffer,
+                                  size_t size)
+{
+    size_t i;
+    size_t n = 0;
+
+    mutex_lock(&self->mutex);
+
+    for (i = 0; i < AKVCAM_FRAME_PYRAMID_LEVELS && n < size; i++) {
+        akvcam_frame_pyramid_level_t *level = self->levels + i;
+        uint64_t average =
+                level->renders?
+                    div64_u64(level->render_time, level->renders): 0;
+
+        n += scnprintf(buffer + n,
+                       size - n,
+                       "%zu %zux%zu renders=%llu avg_ns=%llu\n",
+                       i + 1,
+                       level->width,
+                       level->height,
+                       (unsigned long long) level->renders,
+                       (unsigned long long) average);
+    }
+
+    mutex_unlock(&self->mutex);
+
+    return n;
+}
+
+bool akvcam_frame_pyramid_render_level(akvcam_frame_pyramid_level_t *level,
+                                       akvcam_frame_ct frame,
+                                       uint64_t sequence,
+                                       size_t width,
+                                       size_t height)
+{
+    akvcam_format_t frame_format;
+    akvcam_format_t format;
+    akvcam_frame_t scaled;
+    struct v4l2_fract frame_rate;
+    uint64_t start;
+
+    if (level->frame
+        && level->sequence == sequence
+        && level->width == width
+        && level->height == height)
+        return true;
+
+    frame_format = akvcam_frame_format_nr(frame);
+    frame_rate = akvcam_format_frame_rate(frame_format);
+    format = akvcam_format_new(akvcam_format_fourcc(frame_format),
+                               width,
+                               height,
+                               &frame_rate);
+    akvcam_converter_set_output_format(level->converter, format);
+    akvcam_format_delete(format);
+
+    start = ktime_get_ns();
+    akvcam_converter_begin(level->converter);
+    scaled = akvcam_converter_convert(level->converter, frame);
+    akvcam_converter_end(level->converter);
+
+    if (!scaled)
+        return false;
+
+    akvcam_frame_delete(level->frame);
+    level->frame = scaled;
+    level->sequence = sequence;
+    level->width = width;
+    level->height = height;
+    level->renders++;
+    level->render_time += ktime_get_ns() - start;
+
+    return true;
+}
@@ -0,0 +1,42 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef AKVCAM_FRAME_PYRAMID_H
+#define AKVCAM_FRAME_PYRAMID_H
+
+#include <linux/types.h>
+
+#include "frame_pyramid_types.h"
+#include "frame_types.h"
+
+// public
+akvcam_frame_pyramid_t akvcam_frame_pyramid_new(void);
+void akvcam_frame_pyramid_delete(akvcam_frame_pyramid_t self);
+akvcam_frame_pyramid_t akvcam_frame_pyramid_ref(akvcam_frame_pyramid_t self);
+
+akvcam_frame_t akvcam_frame_pyramid_level(akvcam_frame_pyramid_t self,
+                                          akvcam_frame_ct frame,
+                                          uint64_t sequence,
+                                          size_t width,
+                                          size_t height);
+void akvcam_frame_pyramid_clear(akvcam_frame_pyramid_t self);
+size_t akvcam_frame_pyramid_stats(akvcam_frame_pyramid_t self,
+                                  char *buffer,
+                                  size_t size);
+
+#endif // AKVCAM_FRAME_PYRAMID_H
@@ -0,0 +1,210 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <linux/kref.h>
+#include <linux/slab.h>
+
+#include "frame_queue.h"
+#include "frame.h"
+#include "rbuffer.h"
+#include "utils.h"
+
+typedef struct
+{
+    akvcam_frame_t frame;
+    uint64_t sequence;
+} akvcam_frame_queue_entry, *akvcam_frame_queue_entry_t;
+
+typedef struct
+{
+    AKVCAM_FRAME_QUEUE_POLICY policy;
+    char str[32];
+} akvcam_frame_queue_policy_strings;
+
+static const akvcam_frame_queue_policy_strings akvcam_frame_queue_policy_strs[] = {
+    {AKVCAM_FRAME_QUEUE_POLICY_LATEST       , "latest"       },
+    {AKVCAM_FRAME_QUEUE_POLICY_DROP_OLDEST  , "drop_oldest"  },
+    {AKVCAM_FRAME_QUEUE_POLICY_BACK_PRESSURE, "back_pressure"},
+};
+
+/* Frames are queued by the output device and consumed by the capture device
+ * on each tick. When the queue runs empty the last consumed frame is
+ * returned again.
+ */
+struct akvcam_frame_queue
+{
+    struct kref ref;
+    akvcam_rbuffer_tt(akvcam_frame_queue_entry) entries;
+    akvcam_frame_queue_entry last;
+    size_t depth;
+    AKVCAM_FRAME_QUEUE_POLICY policy;
+};
+
+void akvcam_frame_queue_resize(akvcam_frame_queue_t self);
+
+akvcam_frame_queue_t akvcam_frame_queue_new(void)
+{
+    akvcam_frame_queue_t self =
+            kzalloc(sizeof(struct akvcam_frame_queue), GFP_KERNEL);
+    kref_init(&self->ref);
+    self->entries = akvcam_rbuffer_new();
+    self->depth = 1;
+    self->policy = AKVCAM_FRAME_QUEUE_POLICY_LATEST;
+    akvcam_frame_queue_resize(self);
+
+    return self;
+}
+
+static void akvcam_frame_queue_free(struct kref *ref)
+{
+    akvcam_frame_queue_t self =
+            container_of(ref, struct akvcam_frame_queue, ref);
+    akvcam_frame_queue_clear(self);
+    akvcam_rbuffer_delete(self->entries);
+    kfree(self);
+}
+
+void akvcam_frame_queue_delete(akvcam_frame_queue_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_frame_queue_free);
+}
+
+akvcam_frame_queue_t akvcam_frame_queue_ref(akvcam_frame_queue_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+size_t akvcam_frame_queue_depth(akvcam_frame_queue_ct self)
+{
+    return self->depth;
+}
+
+void akvcam_frame_queue_set_depth(akvcam_frame_queue_t self, size_t depth)
+{
+    depth = akvcam_bound(1, depth, AKVCAM_FRAME_QUEUE_MAX_DEPTH);
+
+    if (self->depth == depth)
+        return;
+
+    self->depth = depth;
+    akvcam_frame_queue_resize(self);
+}
+
+AKVCAM_FRAME_QUEUE_POLICY akvcam_frame_queue_policy(akvcam_frame_queue_ct self)
+{
+    return self->policy;
+}
+
+void akvcam_frame_queue_set_policy(akvcam_frame_queue_t self,
+                                   AKVCAM_FRAME_QUEUE_POLICY policy)
+{
+    if (self->policy == policy)
+        return;
+
+    self->policy = policy;
+    akvcam_frame_queue_resize(self);
+}
+
+size_t akvcam_frame_queue_size(akvcam_frame_queue_ct self)
+{
+    return akvcam_rbuffer_n_data(self->entries);
+}
+
+bool akvcam_frame_queue_full(akvcam_frame_queue_ct self)
+{
+    return akvcam_rbuffer_data_full(self->entries);
+}
+
+bool akvcam_frame_queue_push(akvcam_frame_queue_t self,
+                             akvcam_frame_t frame,
+                             uint64_t sequence)
+{
+    akvcam_frame_queue_entry entry;
+
+    if (akvcam_rbuffer_data_full(self->entries)) {
+        if (self->policy == AKVCAM_FRAME_QUEUE_POLICY_BACK_PRESSURE)
+            return false;
+
+        akvcam_rbuffer_dequeue(self->entries, &entry, false);
+        akvcam_frame_delete(entry.frame);
+    }
+
+    entry.frame = akvcam_frame_ref(frame);
+    entry.sequence = sequence;
+    akvcam_rbuffer_queue(self->entries, &entry);
+
+    return true;
+}
+
+akvcam_frame_t akvcam_frame_queue_pop(akvcam_frame_queue_t self,
+                                      uint64_t *sequence)
+{
+    akvcam_frame_queue_entry entry;
+
+    if (akvcam_rbuffer_dequeue(self->entries, &entry, false)) {
+        akvcam_frame_delete(self->last.frame);
+        self->last = entry;
+    }
+
+    if (sequence)
+        *sequence = self->last.sequence;
+
+    return akvcam_frame_ref(self->last.frame);
+}
+
+void akvcam_frame_queue_clear(akvcam_frame_queue_t self)
+{
+    akvcam_frame_queue_entry entry;
+
+    while (akvcam_rbuffer_dequeue(self->entries, &entry, false))
+        akvcam_frame_delete(entry.frame);
+
+    akvcam_frame_delete(self->last.frame);
+    self->last.frame = NULL;
+    self->last.sequence = 0;
+}
+
+AKVCAM_FRAME_QUEUE_POLICY akvcam_frame_queue_policy_from_string(const char *str)
+{
+    size_t i;
+
+    if (str)
+        for (i = 0; i < ARRAY_SIZE(akvcam_frame_queue_policy_strs); i++)
+            if (strcmp(akvcam_frame_queue_policy_strs[i].str, str) == 0)
+                return akvcam_frame_queue_policy_strs[i].policy;
+
+    return AKVCAM_FRAME_QUEUE_POLICY_LATEST;
+}
+
+void akvcam_frame_queue_resize(akvcam_frame_queue_t self)
+{
+    // Only the most recent frame is kept in latest mode.
+    size_t depth = self->policy == AKVCAM_FRAME_QUEUE_POLICY_LATEST?
+                       1: self->depth;
+
+    akvcam_frame_queue_clear(self);
+    akvcam_rbuffer_resize(self->entries,
+                          depth,
+                          sizeof(akvcam_frame_queue_entry),
+                          AKVCAM_MEMORY_TYPE_KMALLOC);
+}
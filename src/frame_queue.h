@@ -0,0 +1,52 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_FRAME_QUEUE_H
+#define AKVCAM_FRAME_QUEUE_H
+
+#include <linux/types.h>
+
+#include "frame_queue_types.h"
+#include "frame_types.h"
+
+#define AKVCAM_FRAME_QUEUE_MAX_DEPTH 8
+
+// public
+akvcam_frame_queue_t akvcam_frame_queue_new(void);
+void akvcam_frame_queue_delete(akvcam_frame_queue_t self);
+akvcam_frame_queue_t akvcam_frame_queue_ref(akvcam_frame_queue_t self);
+
+size_t akvcam_frame_queue_depth(akvcam_frame_queue_ct self);
+void akvcam_frame_queue_set_depth(akvcam_frame_queue_t self, size_t depth);
+AKVCAM_FRAME_QUEUE_POLICY akvcam_frame_queue_policy(akvcam_frame_queue_ct self);
+void akvcam_frame_queue_set_policy(akvcam_frame_queue_t self,
+                                   AKVCAM_FRAME_QUEUE_POLICY policy);
+size_t akvcam_frame_queue_size(akvcam_frame_queue_ct self);
+bool akvcam_frame_queue_full(akvcam_frame_queue_ct self);
+bool akvcam_frame_queue_push(akvcam_frame_queue_t self,
+                             akvcam_frame_t frame,
+                             uint64_t sequence);
+akvcam_frame_t akvcam_frame_queue_pop(akvcam_frame_queue_t self,
+                                      uint64_t *sequence);
+void akvcam_frame_queue_clear(akvcam_frame_queue_t self);
+
+// public static
+AKVCAM_FRAME_QUEUE_POLICY akvcam_frame_queue_policy_from_string(const char *str);
+
+#endif // AKVCAM_FRAME_QUEUE_H
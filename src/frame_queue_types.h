@@ -0,0 +1,34 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_FRAME_QUEUE_TYPES_H
+#define AKVCAM_FRAME_QUEUE_TYPES_H
+
+typedef enum
+{
+    AKVCAM_FRAME_QUEUE_POLICY_LATEST,
+    AKVCAM_FRAME_QUEUE_POLICY_DROP_OLDEST,
+    AKVCAM_FRAME_QUEUE_POLICY_BACK_PRESSURE,
+} AKVCAM_FRAME_QUEUE_POLICY;
+
+struct akvcam_frame_queue;
+typedef struct akvcam_frame_queue *akvcam_frame_queue_t;
+typedef const struct akvcam_frame_queue *akvcam_frame_queue_ct;
+
+#endif // AKVCAM_FRAME_QUEUE_TYPES_H
@@ -0,0 +1,307 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#include "frame_ring.h"
+#include "format.h"
+#include "frame.h"
+#include "list.h"
+#include "log.h"
+
+/* Frames written by the producer directly into shared memory, the output
+ * device consumes them without any per-frame system call.
+ */
+struct akvcam_frame_ring
+{
+    struct kref ref;
+    struct mutex mutex;
+    wait_queue_head_t wait;
+    akvcam_frame_ring_header *header;
+    char *data;
+    akvcam_format_t format;
+    akvcam_signal_callback(frame_ring, mapped);
+    akvcam_signal_callback(frame_ring, unmapped);
+    atomic_t maps;
+    struct file *mapper;
+    size_t slots;
+    size_t slot_size;
+    __u32 tail;
+    __u32 sequence;
+};
+
+akvcam_signal_define(frame_ring, mapped)
+akvcam_signal_define(frame_ring, unmapped)
+
+static const struct vm_operations_struct akvcam_frame_ring_vm_ops;
+
+void akvcam_frame_ring_vm_open(struct vm_area_struct *vma);
+void akvcam_frame_ring_vm_close(struct vm_area_struct *vma);
+
+akvcam_frame_ring_t akvcam_frame_ring_new(size_t slots,
+                                          akvcam_formats_list_t formats)
+{
+    akvcam_list_element_t it = NULL;
+    size_t data_offset;
+    size_t size;
+
+    akvcam_frame_ring_t self =
+            kzalloc(sizeof(struct akvcam_frame_ring), GFP_KERNEL);
+    kref_init(&self->ref);
+    mutex_init(&self->mutex);
+    init_waitqueue_head(&self->wait);
+    atomic_set(&self->maps, 0);
+    self->slots = akvcam_bound(1, slots, AKVCAM_FRAME_RING_MAX_SLOTS);
+    self->format = akvcam_format_new(0, 0, 0, NULL);
+
+    // The slots must fit any frame the output device may receive.
+    for (;;) {
+        akvcam_format_t format = akvcam_list_next(formats, &it);
+
+        if (!it)
+            break;
+
+        self->slot_size = akvcam_max(self->slot_size,
+                                     akvcam_format_size(format));
+    }
+
+    self->slot_size = PAGE_ALIGN(self->slot_size);
+    data_offset = PAGE_ALIGN(sizeof(akvcam_frame_ring_header)
+                             + self->slots * sizeof(akvcam_frame_ring_slot));
+    size = data_offset + self->slots * self->slot_size;
+    self->header = vmalloc_user(size);
+
+    if (!self->header) {
+        akpr_err("Can't allocate a frame ring of %zu bytes.\n", size);
+        self->slots = 0;
+
+        return self;
+    }
+
+    self->data = (char *) self->header + data_offset;
+    self->header->magic = AKVCAM_FRAME_RING_MAGIC;
+    self->header->version = AKVCAM_FRAME_RING_VERSION;
+    self->header->slots = (__u32) self->slots;
+    self->header->slot_size = (__u32) self->slot_size;
+    self->header->data_offset = (__u32) data_offset;
+    self->header->size = (__u32) size;
+
+    return self;
+}
+
+static void akvcam_frame_ring_free(struct kref *ref)
+{
+    akvcam_frame_ring_t self =
+            container_of(ref, struct akvcam_frame_ring, ref);
+    vfree(self->header);
+    akvcam_format_delete(self->format);
+    kfree(self);
+}
+
+void akvcam_frame_ring_delete(akvcam_frame_ring_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_frame_ring_free);
+}
+
+akvcam_frame_ring_t akvcam_frame_ring_ref(akvcam_frame_ring_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+size_t akvcam_frame_ring_slots(akvcam_frame_ring_ct self)
+{
+    return self->slots;
+}
+
+void akvcam_frame_ring_set_format(akvcam_frame_ring_t self,
+                                  akvcam_format_ct format)
+{
+    mutex_lock(&self->mutex);
+    akvcam_format_copy(self->format, format);
+
+    if (self->header) {
+        self->header->fourcc = akvcam_format_fourcc(format);
+        self->header->width = (__u32) akvcam_format_width(format);
+        self->header->height = (__u32) akvcam_format_height(format);
+        self->header->frame_size = (__u32) akvcam_format_size(format);
+    }
+
+    mutex_unlock(&self->mutex);
+}
+
+bool akvcam_frame_ring_mapped(akvcam_frame_ring_ct self)
+{
+    return atomic_read(&self->maps) > 0;
+}
+
+int akvcam_frame_ring_mmap(akvcam_frame_ring_t self,
+                           struct vm_area_struct *vma)
+{
+    int result;
+
+    if (!self->header)
+        return -ENOMEM;
+
+    // Private mappings would never publish the frames to the device.
+    if (!(vma->vm_flags & VM_SHARED))
+        return -EINVAL;
+
+    mutex_lock(&self->mutex);
+
+    // Only one producer can write to the ring.
+    if (self->mapper && self->mapper != vma->vm_file) {
+        mutex_unlock(&self->mutex);
+
+        return -EBUSY;
+    }
+
+    result = remap_vmalloc_range(vma, self->header, 0);
+
+    if (result) {
+        mutex_unlock(&self->mutex);
+
+        return result;
+    }
+
+    // Start every new producer with an empty ring.
+    if (!self->mapper) {
+        WRITE_ONCE(self->header->head, self->tail);
+        WRITE_ONCE(self->header->tail, self->tail);
+        self->mapper = vma->vm_file;
+    }
+
+    mutex_unlock(&self->mutex);
+
+    vma->vm_ops = &akvcam_frame_ring_vm_ops;
+    vma->vm_private_data = self;
+    akvcam_frame_ring_vm_open(vma);
+
+    return 0;
+}
+
+__poll_t akvcam_frame_ring_poll(akvcam_frame_ring_t self,
+                                struct file *filp,
+                                struct poll_table_struct *wait)
+{
+    __u32 head;
+
+    if (!self->header)
+        return EPOLLERR;
+
+    poll_wait(filp, &self->wait, wait);
+    head = READ_ONCE(self->header->head);
+
+    return head - READ_ONCE(self->tail) < self->slots?
+                EPOLLOUT | EPOLLWRNORM: 0;
+}
+
+akvcam_frame_t akvcam_frame_ring_read_frame(akvcam_frame_ring_t self)
+{
+    akvcam_frame_ring_slot slot;
+    akvcam_frame_t frame;
+    size_t index;
+    size_t size;
+    __u32 pending;
+    __u32 head;
+
+    if (!self->header || !akvcam_format_size(self->format))
+        return NULL;
+
+    mutex_lock(&self->mutex);
+
+    // Read the slot only after the producer published it.
+    head = smp_load_acquire(&self->header->head);
+    pending = head - self->tail;
+
+    if (pending < 1) {
+        mutex_unlock(&self->mutex);
+
+        return NULL;
+    }
+
+    /* The indexes come from user space, a producer running too far ahead
+     * just loses its oldest frames.
+     */
+    if (pending > self->slots)
+        self->tail = head - (__u32) self->slots;
+
+    index = self->tail % self->slots;
+    memcpy(&slot, self->header->slot + index, sizeof(akvcam_frame_ring_slot));
+    frame = akvcam_frame_new(self->format);
+    size = akvcam_min(akvcam_frame_size(frame), self->slot_size);
+
+    if (slot.bytesused > 0)
+        size = akvcam_min(size, (size_t) slot.bytesused);
+
+    memcpy(akvcam_frame_data(frame), self->data + index * self->slot_size, size);
+
+    if (akvcam_format_is_compressed(self->format))
+        akvcam_frame_set_bytes_used(frame, size);
+
+    akvcam_frame_set_timestamp(frame,
+                               slot.timestamp? slot.timestamp: ktime_get_ns());
+    akvcam_frame_set_sequence(frame, self->sequence++);
+
+    // Hand the slot back to the producer.
+    WRITE_ONCE(self->tail, self->tail + 1);
+    smp_store_release(&self->header->tail, self->tail);
+    mutex_unlock(&self->mutex);
+    wake_up_interruptible(&self->wait);
+
+    return frame;
+}
+
+void akvcam_frame_ring_vm_open(struct vm_area_struct *vma)
+{
+    akvcam_frame_ring_t self = vma->vm_private_data;
+
+    akvcam_frame_ring_ref(self);
+
+    if (atomic_inc_return(&self->maps) == 1)
+        akvcam_emit_no_args(self, mapped);
+}
+
+void akvcam_frame_ring_vm_close(struct vm_area_struct *vma)
+{
+    akvcam_frame_ring_t self = vma->vm_private_data;
+
+    if (atomic_dec_return(&self->maps) == 0) {
+        mutex_lock(&self->mutex);
+        self->mapper = NULL;
+        mutex_unlock(&self->mutex);
+        akvcam_emit_no_args(self, unmapped);
+    }
+
+    akvcam_frame_ring_delete(self);
+}
+
+static const struct vm_operations_struct akvcam_frame_ring_vm_ops = {
+    .open  = akvcam_frame_ring_vm_open ,
+    .close = akvcam_frame_ring_vm_close,
+};
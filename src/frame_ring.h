@@ -0,0 +1,57 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_FRAME_RING_H
+#define AKVCAM_FRAME_RING_H
+
+#include <linux/poll.h>
+#include <linux/types.h>
+
+#include "frame_ring_types.h"
+#include "format_types.h"
+#include "frame_types.h"
+#include "utils.h"
+
+#define AKVCAM_FRAME_RING_MAX_SLOTS 64
+
+struct file;
+struct vm_area_struct;
+
+// public
+akvcam_frame_ring_t akvcam_frame_ring_new(size_t slots,
+                                          akvcam_formats_list_t formats);
+void akvcam_frame_ring_delete(akvcam_frame_ring_t self);
+akvcam_frame_ring_t akvcam_frame_ring_ref(akvcam_frame_ring_t self);
+
+size_t akvcam_frame_ring_slots(akvcam_frame_ring_ct self);
+void akvcam_frame_ring_set_format(akvcam_frame_ring_t self,
+                                  akvcam_format_ct format);
+bool akvcam_frame_ring_mapped(akvcam_frame_ring_ct self);
+int akvcam_frame_ring_mmap(akvcam_frame_ring_t self,
+                           struct vm_area_struct *vma);
+__poll_t akvcam_frame_ring_poll(akvcam_frame_ring_t self,
+                                struct file *filp,
+                                struct poll_table_struct *wait);
+akvcam_frame_t akvcam_frame_ring_read_frame(akvcam_frame_ring_t self);
+
+// signals
+akvcam_signal_no_args(frame_ring, mapped);
+akvcam_signal_no_args(frame_ring, unmapped);
+
+#endif // AKVCAM_FRAME_RING_H
@@ -0,0 +1,70 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_FRAME_RING_TYPES_H
+#define AKVCAM_FRAME_RING_TYPES_H
+
+#include <linux/types.h>
+
+#define AKVCAM_FRAME_RING_MAGIC   0x414b5652 // "AKVR"
+#define AKVCAM_FRAME_RING_VERSION 1
+
+/* Offset passed to mmap() on the output device for mapping the frame ring,
+ * it's far above any buffer cookie handed out by videobuf2.
+ */
+#define AKVCAM_FRAME_RING_MMAP_OFFSET 0x40000000
+
+struct akvcam_frame_ring;
+typedef struct akvcam_frame_ring *akvcam_frame_ring_t;
+typedef const struct akvcam_frame_ring *akvcam_frame_ring_ct;
+
+/* Layout of the ring shared with the producer. The first page holds the
+ * header followed by one descriptor per slot, the slots start at
+ * data_offset and are slot_size bytes apart.
+ *
+ * The producer fills the slot at head % slots, sets its descriptor and then
+ * increments head. The driver consumes the slot at tail % slots and then
+ * increments tail. Both indexes are free running.
+ */
+typedef struct
+{
+    __u64 timestamp;
+    __u32 bytesused;
+    __u32 reserved;
+} akvcam_frame_ring_slot;
+
+typedef struct
+{
+    __u32 magic;
+    __u32 version;
+    __u32 slots;
+    __u32 slot_size;
+    __u32 data_offset;
+    __u32 size;
+    __u32 fourcc;
+    __u32 width;
+    __u32 height;
+    __u32 frame_size;
+    __u32 reserved[4];
+    __u32 head;
+    __u32 tail;
+    akvcam_frame_ring_slot slot[];
+} akvcam_frame_ring_header;
+
+#endif // AKVCAM_FRAME_RING_TYPES_H
@@ -16,6 +16,8 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define AKVCAM_LOG_CATEGORY AKVCAM_LOG_CATEGORY_IOCTL
+
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-event.h>
 #include <media/v4l2-ioctl.h>
@@ -48,6 +50,12 @@ int akvcam_ioctl_s_fmt(struct file *file,
 int akvcam_ioctl_try_fmt(struct file *file,
                          void *fh,
                          struct v4l2_format *format);
+void akvcam_ioctl_negotiate_format(akvcam_device_ct device,
+                                   akvcam_formats_list_t formats,
+                                   __u32 *fourcc,
+                                   __u32 *width,
+                                   __u32 *height,
+                                   struct v4l2_fract *frame_rate);
 int akvcam_ioctl_enum_input(struct file *file,
                             void *fh,
                             struct v4l2_input *input);
@@ -63,12 +71,41 @@ int akvcam_ioctl_g_parm(struct file *file,
 int akvcam_ioctl_s_parm(struct file *file,
                         void *fh,
                         struct v4l2_streamparm *param);
+int akvcam_ioctl_g_selection(struct file *file,
+                             void *fh,
+                             struct v4l2_selection *selection);
+int akvcam_ioctl_s_selection(struct file *file,
+                             void *fh,
+                             struct v4l2_selection *selection);
+bool akvcam_ioctl_selection_supported(akvcam_device_ct device,
+                                      const struct v4l2_selection *selection);
 int akvcam_ioctl_enum_framesizes(struct file *file,
                                  void *fh,
                                  struct v4l2_frmsizeenum *frame_sizes);
 int akvcam_ioctl_enum_frameintervals(struct file *file,
                                      void *fh,
                                      struct v4l2_frmivalenum *frame_intervals);
+int akvcam_ioctl_reqbufs(struct file *file,
+                         void *fh,
+                         struct v4l2_requestbuffers *request);
+int akvcam_ioctl_querybuf(struct file *file,
+                          void *fh,
+                          struct v4l2_buffer *buffer);
+int akvcam_ioctl_qbuf(struct file *file, void *fh, struct v4l2_buffer *buffer);
+int akvcam_ioctl_expbuf(struct file *file,
+                        void *fh,
+                        struct v4l2_exportbuffer *buffer);
+int akvcam_ioctl_dqbuf(struct file *file, void *fh, struct v4l2_buffer *buffer);
+int akvcam_ioctl_create_bufs(struct file *file,
+                             void *fh,
+                             struct v4l2_create_buffers *buffers);
+int akvcam_ioctl_prepare_buf(struct file *file,
+                             void *fh,
+                             struct v4l2_buffer *buffer);
+int akvcam_ioctl_streamon(struct file *file, void *fh, enum v4l2_buf_type type);
+int akvcam_ioctl_streamoff(struct file *file,
+                           void *fh,
+                           enum v4l2_buf_type type);
 
 const struct v4l2_ioctl_ops *akvcam_ioctl_ops(void)
 {
@@ -88,15 +125,15 @@ const struct v4l2_ioctl_ops *akvcam_ioctl_ops(void)
         .vidioc_try_fmt_vid_out        = akvcam_ioctl_try_fmt            ,
         .vidioc_try_fmt_vid_cap_mplane = akvcam_ioctl_try_fmt            ,
         .vidioc_try_fmt_vid_out_mplane = akvcam_ioctl_try_fmt            ,
-        .vidioc_reqbufs                = vb2_ioctl_reqbufs               ,
-        .vidioc_querybuf               = vb2_ioctl_querybuf              ,
-        .vidioc_qbuf                   = vb2_ioctl_qbuf                  ,
-        .vidioc_expbuf                 = vb2_ioctl_expbuf                ,
-        .vidioc_dqbuf                  = vb2_ioctl_dqbuf                 ,
-        .vidioc_create_bufs            = vb2_ioctl_create_bufs           ,
-        .vidioc_prepare_buf            = vb2_ioctl_prepare_buf           ,
-        .vidioc_streamon               = vb2_ioctl_streamon              ,
-        .vidioc_streamoff              = vb2_ioctl_streamoff             ,
+        .vidioc_reqbufs                = akvcam_ioctl_reqbufs            ,
+        .vidioc_querybuf               = akvcam_ioctl_querybuf           ,
+        .vidioc_qbuf                   = akvcam_ioctl_qbuf               ,
+        .vidioc_expbuf                 = akvcam_ioctl_expbuf             ,
+        .vidioc_dqbuf                  = akvcam_ioctl_dqbuf              ,
+        .vidioc_create_bufs            = akvcam_ioctl_create_bufs        ,
+        .vidioc_prepare_buf            = akvcam_ioctl_prepare_buf        ,
+        .vidioc_streamon               = akvcam_ioctl_streamon           ,
+        .vidioc_streamoff              = akvcam_ioctl_streamoff          ,
         .vidioc_enum_input             = akvcam_ioctl_enum_input         ,
         .vidioc_g_input                = akvcam_ioctl_g_input            ,
         .vidioc_s_input                = akvcam_ioctl_s_input            ,
@@ -105,6 +142,8 @@ const struct v4l2_ioctl_ops *akvcam_ioctl_ops(void)
         .vidioc_s_output               = akvcam_ioctl_s_output           ,
         .vidioc_g_parm                 = akvcam_ioctl_g_parm             ,
         .vidioc_s_parm                 = akvcam_ioctl_s_parm             ,
+        .vidioc_g_selection            = akvcam_ioctl_g_selection        ,
+        .vidioc_s_selection            = akvcam_ioctl_s_selection        ,
         .vidioc_log_status             = v4l2_ctrl_log_status            ,
         .vidioc_enum_framesizes        = akvcam_ioctl_enum_framesizes    ,
         .vidioc_enum_frameintervals    = akvcam_ioctl_enum_frameintervals,
@@ -165,7 +204,8 @@ int akvcam_ioctl_enum_fmt(struct file *file,
     if (fourcc) {
         const char *description;
 
-        format->flags = 0;
+        format->flags = akvcam_fourcc_is_compressed(*fourcc)?
+                            V4L2_FMT_FLAG_COMPRESSED: 0;
         format->pixelformat = *fourcc;
         description = akvcam_string_from_fourcc(format->pixelformat);
         snprintf((char *) format->description, 32, "%s", description);
@@ -249,13 +289,54 @@ int akvcam_ioctl_s_fmt(struct file *file, void *fh, struct v4l2_format *format)
                                                &frame_rate);
         }
 
-        akvcam_device_set_format(device, current_format);
+        /* In shared mode, other readers may have buffers allocated for the
+         * current format even if the device isn't streaming yet.
+         */
+        if (!akvcam_device_streaming(device)
+            && !akvcam_device_readers_busy(device, file))
+            akvcam_device_set_format(device, current_format);
+        else if (!akvcam_format_is_same_format(current_format, device_format))
+            result = -EBUSY;
+
         akvcam_format_delete(current_format);
     }
 
     return result;
 }
 
+/* Fill the parts of the requested format that the device can't honour, or
+ * that the client left unspecified, with the active format of the output
+ * device, so the nearest format is the one that needs no conversion.
+ */
+void akvcam_ioctl_negotiate_format(akvcam_device_ct device,
+                                   akvcam_formats_list_t formats,
+                                   __u32 *fourcc,
+                                   __u32 *width,
+                                   __u32 *height,
+                                   struct v4l2_fract *frame_rate)
+{
+    akvcam_format_t preferred = akvcam_device_preferred_format(device);
+    akvcam_resolutions_list_t resolutions;
+
+    if (!preferred)
+        return;
+
+    resolutions = akvcam_format_resolutions(formats, *fourcc);
+
+    if (akvcam_list_empty(resolutions))
+        *fourcc = akvcam_format_fourcc(preferred);
+
+    if (*width < 1 || *height < 1) {
+        *width = (__u32) akvcam_format_width(preferred);
+        *height = (__u32) akvcam_format_height(preferred);
+    }
+
+    *frame_rate = akvcam_format_frame_rate(preferred);
+
+    akvcam_list_delete(resolutions);
+    akvcam_format_delete(preferred);
+}
+
 int akvcam_ioctl_try_fmt(struct file *file,
                          void *fh,
                          struct v4l2_format *format)
@@ -265,6 +346,9 @@ int akvcam_ioctl_try_fmt(struct file *file,
     akvcam_format_t temp_format;
     akvcam_formats_list_t formats;
     struct v4l2_fract frame_rate = {0, 0};
+    __u32 fourcc;
+    __u32 width;
+    __u32 height;
     UNUSED(fh);
 
     akpr_function();
@@ -273,14 +357,21 @@ int akvcam_ioctl_try_fmt(struct file *file,
     if (format->type != akvcam_device_v4l2_type(device))
         return -EINVAL;
 
-    if (akvcam_device_streaming(device))
+    // Shared devices accept the active format from the other readers.
+    if (akvcam_device_streaming(device) && !akvcam_device_shared(device))
         return -EBUSY;
 
-    temp_format = akvcam_format_new(format->fmt.pix.pixelformat,
-                                    format->fmt.pix.width,
-                                    format->fmt.pix.height,
-                                    &frame_rate);
+    fourcc = format->fmt.pix.pixelformat;
+    width = format->fmt.pix.width;
+    height = format->fmt.pix.height;
     formats = akvcam_device_formats(device);
+    akvcam_ioctl_negotiate_format(device,
+                                  formats,
+                                  &fourcc,
+                                  &width,
+                                  &height,
+                                  &frame_rate);
+    temp_format = akvcam_format_new(fourcc, width, height, &frame_rate);
     nearest_format = akvcam_format_nearest(formats, temp_format);
     akvcam_list_delete(formats);
     akvcam_format_delete(temp_format);
@@ -559,6 +650,97 @@ int akvcam_ioctl_s_parm(struct file *file,
     return result;
 }
 
+int akvcam_ioctl_g_selection(struct file *file,
+                             void *fh,
+                             struct v4l2_selection *selection)
+{
+    akvcam_device_t device = video_drvdata(file);
+    akvcam_format_t format;
+    UNUSED(fh);
+
+    akpr_function();
+    akpr_debug("Device: /dev/video%d\n", akvcam_device_num(device));
+
+    if (!akvcam_ioctl_selection_supported(device, selection))
+        return -EINVAL;
+
+    switch (selection->target) {
+    case V4L2_SEL_TGT_CROP:
+        akvcam_device_crop(device, &selection->r);
+
+        break;
+
+    case V4L2_SEL_TGT_CROP_DEFAULT:
+    case V4L2_SEL_TGT_CROP_BOUNDS:
+        akvcam_device_crop_bounds(device, &selection->r);
+
+        break;
+
+    // The cropped frame is always scaled to the whole capture frame.
+    case V4L2_SEL_TGT_COMPOSE:
+    case V4L2_SEL_TGT_COMPOSE_DEFAULT:
+    case V4L2_SEL_TGT_COMPOSE_BOUNDS:
+        format = akvcam_device_format_nr(device);
+        selection->r.left = 0;
+        selection->r.top = 0;
+        selection->r.width = (__u32) akvcam_format_width(format);
+        selection->r.height = (__u32) akvcam_format_height(format);
+
+        break;
+
+    default:
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+int akvcam_ioctl_s_selection(struct file *file,
+                             void *fh,
+                             struct v4l2_selection *selection)
+{
+    akvcam_device_t device = video_drvdata(file);
+
+    akpr_function();
+    akpr_debug("Device: /dev/video%d\n", akvcam_device_num(device));
+
+    if (!akvcam_ioctl_selection_supported(device, selection))
+        return -EINVAL;
+
+    switch (selection->target) {
+    case V4L2_SEL_TGT_CROP:
+        akvcam_device_set_crop(device, &selection->r);
+
+        return 0;
+
+    case V4L2_SEL_TGT_COMPOSE:
+        selection->target = V4L2_SEL_TGT_COMPOSE_BOUNDS;
+        akvcam_ioctl_g_selection(file, fh, selection);
+        selection->target = V4L2_SEL_TGT_COMPOSE;
+
+        return 0;
+
+    default:
+        break;
+    }
+
+    return -EINVAL;
+}
+
+/* Cropping is done by the converter, so it's only available for capture
+ * devices that aren't in direct mode.
+ */
+bool akvcam_ioctl_selection_supported(akvcam_device_ct device,
+                                      const struct v4l2_selection *selection)
+{
+    if (akvcam_device_type(device) != AKVCAM_DEVICE_TYPE_CAPTURE
+        || akvcam_device_direct_mode(device))
+        return false;
+
+    return selection->type == V4L2_BUF_TYPE_VIDEO_CAPTURE
+           || selection->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+}
+
 int akvcam_ioctl_enum_framesizes(struct file *file,
                                  void *fh,
                                  struct v4l2_frmsizeenum *frame_sizes)
@@ -622,3 +804,117 @@ int akvcam_ioctl_enum_frameintervals(struct file *file,
 
     return frame_rate? 0: -EINVAL;
 }
+
+/* Shared devices give each file its own queue, the other devices use the
+ * queue of the video device.
+ */
+int akvcam_ioctl_reqbufs(struct file *file,
+                         void *fh,
+                         struct v4l2_requestbuffers *request)
+{
+    struct vb2_queue *queue =
+            akvcam_device_file_queue(video_drvdata(file), file);
+
+    if (!queue)
+        return vb2_ioctl_reqbufs(file, fh, request);
+
+    return vb2_reqbufs(queue, request);
+}
+
+int akvcam_ioctl_querybuf(struct file *file,
+                          void *fh,
+                          struct v4l2_buffer *buffer)
+{
+    struct vb2_queue *queue =
+            akvcam_device_file_queue(video_drvdata(file), file);
+
+    if (!queue)
+        return vb2_ioctl_querybuf(file, fh, buffer);
+
+    return vb2_querybuf(queue, buffer);
+}
+
+int akvcam_ioctl_qbuf(struct file *file, void *fh, struct v4l2_buffer *buffer)
+{
+    struct vb2_queue *queue =
+            akvcam_device_file_queue(video_drvdata(file), file);
+
+    if (!queue)
+        return vb2_ioctl_qbuf(file, fh, buffer);
+
+    return vb2_qbuf(queue, video_devdata(file)->v4l2_dev->mdev, buffer);
+}
+
+int akvcam_ioctl_expbuf(struct file *file,
+                        void *fh,
+                        struct v4l2_exportbuffer *buffer)
+{
+    struct vb2_queue *queue =
+            akvcam_device_file_queue(video_drvdata(file), file);
+
+    if (!queue)
+        return vb2_ioctl_expbuf(file, fh, buffer);
+
+    return vb2_expbuf(queue, buffer);
+}
+
+int akvcam_ioctl_dqbuf(struct file *file, void *fh, struct v4l2_buffer *buffer)
+{
+    struct vb2_queue *queue =
+            akvcam_device_file_queue(video_drvdata(file), file);
+
+    if (!queue)
+        return vb2_ioctl_dqbuf(file, fh, buffer);
+
+    return vb2_dqbuf(queue, buffer, file->f_flags & O_NONBLOCK);
+}
+
+int akvcam_ioctl_create_bufs(struct file *file,
+                             void *fh,
+                             struct v4l2_create_buffers *buffers)
+{
+    struct vb2_queue *queue =
+            akvcam_device_file_queue(video_drvdata(file), file);
+
+    if (!queue)
+        return vb2_ioctl_create_bufs(file, fh, buffers);
+
+    return vb2_create_bufs(queue, buffers);
+}
+
+int akvcam_ioctl_prepare_buf(struct file *file,
+                             void *fh,
+                             struct v4l2_buffer *buffer)
+{
+    struct vb2_queue *queue =
+            akvcam_device_file_queue(video_drvdata(file), file);
+
+    if (!queue)
+        return vb2_ioctl_prepare_buf(file, fh, buffer);
+
+    return vb2_prepare_buf(queue, video_devdata(file)->v4l2_dev->mdev, buffer);
+}
+
+int akvcam_ioctl_streamon(struct file *file, void *fh, enum v4l2_buf_type type)
+{
+    struct vb2_queue *queue =
+            akvcam_device_file_queue(video_drvdata(file), file);
+
+    if (!queue)
+        return vb2_ioctl_streamon(file, fh, type);
+
+    return vb2_streamon(queue, type);
+}
+
+int akvcam_ioctl_streamoff(struct file *file,
+                           void *fh,
+                           enum v4l2_buf_type type)
+{
+    struct vb2_queue *queue =
+            akvcam_device_file_queue(video_drvdata(file), file);
+
+    if (!queue)
+        return vb2_ioctl_streamoff(file, fh, type);
+
+    return vb2_streamoff(queue, type);
+}
@@ -18,10 +18,16 @@
 
 #include "log.h"
 
+DEFINE_STATIC_KEY_FALSE(akvcam_log_enabled_key);
+DEFINE_STATIC_KEY_FALSE(akvcam_log_debug_key);
+
 static struct akvcam_log
 {
     int level;
-} akvcam_log_private;
+    unsigned int categories;
+} akvcam_log_private = {
+    .categories = AKVCAM_LOG_CATEGORY_ALL,
+};
 
 int akvcam_log_level(void)
 {
@@ -31,4 +37,24 @@ int akvcam_log_level(void)
 void akvcam_log_set_level(int level)
 {
     akvcam_log_private.level = level;
+
+    if (level >= LOGLEVEL_ERR)
+        static_branch_enable(&akvcam_log_enabled_key);
+    else
+        static_branch_disable(&akvcam_log_enabled_key);
+
+    if (level >= LOGLEVEL_DEBUG)
+        static_branch_enable(&akvcam_log_debug_key);
+    else
+        static_branch_disable(&akvcam_log_debug_key);
+}
+
+unsigned int akvcam_log_categories(void)
+{
+    return akvcam_log_private.categories;
+}
+
+void akvcam_log_set_categories(unsigned int categories)
+{
+    akvcam_log_private.categories = categories;
 }
@@ -19,47 +19,80 @@
 #ifndef AKVCAM_LOG_H
 #define AKVCAM_LOG_H
 
+#include <linux/jump_label.h>
+#include <linux/printk.h>
 #include <linux/version.h>
 
+/* Debug messages are grouped by subsystem, a source file can select its
+ * category by defining AKVCAM_LOG_CATEGORY before including any header.
+ */
+#define AKVCAM_LOG_CATEGORY_DRIVER  0x01
+#define AKVCAM_LOG_CATEGORY_DEVICE  0x02
+#define AKVCAM_LOG_CATEGORY_BUFFERS 0x04
+#define AKVCAM_LOG_CATEGORY_IOCTL   0x08
+#define AKVCAM_LOG_CATEGORY_FRAME   0x10
+#define AKVCAM_LOG_CATEGORY_ALL     0x1f
+
+#ifndef AKVCAM_LOG_CATEGORY
+#define AKVCAM_LOG_CATEGORY AKVCAM_LOG_CATEGORY_DRIVER
+#endif
+
 #define akpr_file_name (strrchr(__FILE__, '/')? strrchr(__FILE__, '/') + 1: __FILE__)
 #define akpr_log_format "[akvcam] %s(%d): "
 
-#define akpr_err(fmt, ...) \
+/* The keys are only enabled when the log level allows printing something,
+ * so disabled log calls in hot paths cost a single no-op instruction.
+ */
+DECLARE_STATIC_KEY_FALSE(akvcam_log_enabled_key);
+DECLARE_STATIC_KEY_FALSE(akvcam_log_debug_key);
+
+#define akpr_enabled(level) \
+    (static_branch_unlikely(&akvcam_log_enabled_key) \
+     && akvcam_log_level() >= (level))
+
+#define akpr_debug_enabled() \
+    (static_branch_unlikely(&akvcam_log_debug_key) \
+     && (akvcam_log_categories() & AKVCAM_LOG_CATEGORY))
+
+#define akpr_print(enabled, print, level, fmt, ...) \
     do { \
-        if (akvcam_log_level() >= LOGLEVEL_ERR) { \
-            printk(KERN_ERR akpr_log_format fmt, \
-                   akpr_file_name, __LINE__, ##__VA_ARGS__); \
+        if (enabled) { \
+            print(level akpr_log_format fmt, \
+                  akpr_file_name, __LINE__, ##__VA_ARGS__); \
         } \
     } while (false)
 
+#define akpr_err(fmt, ...) \
+    akpr_print(akpr_enabled(LOGLEVEL_ERR), printk, KERN_ERR, fmt, ##__VA_ARGS__)
+
 #define akpr_warning(fmt, ...) \
-    do { \
-        if (akvcam_log_level() >= LOGLEVEL_WARNING) { \
-            printk(KERN_WARNING akpr_log_format fmt, \
-                   akpr_file_name, __LINE__, ##__VA_ARGS__); \
-        } \
-    } while (false)
+    akpr_print(akpr_enabled(LOGLEVEL_WARNING), printk, KERN_WARNING, fmt, ##__VA_ARGS__)
 
 #define akpr_info(fmt, ...) \
-    do { \
-        if (akvcam_log_level() >= LOGLEVEL_INFO) { \
-            printk(KERN_INFO akpr_log_format fmt, \
-                   akpr_file_name, __LINE__, ##__VA_ARGS__); \
-        } \
-    } while (false)
+    akpr_print(akpr_enabled(LOGLEVEL_INFO), printk, KERN_INFO, fmt, ##__VA_ARGS__)
 
 #define akpr_debug(fmt, ...) \
-    do { \
-        if (akvcam_log_level() >= LOGLEVEL_DEBUG) { \
-            printk(KERN_DEBUG akpr_log_format fmt, \
-                   akpr_file_name, __LINE__, ##__VA_ARGS__); \
-        } \
-    } while (false)
+    akpr_print(akpr_debug_enabled(), printk, KERN_DEBUG, fmt, ##__VA_ARGS__)
+
+// Rate limited variants, for messages that can be triggered on every frame.
+#define akpr_err_ratelimited(fmt, ...) \
+    akpr_print(akpr_enabled(LOGLEVEL_ERR), printk_ratelimited, KERN_ERR, fmt, ##__VA_ARGS__)
+
+#define akpr_warning_ratelimited(fmt, ...) \
+    akpr_print(akpr_enabled(LOGLEVEL_WARNING), printk_ratelimited, KERN_WARNING, fmt, ##__VA_ARGS__)
+
+#define akpr_info_ratelimited(fmt, ...) \
+    akpr_print(akpr_enabled(LOGLEVEL_INFO), printk_ratelimited, KERN_INFO, fmt, ##__VA_ARGS__)
+
+#define akpr_debug_ratelimited(fmt, ...) \
+    akpr_print(akpr_debug_enabled(), printk_ratelimited, KERN_DEBUG, fmt, ##__VA_ARGS__)
 
 #define akpr_function() \
     akpr_debug("%s()\n", __FUNCTION__)
 
 int akvcam_log_level(void);
 void akvcam_log_set_level(int level);
+unsigned int akvcam_log_categories(void);
+void akvcam_log_set_categories(unsigned int categories);
 
 #endif // AKVCAM_LOG_H
@@ -0,0 +1,1041 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#define AKVCAM_LOG_CATEGORY AKVCAM_LOG_CATEGORY_DEVICE
+
+#include <linux/dma-direction.h>
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
+#include <media/v4l2-ctrls.h>
+#include <media/v4l2-device.h>
+#include <media/v4l2-event.h>
+#include <media/v4l2-ioctl.h>
+#include <media/v4l2-mem2mem.h>
+#include <media/videobuf2-vmalloc.h>
+
+#include "m2m.h"
+#include "buffers.h"
+#include "controls.h"
+#include "converter.h"
+#include "driver.h"
+#include "format.h"
+#include "frame.h"
+#include "frame_filter.h"
+#include "list.h"
+#include "log.h"
+
+#define DEFAULT_COLORSPACE V4L2_COLORSPACE_RAW
+
+// Maximum number of buffers converted on each job.
+#define AKVCAM_M2M_BATCH_SIZE 4
+
+struct akvcam_m2m
+{
+    struct kref ref;
+    char *description;
+    akvcam_formats_list_t formats;
+    akvcam_frame_filter_ct frame_filter;
+    struct v4l2_device v4l2_dev;
+    struct v4l2_m2m_dev *m2m_dev;
+    struct workqueue_struct *workqueue;
+    struct video_device *vdev;
+    struct mutex device_mutex;
+    enum v4l2_buf_type output_type;
+    enum v4l2_buf_type capture_type;
+    AKVCAM_RW_MODE rw_mode;
+    int32_t videonr;
+};
+
+// Per file handle conversion state.
+typedef struct
+{
+    struct v4l2_fh fh;
+    struct work_struct work;
+    akvcam_m2m_t m2m;
+    akvcam_controls_t controls;
+    akvcam_format_t input_format;
+    akvcam_format_t output_format;
+    akvcam_converter_t in_video_converter;
+    akvcam_converter_t out_video_converter;
+    __u32 sequence;
+    bool aborting;
+
+    // Controls
+    int brightness;
+    int contrast;
+    int gamma;
+    int saturation;
+    int hue;
+    bool gray;
+    bool horizontal_flip;
+    bool vertical_flip;
+    bool swap_rgb;
+    AKVCAM_SCALING_MODE scaling;
+    AKVCAM_ASPECT_RATIO_MODE aspect_ratio;
+} akvcam_m2m_context, *akvcam_m2m_context_t;
+
+static const struct v4l2_file_operations akvcam_m2m_fops;
+static const struct v4l2_ioctl_ops akvcam_m2m_ioctl_ops;
+static const struct v4l2_m2m_ops akvcam_m2m_ops;
+static const struct vb2_ops akvcam_m2m_queue_ops;
+
+__u32 akvcam_m2m_caps(akvcam_m2m_ct self);
+akvcam_m2m_context_t akvcam_m2m_context_from_file(struct file *file);
+akvcam_format_t akvcam_m2m_context_format(akvcam_m2m_context_t context,
+                                          enum v4l2_buf_type type);
+int akvcam_m2m_context_controls_updated(akvcam_m2m_context_t context,
+                                        __u32 id,
+                                        __s32 value);
+akvcam_frame_t akvcam_m2m_context_convert(akvcam_m2m_context_t context,
+                                          akvcam_frame_ct frame);
+bool akvcam_m2m_context_process(akvcam_m2m_context_t context,
+                                struct vb2_v4l2_buffer *src,
+                                struct vb2_v4l2_buffer *dst);
+void akvcam_m2m_context_work(struct work_struct *work);
+int akvcam_m2m_queue_init(void *priv,
+                          struct vb2_queue *src_vq,
+                          struct vb2_queue *dst_vq);
+void akvcam_m2m_fill_format(struct v4l2_format *format,
+                            akvcam_format_ct fmt);
+
+akvcam_m2m_t akvcam_m2m_new(const char *description,
+                            AKVCAM_RW_MODE rw_mode,
+                            akvcam_formats_list_t formats,
+                            akvcam_frame_filter_ct frame_filter)
+{
+    bool multiplanar;
+
+    akvcam_m2m_t self = kzalloc(sizeof(struct akvcam_m2m), GFP_KERNEL);
+    kref_init(&self->ref);
+    self->description = akvcam_strdup(description, AKVCAM_MEMORY_TYPE_KMALLOC);
+    self->formats = akvcam_list_new_copy(formats);
+    self->frame_filter = frame_filter;
+    self->rw_mode = rw_mode;
+    self->videonr = -1;
+    multiplanar = akvcam_format_have_multiplanar(formats);
+    self->output_type = multiplanar?
+                            V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE:
+                            V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    self->capture_type = multiplanar?
+                             V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE:
+                             V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    mutex_init(&self->device_mutex);
+    memset(&self->v4l2_dev, 0, sizeof(struct v4l2_device));
+    snprintf(self->v4l2_dev.name,
+             sizeof(self->v4l2_dev.name),
+             "akvcam-m2m-%u", (uint) akvcam_id());
+
+    /* Converting a batch of frames can take a while, use a queue of our own
+     * instead of stalling the system one.
+     */
+    self->workqueue = alloc_workqueue("%s",
+                                      WQ_UNBOUND,
+                                      0,
+                                      self->v4l2_dev.name);
+
+    return self;
+}
+
+static void akvcam_m2m_free(struct kref *ref)
+{
+    akvcam_m2m_t self = container_of(ref, struct akvcam_m2m, ref);
+
+    akvcam_m2m_unregister(self);
+
+    if (self->workqueue)
+        destroy_workqueue(self->workqueue);
+
+    akvcam_list_delete(self->formats);
+    kfree(self->description);
+    kfree(self);
+}
+
+void akvcam_m2m_delete(akvcam_m2m_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_m2m_free);
+}
+
+akvcam_m2m_t akvcam_m2m_ref(akvcam_m2m_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+bool akvcam_m2m_register(akvcam_m2m_t self)
+{
+    int result;
+
+    if (self->vdev)
+        return true;
+
+    if (!self->workqueue) {
+        akvcam_set_last_error(-ENOMEM);
+
+        return false;
+    }
+
+    result = v4l2_device_register(NULL, &self->v4l2_dev);
+
+    if (result == 0) {
+        self->m2m_dev = v4l2_m2m_init(&akvcam_m2m_ops);
+
+        if (IS_ERR(self->m2m_dev)) {
+            result = (int) PTR_ERR(self->m2m_dev);
+            self->m2m_dev = NULL;
+            v4l2_device_unregister(&self->v4l2_dev);
+        } else {
+            self->vdev = video_device_alloc();
+            snprintf(self->vdev->name, 32, "%s", "akvcam-m2m");
+            self->vdev->v4l2_dev = &self->v4l2_dev;
+            self->vdev->vfl_type = VFL_TYPE_VIDEO;
+            self->vdev->vfl_dir = VFL_DIR_M2M;
+            self->vdev->minor = -1;
+            self->vdev->fops = &akvcam_m2m_fops;
+            self->vdev->ioctl_ops = &akvcam_m2m_ioctl_ops;
+            self->vdev->release = video_device_release_empty;
+            self->vdev->lock = &self->device_mutex;
+            video_set_drvdata(self->vdev, self);
+            self->vdev->device_caps = akvcam_m2m_caps(self);
+            result = video_register_device(self->vdev,
+                                           VFL_TYPE_VIDEO,
+                                           self->videonr);
+
+            if (result) {
+                v4l2_m2m_release(self->m2m_dev);
+                self->m2m_dev = NULL;
+                v4l2_device_unregister(&self->v4l2_dev);
+                video_device_release(self->vdev);
+                self->vdev = NULL;
+            }
+        }
+    }
+
+    akvcam_set_last_error(result);
+
+    return self->vdev;
+}
+
+void akvcam_m2m_unregister(akvcam_m2m_t self)
+{
+    if (!self->vdev)
+        return;
+
+    video_unregister_device(self->vdev);
+    video_device_release(self->vdev);
+    self->vdev = NULL;
+    v4l2_m2m_release(self->m2m_dev);
+    self->m2m_dev = NULL;
+
+    v4l2_device_unregister(&self->v4l2_dev);
+}
+
+int32_t akvcam_m2m_num(akvcam_m2m_ct self)
+{
+    return self->vdev?
+                self->vdev->num:
+                self->videonr;
+}
+
+void akvcam_m2m_set_num(akvcam_m2m_t self, int32_t num)
+{
+    self->videonr = num;
+}
+
+bool akvcam_m2m_is_registered(akvcam_m2m_ct self)
+{
+    return self->vdev;
+}
+
+const char *akvcam_m2m_description(akvcam_m2m_ct self)
+{
+    return self->description;
+}
+
+akvcam_formats_list_t akvcam_m2m_formats(akvcam_m2m_ct self)
+{
+    return akvcam_list_new_copy(self->formats);
+}
+
+__u32 akvcam_m2m_caps(akvcam_m2m_ct self)
+{
+    __u32 caps = self->capture_type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE?
+                     V4L2_CAP_VIDEO_M2M_MPLANE:
+                     V4L2_CAP_VIDEO_M2M;
+
+    if (self->rw_mode & AKVCAM_RW_MODE_MMAP
+        || self->rw_mode & AKVCAM_RW_MODE_USERPTR
+        || self->rw_mode & AKVCAM_RW_MODE_DMABUF)
+        caps |= V4L2_CAP_STREAMING;
+
+    return caps | V4L2_CAP_EXT_PIX_FORMAT;
+}
+
+akvcam_m2m_context_t akvcam_m2m_context_from_file(struct file *file)
+{
+    return container_of(file->private_data, akvcam_m2m_context, fh);
+}
+
+akvcam_format_t akvcam_m2m_context_format(akvcam_m2m_context_t context,
+                                          enum v4l2_buf_type type)
+{
+    if (type == context->m2m->output_type)
+        return context->input_format;
+
+    if (type == context->m2m->capture_type)
+        return context->output_format;
+
+    return NULL;
+}
+
+int akvcam_m2m_context_controls_updated(akvcam_m2m_context_t context,
+                                        __u32 id,
+                                        __s32 value)
+{
+    switch (id) {
+    case V4L2_CID_BRIGHTNESS:
+        context->brightness = value;
+        break;
+
+    case V4L2_CID_CONTRAST:
+        context->contrast = value;
+        break;
+
+    case V4L2_CID_SATURATION:
+        context->saturation = value;
+        break;
+
+    case V4L2_CID_HUE:
+        context->hue = value;
+        break;
+
+    case V4L2_CID_GAMMA:
+        context->gamma = value;
+        break;
+
+    case V4L2_CID_HFLIP:
+        context->horizontal_flip = value;
+        break;
+
+    case V4L2_CID_VFLIP:
+        context->vertical_flip = value;
+        break;
+
+    case V4L2_CID_COLORFX:
+        context->gray = value == V4L2_COLORFX_BW;
+        break;
+
+    case AKVCAM_CID_SCALING:
+        context->scaling = value;
+        break;
+
+    case AKVCAM_CID_ASPECT_RATIO:
+        context->aspect_ratio = value;
+        break;
+
+    case AKVCAM_CID_SWAP_RGB:
+        context->swap_rgb = value;
+        break;
+
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+/* Same pipeline as the capture devices: adjustments that fit in a color
+ * matrix are folded into a single conversion, otherwise the frame goes
+ * through the ARGB filters between two conversions.
+ */
+akvcam_frame_t akvcam_m2m_context_convert(akvcam_m2m_context_t context,
+                                          akvcam_frame_ct frame)
+{
+    akvcam_rendition_controls controls;
+
+    memset(&controls, 0, sizeof(akvcam_rendition_controls));
+    controls.brightness = context->brightness;
+    controls.contrast = context->contrast;
+    controls.gamma = context->gamma;
+    controls.saturation = context->saturation;
+    controls.hue = context->hue;
+    controls.gray = context->gray;
+    controls.horizontal_flip = context->horizontal_flip;
+    controls.vertical_flip = context->vertical_flip;
+    controls.swap_rgb = context->swap_rgb;
+    controls.scaling = context->scaling;
+    controls.aspect_ratio = context->aspect_ratio;
+
+    return akvcam_frame_filter_render(context->m2m->frame_filter,
+                                      frame,
+                                      context->output_format,
+                                      &controls,
+                                      NULL,
+                                      context->in_video_converter,
+                                      context->out_video_converter,
+                                      NULL,
+                                      akvcam_m2m_num(context->m2m));
+}
+
+bool akvcam_m2m_context_process(akvcam_m2m_context_t context,
+                                struct vb2_v4l2_buffer *src,
+                                struct vb2_v4l2_buffer *dst)
+{
+    akvcam_frame_t iframe;
+    akvcam_frame_t oframe;
+    size_t i;
+
+    if (akvcam_buffers_begin_cpu_access(&src->vb2_buf, DMA_FROM_DEVICE))
+        return false;
+
+    iframe = akvcam_frame_new(context->input_format);
+
+    for (i = 0; i < src->vb2_buf.num_planes; i++) {
+        void *src_data = vb2_plane_vaddr(&src->vb2_buf, i);
+        void *dst_data = akvcam_frame_plane_data(iframe, i);
+        size_t payload = vb2_get_plane_payload(&src->vb2_buf, i);
+        size_t expected = akvcam_format_plane_size(context->input_format, i);
+        size_t copy_size = akvcam_min(payload, expected);
+
+        if (src_data && dst_data && copy_size > 0)
+            memcpy(dst_data, src_data, copy_size);
+    }
+
+    if (akvcam_buffers_end_cpu_access(&src->vb2_buf, DMA_FROM_DEVICE)) {
+        akvcam_frame_delete(iframe);
+
+        return false;
+    }
+
+    oframe = akvcam_m2m_context_convert(context, iframe);
+    akvcam_frame_delete(iframe);
+
+    if (!oframe)
+        return false;
+
+    if (akvcam_buffers_begin_cpu_access(&dst->vb2_buf, DMA_TO_DEVICE)) {
+        akvcam_frame_delete(oframe);
+
+        return false;
+    }
+
+    for (i = 0; i < dst->vb2_buf.num_planes; i++) {
+        void *dst_data = vb2_plane_vaddr(&dst->vb2_buf, i);
+        void *src_data = akvcam_frame_plane_data(oframe, i);
+        size_t frame_size = akvcam_format_plane_size(context->output_format, i);
+        size_t buf_size = vb2_plane_size(&dst->vb2_buf, i);
+        size_t copy_size = akvcam_min(frame_size, buf_size);
+
+        if (dst_data && src_data && copy_size > 0) {
+            memcpy(dst_data, src_data, copy_size);
+            vb2_set_plane_payload(&dst->vb2_buf, i, copy_size);
+        }
+    }
+
+    akvcam_frame_delete(oframe);
+
+    if (akvcam_buffers_end_cpu_access(&dst->vb2_buf, DMA_TO_DEVICE))
+        return false;
+
+    dst->vb2_buf.timestamp = src->vb2_buf.timestamp;
+    dst->timecode = src->timecode;
+    dst->flags &= ~(V4L2_BUF_FLAG_TSTAMP_SRC_MASK | V4L2_BUF_FLAG_TIMECODE);
+    dst->flags |= src->flags
+                  & (V4L2_BUF_FLAG_TSTAMP_SRC_MASK | V4L2_BUF_FLAG_TIMECODE);
+    dst->field = V4L2_FIELD_NONE;
+    src->sequence = context->sequence;
+    dst->sequence = context->sequence++;
+
+    return true;
+}
+
+/* The conversion is done out of the device_run callback, it's called with
+ * the queue lock held, and converting a batch of buffers can take a while.
+ */
+void akvcam_m2m_context_work(struct work_struct *work)
+{
+    akvcam_m2m_context_t context =
+            container_of(work, akvcam_m2m_context, work);
+    struct v4l2_m2m_ctx *m2m_ctx = context->fh.m2m_ctx;
+    size_t i;
+
+    for (i = 0; i < AKVCAM_M2M_BATCH_SIZE && !context->aborting; i++) {
+        struct vb2_v4l2_buffer *src;
+        struct vb2_v4l2_buffer *dst;
+        enum vb2_buffer_state state;
+
+        if (v4l2_m2m_num_src_bufs_ready(m2m_ctx) < 1
+            || v4l2_m2m_num_dst_bufs_ready(m2m_ctx) < 1)
+            break;
+
+        src = v4l2_m2m_src_buf_remove(m2m_ctx);
+        dst = v4l2_m2m_dst_buf_remove(m2m_ctx);
+        state = akvcam_m2m_context_process(context, src, dst)?
+                    VB2_BUF_STATE_DONE:
+                    VB2_BUF_STATE_ERROR;
+        v4l2_m2m_buf_done(src, state);
+        v4l2_m2m_buf_done(dst, state);
+    }
+
+    v4l2_m2m_job_finish(context->m2m->m2m_dev, m2m_ctx);
+}
+
+static void akvcam_m2m_device_run(void *priv)
+{
+    akvcam_m2m_context_t context = priv;
+
+    queue_work(context->m2m->workqueue, &context->work);
+}
+
+static void akvcam_m2m_job_abort(void *priv)
+{
+    akvcam_m2m_context_t context = priv;
+
+    context->aborting = true;
+}
+
+int akvcam_m2m_queue_init(void *priv,
+                          struct vb2_queue *src_vq,
+                          struct vb2_queue *dst_vq)
+{
+    akvcam_m2m_context_t context = priv;
+    enum vb2_io_modes io_modes = 0;
+    int result;
+
+    if (context->m2m->rw_mode & AKVCAM_RW_MODE_MMAP)
+        io_modes |= VB2_MMAP;
+
+    if (context->m2m->rw_mode & AKVCAM_RW_MODE_USERPTR)
+        io_modes |= VB2_USERPTR;
+
+    if (context->m2m->rw_mode & AKVCAM_RW_MODE_DMABUF)
+        io_modes |= VB2_DMABUF;
+
+    src_vq->type = context->m2m->output_type;
+    src_vq->io_modes = io_modes;
+    src_vq->drv_priv = context;
+    src_vq->buf_struct_size = sizeof(struct v4l2_m2m_buffer);
+    src_vq->ops = &akvcam_m2m_queue_ops;
+    src_vq->mem_ops = &vb2_vmalloc_memops;
+    src_vq->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
+    src_vq->lock = &context->m2m->device_mutex;
+    result = vb2_queue_init(src_vq);
+
+    if (result)
+        return result;
+
+    dst_vq->type = context->m2m->capture_type;
+    dst_vq->io_modes = io_modes;
+    dst_vq->drv_priv = context;
+    dst_vq->buf_struct_size = sizeof(struct v4l2_m2m_buffer);
+    dst_vq->ops = &akvcam_m2m_queue_ops;
+    dst_vq->mem_ops = &vb2_vmalloc_memops;
+    dst_vq->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
+    dst_vq->lock = &context->m2m->device_mutex;
+
+    return vb2_queue_init(dst_vq);
+}
+
+void akvcam_m2m_fill_format(struct v4l2_format *format,
+                            akvcam_format_ct fmt)
+{
+    memset(&format->fmt, 0, sizeof(format->fmt));
+
+    if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE
+        || format->type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        format->fmt.pix.width = (__u32) akvcam_format_width(fmt);
+        format->fmt.pix.height = (__u32) akvcam_format_height(fmt);
+        format->fmt.pix.pixelformat = akvcam_format_fourcc(fmt);
+        format->fmt.pix.field = V4L2_FIELD_NONE;
+        format->fmt.pix.bytesperline = (__u32) akvcam_format_line_size(fmt, 0);
+        format->fmt.pix.sizeimage = (__u32) akvcam_format_size(fmt);
+        format->fmt.pix.colorspace = DEFAULT_COLORSPACE;
+    } else {
+        size_t i;
+        size_t nplanes = akvcam_format_planes(fmt);
+
+        nplanes = akvcam_min(nplanes, MAX_PLANES);
+        format->fmt.pix_mp.width = (__u32) akvcam_format_width(fmt);
+        format->fmt.pix_mp.height = (__u32) akvcam_format_height(fmt);
+        format->fmt.pix_mp.pixelformat = akvcam_format_fourcc(fmt);
+        format->fmt.pix_mp.field = V4L2_FIELD_NONE;
+        format->fmt.pix_mp.colorspace = DEFAULT_COLORSPACE;
+        format->fmt.pix_mp.num_planes = (__u8) nplanes;
+
+        for (i = 0; i < format->fmt.pix_mp.num_planes; i++) {
+            format->fmt.pix_mp.plane_fmt[i].bytesperline =
+                    (__u32) akvcam_format_line_size(fmt, i);
+            format->fmt.pix_mp.plane_fmt[i].sizeimage =
+                    (__u32) akvcam_format_plane_size(fmt, i);
+        }
+    }
+}
+
+static int akvcam_m2m_open(struct file *file)
+{
+    akvcam_m2m_t self = video_drvdata(file);
+    akvcam_m2m_context_t context;
+    int result = 0;
+
+    akpr_function();
+
+    if (mutex_lock_interruptible(&self->device_mutex))
+        return -ERESTARTSYS;
+
+    context = kzalloc(sizeof(akvcam_m2m_context), GFP_KERNEL);
+
+    if (!context) {
+        mutex_unlock(&self->device_mutex);
+
+        return -ENOMEM;
+    }
+
+    context->m2m = akvcam_m2m_ref(self);
+    INIT_WORK(&context->work, akvcam_m2m_context_work);
+    context->input_format =
+            akvcam_format_new_copy(akvcam_list_front(self->formats));
+    context->output_format =
+            akvcam_format_new_copy(akvcam_list_front(self->formats));
+    context->in_video_converter = akvcam_converter_new();
+    context->out_video_converter = akvcam_converter_new();
+    akvcam_converter_set_device_num(context->in_video_converter,
+                                    self->vdev->num);
+    akvcam_converter_set_device_num(context->out_video_converter,
+                                    self->vdev->num);
+    context->controls = akvcam_controls_new(AKVCAM_DEVICE_TYPE_M2M);
+    akvcam_connect(controls,
+                   context->controls,
+                   updated,
+                   context,
+                   akvcam_m2m_context_controls_updated);
+
+    v4l2_fh_init(&context->fh, video_devdata(file));
+    context->fh.ctrl_handler = akvcam_controls_handler(context->controls);
+    context->fh.m2m_ctx = v4l2_m2m_ctx_init(self->m2m_dev,
+                                            context,
+                                            akvcam_m2m_queue_init);
+
+    if (IS_ERR(context->fh.m2m_ctx)) {
+        result = (int) PTR_ERR(context->fh.m2m_ctx);
+        v4l2_fh_exit(&context->fh);
+        akvcam_controls_delete(context->controls);
+        akvcam_converter_delete(context->out_video_converter);
+        akvcam_converter_delete(context->in_video_converter);
+        akvcam_format_delete(context->output_format);
+        akvcam_format_delete(context->input_format);
+        akvcam_m2m_delete(context->m2m);
+        kfree(context);
+    } else {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 18, 0)
+        file->private_data = &context->fh;
+        v4l2_fh_add(&context->fh);
+#else
+        v4l2_fh_add(&context->fh, file);
+#endif
+    }
+
+    mutex_unlock(&self->device_mutex);
+
+    return result;
+}
+
+static int akvcam_m2m_release(struct file *file)
+{
+    akvcam_m2m_context_t context = akvcam_m2m_context_from_file(file);
+    akvcam_m2m_t self = context->m2m;
+
+    akpr_function();
+
+    mutex_lock(&self->device_mutex);
+    v4l2_m2m_ctx_release(context->fh.m2m_ctx);
+    mutex_unlock(&self->device_mutex);
+    cancel_work_sync(&context->work);
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 18, 0)
+    v4l2_fh_del(&context->fh);
+#else
+    v4l2_fh_del(&context->fh, file);
+#endif
+    v4l2_fh_exit(&context->fh);
+    akvcam_controls_delete(context->controls);
+    akvcam_converter_delete(context->out_video_converter);
+    akvcam_converter_delete(context->in_video_converter);
+    akvcam_format_delete(context->output_format);
+    akvcam_format_delete(context->input_format);
+    kfree(context);
+    akvcam_m2m_delete(self);
+
+    return 0;
+}
+
+static int akvcam_m2m_queue_setup(struct vb2_queue *queue,
+                                  unsigned int *num_buffers,
+                                  unsigned int *num_planes,
+                                  unsigned int sizes[],
+                                  struct device *alloc_devs[])
+{
+    akvcam_m2m_context_t context = vb2_get_drv_priv(queue);
+    akvcam_format_t format = akvcam_m2m_context_format(context, queue->type);
+    size_t i;
+    UNUSED(alloc_devs);
+
+    akpr_function();
+
+    if (!format)
+        return -EINVAL;
+
+    if (*num_buffers < 1)
+        *num_buffers = 1;
+
+    if (*num_planes > 0) {
+        if (*num_planes < akvcam_format_planes(format))
+            return -EINVAL;
+
+        for (i = 0; i < *num_planes; i++)
+            if (sizes[i] < akvcam_format_plane_size(format, i))
+                return -EINVAL;
+
+        return 0;
+    }
+
+    *num_planes = akvcam_min(akvcam_format_planes(format), MAX_PLANES);
+
+    for (i = 0; i < *num_planes; i++)
+        sizes[i] = akvcam_format_plane_size(format, i);
+
+    return 0;
+}
+
+static int akvcam_m2m_buffer_prepare(struct vb2_buffer *buffer)
+{
+    akvcam_m2m_context_t context = vb2_get_drv_priv(buffer->vb2_queue);
+    struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(buffer);
+    akvcam_format_t format =
+            akvcam_m2m_context_format(context, buffer->vb2_queue->type);
+    size_t i;
+
+    akpr_function();
+
+    for (i = 0; i < buffer->num_planes; i++) {
+        size_t plane_size = akvcam_format_plane_size(format, i);
+
+        if (vb2_plane_size(buffer, i) < plane_size)
+            return -EINVAL;
+
+        // The producer may send a shorter payload, keep it for OUTPUT.
+        if (!V4L2_TYPE_IS_OUTPUT(buffer->vb2_queue->type))
+            vb2_set_plane_payload(buffer, i, plane_size);
+    }
+
+    if (vbuf->field == V4L2_FIELD_ANY)
+        vbuf->field = V4L2_FIELD_NONE;
+
+    return 0;
+}
+
+static void akvcam_m2m_buffer_queue(struct vb2_buffer *buffer)
+{
+    akvcam_m2m_context_t context = vb2_get_drv_priv(buffer->vb2_queue);
+
+    akpr_function();
+    v4l2_m2m_buf_queue(context->fh.m2m_ctx, to_vb2_v4l2_buffer(buffer));
+}
+
+static int akvcam_m2m_start_streaming(struct vb2_queue *queue,
+                                      unsigned int count)
+{
+    akvcam_m2m_context_t context = vb2_get_drv_priv(queue);
+    UNUSED(count);
+
+    akpr_function();
+
+    if (V4L2_TYPE_IS_OUTPUT(queue->type))
+        context->sequence = 0;
+
+    context->aborting = false;
+
+    return 0;
+}
+
+static void akvcam_m2m_stop_streaming(struct vb2_queue *queue)
+{
+    akvcam_m2m_context_t context = vb2_get_drv_priv(queue);
+    struct vb2_v4l2_buffer *vbuf;
+
+    akpr_function();
+
+    for (;;) {
+        vbuf = V4L2_TYPE_IS_OUTPUT(queue->type)?
+                   v4l2_m2m_src_buf_remove(context->fh.m2m_ctx):
+                   v4l2_m2m_dst_buf_remove(context->fh.m2m_ctx);
+
+        if (!vbuf)
+            break;
+
+        v4l2_m2m_buf_done(vbuf, VB2_BUF_STATE_ERROR);
+    }
+}
+
+static int akvcam_m2m_querycap(struct file *file,
+                               void *fh,
+                               struct v4l2_capability *capability)
+{
+    akvcam_m2m_t self = video_drvdata(file);
+    __u32 caps;
+    UNUSED(fh);
+
+    akpr_function();
+
+    memset(capability, 0, sizeof(struct v4l2_capability));
+    snprintf((char *) capability->driver, 16, "%s", akvcam_driver_name());
+    snprintf((char *) capability->card, 32, "%s", self->description);
+    snprintf((char *) capability->bus_info,
+             32, "platform:akvcam-m2m-%d", akvcam_m2m_num(self));
+    capability->version = akvcam_driver_version();
+
+    caps = akvcam_m2m_caps(self);
+    capability->capabilities = caps | V4L2_CAP_DEVICE_CAPS;
+    capability->device_caps = caps;
+
+    return 0;
+}
+
+static int akvcam_m2m_enum_fmt(struct file *file,
+                               void *fh,
+                               struct v4l2_fmtdesc *format)
+{
+    akvcam_m2m_t self = video_drvdata(file);
+    akvcam_pixel_formats_list_t pixel_formats;
+    __u32 *fourcc;
+    UNUSED(fh);
+
+    akpr_function();
+
+    if (format->type != self->output_type
+        && format->type != self->capture_type)
+        return -EINVAL;
+
+    pixel_formats = akvcam_format_pixel_formats(self->formats);
+    fourcc = akvcam_list_at(pixel_formats, format->index);
+
+    if (fourcc) {
+        format->flags = 0;
+        format->pixelformat = *fourcc;
+        snprintf((char *) format->description,
+                 32, "%s", akvcam_string_from_fourcc(*fourcc));
+        akvcam_init_reserved(format);
+    }
+
+    akvcam_list_delete(pixel_formats);
+
+    return fourcc? 0: -EINVAL;
+}
+
+static int akvcam_m2m_g_fmt(struct file *file,
+                            void *fh,
+                            struct v4l2_format *format)
+{
+    akvcam_m2m_context_t context = akvcam_m2m_context_from_file(file);
+    akvcam_format_t current_format =
+            akvcam_m2m_context_format(context, format->type);
+    UNUSED(fh);
+
+    akpr_function();
+
+    if (!current_format)
+        return -EINVAL;
+
+    akvcam_m2m_fill_format(format, current_format);
+
+    return 0;
+}
+
+static int akvcam_m2m_try_fmt(struct file *file,
+                              void *fh,
+                              struct v4l2_format *format)
+{
+    akvcam_m2m_context_t context = akvcam_m2m_context_from_file(file);
+    akvcam_format_t nearest_format;
+    akvcam_format_t temp_format;
+    struct v4l2_fract frame_rate = {0, 0};
+    UNUSED(fh);
+
+    akpr_function();
+
+    if (!akvcam_m2m_context_format(context, format->type))
+        return -EINVAL;
+
+    if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE
+        || format->type == V4L2_BUF_TYPE_VIDEO_OUTPUT)
+        temp_format = akvcam_format_new(format->fmt.pix.pixelformat,
+                                        format->fmt.pix.width,
+                                        format->fmt.pix.height,
+                                        &frame_rate);
+    else
+        temp_format = akvcam_format_new(format->fmt.pix_mp.pixelformat,
+                                        format->fmt.pix_mp.width,
+                                        format->fmt.pix_mp.height,
+                                        &frame_rate);
+
+    nearest_format = akvcam_format_nearest(context->m2m->formats, temp_format);
+    akvcam_format_delete(temp_format);
+
+    if (!nearest_format)
+        return -EINVAL;
+
+    akvcam_m2m_fill_format(format, nearest_format);
+
+    return 0;
+}
+
+static int akvcam_m2m_s_fmt(struct file *file,
+                            void *fh,
+                            struct v4l2_format *format)
+{
+    akvcam_m2m_context_t context = akvcam_m2m_context_from_file(file);
+    akvcam_format_t current_format;
+    struct vb2_queue *queue;
+    struct v4l2_fract frame_rate = {0, 0};
+    akvcam_format_t new_format;
+    int result;
+
+    akpr_function();
+
+    queue = v4l2_m2m_get_vq(context->fh.m2m_ctx, format->type);
+
+    if (!queue)
+        return -EINVAL;
+
+    if (vb2_is_busy(queue))
+        return -EBUSY;
+
+    result = akvcam_m2m_try_fmt(file, fh, format);
+
+    if (result)
+        return result;
+
+    current_format = akvcam_m2m_context_format(context, format->type);
+
+    if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE
+        || format->type == V4L2_BUF_TYPE_VIDEO_OUTPUT)
+        new_format = akvcam_format_new(format->fmt.pix.pixelformat,
+                                       format->fmt.pix.width,
+                                       format->fmt.pix.height,
+                                       &frame_rate);
+    else
+        new_format = akvcam_format_new(format->fmt.pix_mp.pixelformat,
+                                       format->fmt.pix_mp.width,
+                                       format->fmt.pix_mp.height,
+                                       &frame_rate);
+
+    akvcam_format_copy(current_format, new_format);
+    akvcam_format_delete(new_format);
+
+    return 0;
+}
+
+static int akvcam_m2m_enum_framesizes(struct file *file,
+                                      void *fh,
+                                      struct v4l2_frmsizeenum *frame_sizes)
+{
+    akvcam_m2m_t self = video_drvdata(file);
+    akvcam_resolutions_list_t resolutions;
+    struct v4l2_frmsize_discrete *resolution;
+    UNUSED(fh);
+
+    akpr_function();
+
+    resolutions = akvcam_format_resolutions(self->formats,
+                                            frame_sizes->pixel_format);
+    resolution = akvcam_list_at(resolutions, frame_sizes->index);
+
+    if (resolution) {
+        frame_sizes->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+        frame_sizes->discrete.width = resolution->width;
+        frame_sizes->discrete.height = resolution->height;
+        akvcam_init_reserved(frame_sizes);
+    }
+
+    akvcam_list_delete(resolutions);
+
+    return resolution? 0: -EINVAL;
+}
+
+static const struct v4l2_file_operations akvcam_m2m_fops = {
+    .owner          = THIS_MODULE       ,
+    .open           = akvcam_m2m_open   ,
+    .release        = akvcam_m2m_release,
+    .unlocked_ioctl = video_ioctl2      ,
+    .mmap           = v4l2_m2m_fop_mmap ,
+    .poll           = v4l2_m2m_fop_poll ,
+};
+
+static const struct v4l2_ioctl_ops akvcam_m2m_ioctl_ops = {
+    .vidioc_querycap               = akvcam_m2m_querycap        ,
+    .vidioc_enum_fmt_vid_cap       = akvcam_m2m_enum_fmt        ,
+    .vidioc_enum_fmt_vid_out       = akvcam_m2m_enum_fmt        ,
+    .vidioc_g_fmt_vid_cap          = akvcam_m2m_g_fmt           ,
+    .vidioc_g_fmt_vid_out          = akvcam_m2m_g_fmt           ,
+    .vidioc_g_fmt_vid_cap_mplane   = akvcam_m2m_g_fmt           ,
+    .vidioc_g_fmt_vid_out_mplane   = akvcam_m2m_g_fmt           ,
+    .vidioc_s_fmt_vid_cap          = akvcam_m2m_s_fmt           ,
+    .vidioc_s_fmt_vid_out          = akvcam_m2m_s_fmt           ,
+    .vidioc_s_fmt_vid_cap_mplane   = akvcam_m2m_s_fmt           ,
+    .vidioc_s_fmt_vid_out_mplane   = akvcam_m2m_s_fmt           ,
+    .vidioc_try_fmt_vid_cap        = akvcam_m2m_try_fmt         ,
+    .vidioc_try_fmt_vid_out        = akvcam_m2m_try_fmt         ,
+    .vidioc_try_fmt_vid_cap_mplane = akvcam_m2m_try_fmt         ,
+    .vidioc_try_fmt_vid_out_mplane = akvcam_m2m_try_fmt         ,
+    .vidioc_reqbufs                = v4l2_m2m_ioctl_reqbufs     ,
+    .vidioc_querybuf               = v4l2_m2m_ioctl_querybuf    ,
+    .vidioc_qbuf                   = v4l2_m2m_ioctl_qbuf        ,
+    .vidioc_expbuf                 = v4l2_m2m_ioctl_expbuf      ,
+    .vidioc_dqbuf                  = v4l2_m2m_ioctl_dqbuf       ,
+    .vidioc_create_bufs            = v4l2_m2m_ioctl_create_bufs ,
+    .vidioc_prepare_buf            = v4l2_m2m_ioctl_prepare_buf ,
+    .vidioc_streamon               = v4l2_m2m_ioctl_streamon    ,
+    .vidioc_streamoff              = v4l2_m2m_ioctl_streamoff   ,
+    .vidioc_log_status             = v4l2_ctrl_log_status       ,
+    .vidioc_enum_framesizes        = akvcam_m2m_enum_framesizes ,
+    .vidioc_subscribe_event        = v4l2_ctrl_subscribe_event  ,
+    .vidioc_unsubscribe_event      = v4l2_event_unsubscribe     ,
+};
+
+static const struct v4l2_m2m_ops akvcam_m2m_ops = {
+    .device_run = akvcam_m2m_device_run,
+    .job_abort  = akvcam_m2m_job_abort ,
+};
+
+static const struct vb2_ops akvcam_m2m_queue_ops = {
+    .queue_setup     = akvcam_m2m_queue_setup    ,
+    .buf_prepare     = akvcam_m2m_buffer_prepare ,
+    .buf_queue       = akvcam_m2m_buffer_queue   ,
+    .start_streaming = akvcam_m2m_start_streaming,
+    .stop_streaming  = akvcam_m2m_stop_streaming ,
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(7, 0, 0)
+    .wait_prepare    = vb2_ops_wait_prepare,
+    .wait_finish     = vb2_ops_wait_finish,
+#endif
+};
@@ -0,0 +1,46 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_M2M_H
+#define AKVCAM_M2M_H
+
+#include <linux/types.h>
+
+#include "m2m_types.h"
+#include "device_types.h"
+#include "format_types.h"
+#include "frame_filter_types.h"
+
+// public
+akvcam_m2m_t akvcam_m2m_new(const char *description,
+                            AKVCAM_RW_MODE rw_mode,
+                            akvcam_formats_list_t formats,
+                            akvcam_frame_filter_ct frame_filter);
+void akvcam_m2m_delete(akvcam_m2m_t self);
+akvcam_m2m_t akvcam_m2m_ref(akvcam_m2m_t self);
+
+bool akvcam_m2m_register(akvcam_m2m_t self);
+void akvcam_m2m_unregister(akvcam_m2m_t self);
+int32_t akvcam_m2m_num(akvcam_m2m_ct self);
+void akvcam_m2m_set_num(akvcam_m2m_t self, int32_t num);
+bool akvcam_m2m_is_registered(akvcam_m2m_ct self);
+const char *akvcam_m2m_description(akvcam_m2m_ct self);
+akvcam_formats_list_t akvcam_m2m_formats(akvcam_m2m_ct self);
+
+#endif // AKVCAM_M2M_H
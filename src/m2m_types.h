@@ -0,0 +1,31 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_M2M_TYPES_H
+#define AKVCAM_M2M_TYPES_H
+
+#include "list_types.h"
+
+struct akvcam_m2m;
+typedef struct akvcam_m2m *akvcam_m2m_t;
+typedef const struct akvcam_m2m *akvcam_m2m_ct;
+typedef akvcam_list_tt(akvcam_m2m_t) akvcam_m2ms_list_t;
+typedef akvcam_list_ctt(akvcam_m2m_t) akvcam_m2ms_list_ct;
+
+#endif // AKVCAM_M2M_TYPES_H
@@ -19,6 +19,7 @@
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/version.h>
 
 #include "driver.h"
 #include "log.h"
@@ -28,9 +29,51 @@
 #define AKVCAM_DRIVER_DESCRIPTION "AkVCam Virtual Camera"
 
 static int loglevel = LOGLEVEL_EMERG;
-module_param(loglevel, int, S_IRUGO | S_IWUSR);
+static unsigned int debug_categories = AKVCAM_LOG_CATEGORY_ALL;
+
+static int akvcam_set_loglevel(const char *value,
+                               const struct kernel_param *param)
+{
+    int result = param_set_int(value, param);
+
+    if (!result)
+        akvcam_log_set_level(loglevel);
+
+    return result;
+}
+
+static int akvcam_set_debug_categories(const char *value,
+                                       const struct kernel_param *param)
+{
+    int result = param_set_uint(value, param);
+
+    if (!result)
+        akvcam_log_set_categories(debug_categories);
+
+    return result;
+}
+
+static const struct kernel_param_ops akvcam_loglevel_ops = {
+    .set = akvcam_set_loglevel,
+    .get = param_get_int,
+};
+
+static const struct kernel_param_ops akvcam_debug_categories_ops = {
+    .set = akvcam_set_debug_categories,
+    .get = param_get_uint,
+};
+
+module_param_cb(loglevel, &akvcam_loglevel_ops, &loglevel, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(loglevel, "Debug verbosity (-2 to 7)");
 
+module_param_cb(debug_categories,
+                &akvcam_debug_categories_ops,
+                &debug_categories,
+                S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(debug_categories,
+                 "Debug messages to print: 0x01 driver, 0x02 device, "
+                 "0x04 buffers, 0x08 ioctl, 0x10 frame (default: 0x1f)");
+
 static char config_file[4096] = "/etc/akvcam/config.ini";
 module_param_string(config_file, config_file, 4096, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(config_file, "Full path to virtual cameras config file");
@@ -55,3 +98,10 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Gonzalo Exequiel Pedone");
 MODULE_DESCRIPTION(AKVCAM_DRIVER_DESCRIPTION);
 MODULE_VERSION("1.4.0");
+
+// Needed for syncing the imported dma-bufs.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+MODULE_IMPORT_NS("DMA_BUF");
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+MODULE_IMPORT_NS(DMA_BUF);
+#endif
@@ -0,0 +1,381 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/videodev2.h>
+#include <linux/vmalloc.h>
+
+#include "overlay.h"
+#include "converter.h"
+#include "format.h"
+#include "format_specs.h"
+#include "frame.h"
+#include "log.h"
+#include "utils.h"
+
+#define AKVCAM_OVERLAY_ALPHA_LEVELS 256
+
+/* The overlay is drawn over the frames while they are copied to the capture
+ * buffers.
+ * The image is converted once for each capture format, and stored already
+ * multiplied by its alpha, along with the inverse of the alpha of each byte,
+ * so blending is a table lookup and an addition per byte. Only the bounding
+ * box of the visible pixels of the image is ever blended.
+ */
+struct akvcam_overlay
+{
+    struct kref ref;
+    akvcam_frame_t image;
+    size_t left;
+    size_t top;
+    size_t x;
+    size_t y;
+    akvcam_converter_t converter;
+    akvcam_format_t format;
+    akvcam_frame_t premultiplied;
+    akvcam_frame_t inverse_alpha;
+    uint8_t *multiply;
+    bool blendable;
+    struct mutex mutex;
+};
+
+bool akvcam_overlay_crop(akvcam_overlay_t self, akvcam_frame_ct image);
+void akvcam_overlay_update(akvcam_overlay_t self, akvcam_format_ct format);
+bool akvcam_overlay_can_blend(akvcam_format_specs_ct specs);
+
+akvcam_overlay_t akvcam_overlay_new(void)
+{
+    akvcam_overlay_t self = kzalloc(sizeof(struct akvcam_overlay), GFP_KERNEL);
+    size_t alpha;
+    size_t value;
+
+    kref_init(&self->ref);
+    self->converter = akvcam_converter_new();
+    self->format = akvcam_format_new(0, 0, 0, NULL);
+    self->multiply = vmalloc(AKVCAM_OVERLAY_ALPHA_LEVELS * 256);
+
+    /* Rounded down, so adding the overlay and the blended frame never
+     * overflows a byte.
+     */
+    for (alpha = 0; alpha < AKVCAM_OVERLAY_ALPHA_LEVELS; alpha++)
+        for (value = 0; value < 256; value++)
+            self->multiply[(alpha << 8) | value] = (uint8_t) (alpha * value / 255);
+
+    mutex_init(&self->mutex);
+
+    return self;
+}
+
+static void akvcam_overlay_free(struct kref *ref)
+{
+    akvcam_overlay_t self = container_of(ref, struct akvcam_overlay, ref);
+    akvcam_frame_delete(self->inverse_alpha);
+    akvcam_frame_delete(self->premultiplied);
+    akvcam_frame_delete(self->image);
+    akvcam_format_delete(self->format);
+    akvcam_converter_delete(self->converter);
+    vfree(self->multiply);
+    kfree(self);
+}
+
+void akvcam_overlay_delete(akvcam_overlay_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_overlay_free);
+}
+
+akvcam_overlay_t akvcam_overlay_ref(akvcam_overlay_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+bool akvcam_overlay_load(akvcam_overlay_t self, const char *file_name)
+{
+    akvcam_frame_t image = akvcam_frame_new(NULL);
+    bool loaded;
+
+    mutex_lock(&self->mutex);
+    loaded = akvcam_frame_load(image, file_name)
+             && akvcam_overlay_crop(self, image);
+
+    // Convert it again on the next frame.
+    akvcam_format_delete(self->format);
+    self->format = akvcam_format_new(0, 0, 0, NULL);
+    mutex_unlock(&self->mutex);
+    akvcam_frame_delete(image);
+
+    return loaded;
+}
+
+bool akvcam_overlay_is_empty(akvcam_overlay_ct self)
+{
+    return self->image == NULL;
+}
+
+void akvcam_overlay_set_position(akvcam_overlay_t self, size_t x, size_t y)
+{
+    mutex_lock(&self->mutex);
+
+    // Keep the overlay aligned to the chroma subsampling.
+    self->x = x & ~1;
+    self->y = y & ~1;
+    mutex_unlock(&self->mutex);
+}
+
+void akvcam_overlay_blend(akvcam_overlay_t self,
+                          akvcam_format_ct format,
+                          size_t plane,
+                          uint8_t *data)
+{
+    akvcam_format_specs_ct specs;
+    size_t frame_width = akvcam_format_width(format);
+    size_t frame_height = akvcam_format_height(format);
+    size_t x;
+    size_t y;
+
+    if (!self->image || !data)
+        return;
+
+    mutex_lock(&self->mutex);
+
+    if (!akvcam_format_is_same_format(self->format, format))
+        akvcam_overlay_update(self, format);
+
+    x = self->x + self->left;
+    y = self->y + self->top;
+
+    if (self->blendable
+        && plane < akvcam_format_planes(format)
+        && x < frame_width
+        && y < frame_height) {
+        akvcam_format_ct overlay_format =
+                akvcam_frame_format_nr(self->premultiplied);
+        size_t width = akvcam_min(akvcam_format_width(overlay_format),
+                                  frame_width - x);
+        size_t height = akvcam_min(akvcam_format_height(overlay_format),
+                                   frame_height - y);
+        size_t bits_size;
+        size_t width_div = akvcam_format_width_div(format, plane);
+        size_t height_div = akvcam_format_height_div(format, plane);
+        size_t line_size = akvcam_format_line_size(format, plane);
+        size_t line_bytes;
+        size_t lines = height >> height_div;
+        uint8_t *line;
+        size_t i;
+        size_t j;
+
+        specs = akvcam_format_specs_from_fixel_format(akvcam_format_fourcc(format));
+        bits_size = specs->planes[plane].bits_size;
+        line_bytes = bits_size * (width >> width_div) / 8;
+        line = data
+               + (y >> height_div) * line_size
+               + bits_size * (x >> width_div) / 8;
+
+        for (j = 0; j < lines; j++) {
+            const uint8_t *color =
+                    akvcam_frame_const_line(self->premultiplied,
+                                            plane,
+                                            j << height_div);
+            const uint8_t *inverse_alpha =
+                    akvcam_frame_const_line(self->inverse_alpha,
+                                            plane,
+                                            j << height_div);
+
+            for (i = 0; i < line_bytes; i++)
+                line[i] = color[i]
+                          + self->multiply[(inverse_alpha[i] << 8) | line[i]];
+
+            line += line_size;
+        }
+    }
+
+    mutex_unlock(&self->mutex);
+}
+
+/* Keep only the bounding box of the visible pixels of the image, aligned to
+ * the chroma subsampling.
+ */
+bool akvcam_overlay_crop(akvcam_overlay_t self, akvcam_frame_ct image)
+{
+    akvcam_format_ct image_format = akvcam_frame_format_nr(image);
+    struct v4l2_fract frame_rate = akvcam_format_frame_rate(image_format);
+    size_t width = akvcam_format_width(image_format);
+    size_t height = akvcam_format_height(image_format);
+    size_t left = width;
+    size_t top = height;
+    size_t right = 0;
+    size_t bottom = 0;
+    akvcam_format_t format;
+    size_t x;
+    size_t y;
+
+    for (y = 0; y < height; y++) {
+        const uint8_t *line = akvcam_frame_const_line(image, 0, y);
+
+        for (x = 0; x < width; x++)
+            if (line[4 * x]) {
+                left = akvcam_min(left, x);
+                top = akvcam_min(top, y);
+                right = akvcam_max(right, x + 1);
+                bottom = akvcam_max(bottom, y + 1);
+            }
+    }
+
+    if (left >= right || top >= bottom) {
+        akpr_err("The overlay is fully transparent\n");
+
+        return false;
+    }
+
+    left &= ~(size_t) 1;
+    top &= ~(size_t) 1;
+    right = akvcam_min(akvcam_align_up(right, (size_t) 2), width);
+    bottom = akvcam_min(akvcam_align_up(bottom, (size_t) 2), height);
+
+    format = akvcam_format_new(V4L2_PIX_FMT_ARGB32,
+                               right - left,
+                               bottom - top,
+                               &frame_rate);
+    akvcam_frame_delete(self->image);
+    self->image = akvcam_frame_new(format);
+    akvcam_format_delete(format);
+    self->left = left;
+    self->top = top;
+
+    for (y = top; y < bottom; y++)
+        memcpy(akvcam_frame_line(self->image, 0, y - top),
+               akvcam_frame_const_line(image, 0, y) + 4 * left,
+               4 * (right - left));
+
+    return true;
+}
+
+void akvcam_overlay_update(akvcam_overlay_t self, akvcam_format_ct format)
+{
+    akvcam_format_specs_ct specs =
+            akvcam_format_specs_from_fixel_format(akvcam_format_fourcc(format));
+    akvcam_format_ct image_format = akvcam_frame_format_nr(self->image);
+    struct v4l2_fract frame_rate = akvcam_format_frame_rate(format);
+    size_t width = akvcam_format_width(image_format);
+    size_t height = akvcam_format_height(image_format);
+    akvcam_format_t overlay_format;
+    akvcam_frame_t opaque;
+    size_t plane;
+    size_t x;
+    size_t y;
+
+    akvcam_format_copy(self->format, format);
+    akvcam_frame_delete(self->premultiplied);
+    self->premultiplied = NULL;
+    akvcam_frame_delete(self->inverse_alpha);
+    self->inverse_alpha = NULL;
+    self->blendable = false;
+
+    if (!specs || !akvcam_overlay_can_blend(specs))
+        return;
+
+    // The alpha is applied after the conversion, convert only the colors.
+    opaque = akvcam_frame_new_copy(self->image);
+
+    for (y = 0; y < height; y++) {
+        uint8_t *line = akvcam_frame_line(opaque, 0, y);
+
+        for (x = 0; x < width; x++)
+            line[4 * x] = 0xff;
+    }
+
+    overlay_format = akvcam_format_new(akvcam_format_fourcc(format),
+                                       width,
+                                       height,
+                                       &frame_rate);
+    akvcam_converter_set_output_format(self->converter, overlay_format);
+    akvcam_converter_begin(self->converter);
+    self->premultiplied = akvcam_converter_convert(self->converter, opaque);
+    akvcam_converter_end(self->converter);
+    akvcam_frame_delete(opaque);
+
+    if (!self->premultiplied) {
+        akvcam_format_delete(overlay_format);
+
+        return;
+    }
+
+    self->inverse_alpha = akvcam_frame_new(overlay_format);
+    akvcam_format_delete(overlay_format);
+
+    /* Each byte takes the alpha of the pixel it belongs to, the subsampled
+     * components take the alpha of the first pixel of the block.
+     */
+    for (plane = 0; plane < specs->nplanes; plane++) {
+        size_t bits_size = specs->planes[plane].bits_size;
+        size_t width_div = akvcam_format_width_div(format, plane);
+        size_t height_div = akvcam_format_height_div(format, plane);
+        size_t line_bytes = bits_size * (width >> width_div) / 8;
+        size_t lines = height >> height_div;
+        size_t i;
+        size_t j;
+
+        for (j = 0; j < lines; j++) {
+            const uint8_t *alpha_line =
+                    akvcam_frame_const_line(self->image, 0, j << height_div);
+            uint8_t *color =
+                    akvcam_frame_line(self->premultiplied, plane, j << height_div);
+            uint8_t *inverse_alpha =
+                    akvcam_frame_line(self->inverse_alpha, plane, j << height_div);
+
+            for (i = 0; i < line_bytes; i++) {
+                size_t pixel = akvcam_min((8 * i / bits_size) << width_div,
+                                          width - 1);
+                uint8_t alpha = alpha_line[4 * pixel];
+
+                color[i] = self->multiply[(alpha << 8) | color[i]];
+                inverse_alpha[i] = 255 - alpha;
+            }
+        }
+    }
+
+    self->blendable = true;
+}
+
+// Only formats made of byte aligned 8 bits components are blended by byte.
+bool akvcam_overlay_can_blend(akvcam_format_specs_ct specs)
+{
+    size_t plane;
+    size_t i;
+
+    if (specs->type == AKVCAM_VIDEO_FORMAT_TYPE_UNKNOWN
+        || specs->type == AKVCAM_VIDEO_FORMAT_TYPE_COMPRESSED)
+        return false;
+
+    for (plane = 0; plane < specs->nplanes; plane++)
+        for (i = 0; i < specs->planes[plane].ncomponents; i++) {
+            akvcam_color_component_ct component =
+                    specs->planes[plane].components + i;
+
+            if (component->depth != 8 || component->shift != 0)
+                return false;
+        }
+
+    return true;
+}
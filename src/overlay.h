@@ -0,0 +1,41 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_OVERLAY_H
+#define AKVCAM_OVERLAY_H
+
+#include <linux/types.h>
+
+#include "overlay_types.h"
+#include "format_types.h"
+
+// public
+akvcam_overlay_t akvcam_overlay_new(void);
+void akvcam_overlay_delete(akvcam_overlay_t self);
+akvcam_overlay_t akvcam_overlay_ref(akvcam_overlay_t self);
+
+bool akvcam_overlay_load(akvcam_overlay_t self, const char *file_name);
+bool akvcam_overlay_is_empty(akvcam_overlay_ct self);
+void akvcam_overlay_set_position(akvcam_overlay_t self, size_t x, size_t y);
+void akvcam_overlay_blend(akvcam_overlay_t self,
+                          akvcam_format_ct format,
+                          size_t plane,
+                          uint8_t *data);
+
+#endif // AKVCAM_OVERLAY_H
@@ -0,0 +1,249 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <linux/kref.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+
+#include "rate_converter.h"
+#include "format.h"
+#include "format_specs.h"
+#include "frame.h"
+
+typedef struct
+{
+    AKVCAM_RATE_CONVERSION mode;
+    char str[32];
+} akvcam_rate_conversion_strings;
+
+static const akvcam_rate_conversion_strings akvcam_rate_conversion_strs[] = {
+    {AKVCAM_RATE_CONVERSION_NONE , "none" },
+    {AKVCAM_RATE_CONVERSION_PHASE, "phase"},
+    {AKVCAM_RATE_CONVERSION_BLEND, "blend"},
+};
+
+/* Converts the frame rate of the output device to the frame rate of a
+ * capture device. For each input frame the output phase advances by
+ * output_fps / input_fps, an output frame is emitted every time the phase
+ * crosses a whole output period, so frames are dropped or repeated at
+ * fixed positions instead of depending on the timing of the threads.
+ */
+struct akvcam_rate_converter
+{
+    struct kref ref;
+    akvcam_frame_t previous;
+    struct v4l2_fract input_rate;
+    struct v4l2_fract output_rate;
+    uint64_t step;
+    uint64_t period;
+    uint64_t phase;
+    AKVCAM_RATE_CONVERSION mode;
+};
+
+akvcam_frame_t akvcam_rate_converter_blend(akvcam_frame_ct previous,
+                                           akvcam_frame_ct frame,
+                                           uint32_t weight);
+bool akvcam_rate_converter_can_blend(akvcam_frame_ct previous,
+                                     akvcam_frame_ct frame);
+
+akvcam_rate_converter_t akvcam_rate_converter_new(void)
+{
+    akvcam_rate_converter_t self =
+            kzalloc(sizeof(struct akvcam_rate_converter), GFP_KERNEL);
+    kref_init(&self->ref);
+    self->mode = AKVCAM_RATE_CONVERSION_NONE;
+
+    return self;
+}
+
+static void akvcam_rate_converter_free(struct kref *ref)
+{
+    akvcam_rate_converter_t self =
+            container_of(ref, struct akvcam_rate_converter, ref);
+    akvcam_frame_delete(self->previous);
+    kfree(self);
+}
+
+void akvcam_rate_converter_delete(akvcam_rate_converter_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_rate_converter_free);
+}
+
+akvcam_rate_converter_t akvcam_rate_converter_ref(akvcam_rate_converter_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+AKVCAM_RATE_CONVERSION akvcam_rate_converter_mode(akvcam_rate_converter_ct self)
+{
+    return self->mode;
+}
+
+void akvcam_rate_converter_set_mode(akvcam_rate_converter_t self,
+                                    AKVCAM_RATE_CONVERSION mode)
+{
+    if (self->mode == mode)
+        return;
+
+    self->mode = mode;
+    akvcam_rate_converter_reset(self);
+}
+
+void akvcam_rate_converter_set_rates(akvcam_rate_converter_t self,
+                                     struct v4l2_fract input_rate,
+                                     struct v4l2_fract output_rate)
+{
+    if (self->input_rate.numerator == input_rate.numerator
+        && self->input_rate.denominator == input_rate.denominator
+        && self->output_rate.numerator == output_rate.numerator
+        && self->output_rate.denominator == output_rate.denominator)
+        return;
+
+    self->input_rate = input_rate;
+    self->output_rate = output_rate;
+    self->step = (uint64_t) output_rate.numerator * input_rate.denominator;
+    self->period = (uint64_t) output_rate.denominator * input_rate.numerator;
+    akvcam_rate_converter_reset(self);
+}
+
+size_t akvcam_rate_converter_convert(akvcam_rate_converter_t self,
+                                     akvcam_frame_t frame,
+                                     akvcam_frame_t *frames)
+{
+    size_t n = 0;
+    uint64_t position;
+    bool blend;
+
+    if (self->mode == AKVCAM_RATE_CONVERSION_NONE
+        || self->step < 1
+        || self->period < 1) {
+        frames[0] = akvcam_frame_ref(frame);
+
+        return 1;
+    }
+
+    blend = self->mode == AKVCAM_RATE_CONVERSION_BLEND
+            && akvcam_rate_converter_can_blend(self->previous, frame);
+
+    /* Output frames fall between the previous and the current input frame,
+     * 'position' is the distance from the previous frame in phase units.
+     */
+    for (position = self->period - self->phase;
+         position <= self->step && n < AKVCAM_RATE_CONVERTER_MAX_FRAMES;
+         position += self->period) {
+        uint32_t weight = (uint32_t) div64_u64(position << 8, self->step);
+
+        if (blend && weight < 256)
+            frames[n] = akvcam_rate_converter_blend(self->previous,
+                                                    frame,
+                                                    weight);
+        else
+            frames[n] = akvcam_frame_ref(frame);
+
+        n++;
+    }
+
+    div64_u64_rem(self->phase + self->step, self->period, &self->phase);
+
+    if (self->mode == AKVCAM_RATE_CONVERSION_BLEND) {
+        akvcam_frame_delete(self->previous);
+        self->previous = akvcam_frame_ref(frame);
+    }
+
+    return n;
+}
+
+void akvcam_rate_converter_reset(akvcam_rate_converter_t self)
+{
+    akvcam_frame_delete(self->previous);
+    self->previous = NULL;
+    self->phase = 0;
+}
+
+AKVCAM_RATE_CONVERSION akvcam_rate_converter_mode_from_string(const char *str)
+{
+    size_t i;
+
+    if (str)
+        for (i = 0; i < ARRAY_SIZE(akvcam_rate_conversion_strs); i++)
+            if (strcmp(akvcam_rate_conversion_strs[i].str, str) == 0)
+                return akvcam_rate_conversion_strs[i].mode;
+
+    return AKVCAM_RATE_CONVERSION_NONE;
+}
+
+akvcam_frame_t akvcam_rate_converter_blend(akvcam_frame_ct previous,
+                                           akvcam_frame_ct frame,
+                                           uint32_t weight)
+{
+    akvcam_frame_t blended = akvcam_frame_new(akvcam_frame_format_nr(frame));
+    const uint8_t *src0 = (const uint8_t *) akvcam_frame_const_data(previous);
+    const uint8_t *src1 = (const uint8_t *) akvcam_frame_const_data(frame);
+    uint8_t *dst = (uint8_t *) akvcam_frame_data(blended);
+    size_t size = akvcam_frame_size(blended);
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        dst[i] = (uint8_t) ((src0[i] * (256 - weight) + src1[i] * weight) >> 8);
+
+    akvcam_frame_copy_metadata(blended, frame);
+
+    return blended;
+}
+
+bool akvcam_rate_converter_can_blend(akvcam_frame_ct previous,
+                                     akvcam_frame_ct frame)
+{
+    akvcam_format_t format;
+    akvcam_format_specs_ct specs;
+    size_t i;
+    size_t j;
+
+    if (!previous || !frame)
+        return false;
+
+    format = akvcam_frame_format_nr(frame);
+
+    if (!akvcam_format_is_same_format(akvcam_frame_format_nr(previous), format)
+        || akvcam_frame_size(previous) != akvcam_frame_size(frame))
+        return false;
+
+    specs = akvcam_format_specs_from_fixel_format(akvcam_format_fourcc(format));
+
+    if (!specs || akvcam_format_specs_is_compressed(specs))
+        return false;
+
+    /* Blending byte by byte only works if every component is stored in its
+     * own byte.
+     */
+    for (j = 0; j < specs->nplanes; j++)
+        for (i = 0; i < specs->planes[j].ncomponents; i++) {
+            akvcam_color_component_ct component =
+                    specs->planes[j].components + i;
+
+            if (component->depth != 8 || component->shift > 0)
+                return false;
+        }
+
+    return true;
+}
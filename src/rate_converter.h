@@ -0,0 +1,50 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_RATE_CONVERTER_H
+#define AKVCAM_RATE_CONVERTER_H
+
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+#include "rate_converter_types.h"
+#include "frame_types.h"
+
+#define AKVCAM_RATE_CONVERTER_MAX_FRAMES 8
+
+// public
+akvcam_rate_converter_t akvcam_rate_converter_new(void);
+void akvcam_rate_converter_delete(akvcam_rate_converter_t self);
+akvcam_rate_converter_t akvcam_rate_converter_ref(akvcam_rate_converter_t self);
+
+AKVCAM_RATE_CONVERSION akvcam_rate_converter_mode(akvcam_rate_converter_ct self);
+void akvcam_rate_converter_set_mode(akvcam_rate_converter_t self,
+                                    AKVCAM_RATE_CONVERSION mode);
+void akvcam_rate_converter_set_rates(akvcam_rate_converter_t self,
+                                     struct v4l2_fract input_rate,
+                                     struct v4l2_fract output_rate);
+size_t akvcam_rate_converter_convert(akvcam_rate_converter_t self,
+                                     akvcam_frame_t frame,
+                                     akvcam_frame_t *frames);
+void akvcam_rate_converter_reset(akvcam_rate_converter_t self);
+
+// public static
+AKVCAM_RATE_CONVERSION akvcam_rate_converter_mode_from_string(const char *str);
+
+#endif // AKVCAM_RATE_CONVERTER_H
@@ -0,0 +1,240 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+
+#include "rendition_cache.h"
+#include "format.h"
+#include "frame.h"
+#include "list.h"
+
+// Renditions not requested for this number of source frames are dropped.
+#define AKVCAM_RENDITION_MAX_AGE 64
+
+typedef struct
+{
+    struct kref ref;
+    struct mutex mutex;
+    akvcam_format_t format;
+    akvcam_rendition_controls controls;
+    uint64_t sequence;
+    akvcam_frame_t frame;
+} akvcam_rendition, *akvcam_rendition_t;
+
+typedef const akvcam_rendition *akvcam_rendition_ct;
+
+struct akvcam_rendition_cache
+{
+    struct kref ref;
+    struct mutex mutex;
+    akvcam_list_tt(akvcam_rendition_t) renditions;
+};
+
+akvcam_rendition_t akvcam_rendition_new(akvcam_format_ct format,
+                                        akvcam_rendition_controls_ct controls,
+                                        uint64_t sequence);
+void akvcam_rendition_delete(akvcam_rendition_t self);
+akvcam_rendition_t akvcam_rendition_ref(akvcam_rendition_t self);
+akvcam_rendition_t akvcam_rendition_cache_find(akvcam_rendition_cache_t self,
+                                               akvcam_format_ct format,
+                                               akvcam_rendition_controls_ct controls,
+                                               uint64_t sequence);
+
+akvcam_rendition_cache_t akvcam_rendition_cache_new(void)
+{
+    akvcam_rendition_cache_t self =
+            kzalloc(sizeof(struct akvcam_rendition_cache), GFP_KERNEL);
+    kref_init(&self->ref);
+    mutex_init(&self->mutex);
+    self->renditions = akvcam_list_new();
+
+    return self;
+}
+
+static void akvcam_rendition_cache_free(struct kref *ref)
+{
+    akvcam_rendition_cache_t self =
+            container_of(ref, struct akvcam_rendition_cache, ref);
+    akvcam_list_delete(self->renditions);
+    kfree(self);
+}
+
+void akvcam_rendition_cache_delete(akvcam_rendition_cache_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_rendition_cache_free);
+}
+
+akvcam_rendition_cache_t akvcam_rendition_cache_ref(akvcam_rendition_cache_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+akvcam_frame_t akvcam_rendition_cache_frame(akvcam_rendition_cache_t self,
+                                            akvcam_format_ct format,
+                                            akvcam_rendition_controls_ct controls,
+                                            uint64_t sequence,
+                                            akvcam_frame_ct frame,
+                                            akvcam_rendition_render_t render,
+                                            void *user_data)
+{
+    akvcam_rendition_t rendition;
+    akvcam_frame_t rendered;
+
+    rendition = akvcam_rendition_cache_find(self, format, controls, sequence);
+
+    if (!rendition)
+        return render(user_data, frame);
+
+    /* Devices asking for the same rendition wait here until the first one
+     * finish rendering it, and then they just take a reference to the frame.
+     */
+    if (mutex_lock_interruptible(&rendition->mutex)) {
+        akvcam_rendition_delete(rendition);
+
+        return render(user_data, frame);
+    }
+
+    if (!rendition->frame || rendition->sequence != sequence) {
+        akvcam_frame_delete(rendition->frame);
+        rendition->frame = render(user_data, frame);
+        rendition->sequence = sequence;
+    }
+
+    rendered = akvcam_frame_ref(rendition->frame);
+    mutex_unlock(&rendition->mutex);
+    akvcam_rendition_delete(rendition);
+
+    return rendered;
+}
+
+void akvcam_rendition_cache_clear(akvcam_rendition_cache_t self)
+{
+    mutex_lock(&self->mutex);
+    akvcam_list_clear(self->renditions);
+    mutex_unlock(&self->mutex);
+}
+
+akvcam_rendition_t akvcam_rendition_new(akvcam_format_ct format,
+                                        akvcam_rendition_controls_ct controls,
+                                        uint64_t sequence)
+{
+    akvcam_rendition_t self = kzalloc(sizeof(akvcam_rendition), GFP_KERNEL);
+    kref_init(&self->ref);
+    mutex_init(&self->mutex);
+    self->format = akvcam_format_new_copy(format);
+    self->controls = *controls;
+    self->sequence = sequence;
+    self->frame = NULL;
+
+    return self;
+}
+
+static void akvcam_rendition_free(struct kref *ref)
+{
+    akvcam_rendition_t self = container_of(ref, akvcam_rendition, ref);
+    akvcam_frame_delete(self->frame);
+    akvcam_format_delete(self->format);
+    kfree(self);
+}
+
+void akvcam_rendition_delete(akvcam_rendition_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_rendition_free);
+}
+
+akvcam_rendition_t akvcam_rendition_ref(akvcam_rendition_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+bool akvcam_rendition_controls_equals(akvcam_rendition_controls_ct controls,
+                                      akvcam_rendition_controls_ct other)
+{
+    return controls->brightness == other->brightness
+           && controls->contrast == other->contrast
+           && controls->gamma == other->gamma
+           && controls->saturation == other->saturation
+           && controls->hue == other->hue
+           && controls->gray == other->gray
+           && controls->horizontal_flip == other->horizontal_flip
+           && controls->vertical_flip == other->vertical_flip
+           && controls->swap_rgb == other->swap_rgb
+           && controls->scaling == other->scaling
+           && controls->aspect_ratio == other->aspect_ratio
+           && controls->crop.left == other->crop.left
+           && controls->crop.top == other->crop.top
+           && controls->crop.width == other->crop.width
+           && controls->crop.height == other->crop.height;
+}
+
+/* Returns a reference to the rendition matching the format and the controls,
+ * creating it if it doesn't exists yet. Renditions that nobody asked for
+ * recently are removed from the cache.
+ */
+akvcam_rendition_t akvcam_rendition_cache_find(akvcam_rendition_cache_t self,
+                                               akvcam_format_ct format,
+                                               akvcam_rendition_controls_ct controls,
+                                               uint64_t sequence)
+{
+    akvcam_rendition_t rendition = NULL;
+    akvcam_list_element_t it = NULL;
+    akvcam_rendition_t element;
+
+    if (mutex_lock_interruptible(&self->mutex))
+        return NULL;
+
+    element = akvcam_list_next(self->renditions, &it);
+
+    while (it) {
+        akvcam_list_element_t next = it;
+        akvcam_rendition_t next_element =
+                akvcam_list_next(self->renditions, &next);
+
+        if (akvcam_format_is_same_format(element->format, format)
+            && akvcam_rendition_controls_equals(&element->controls, controls)
+            && !rendition)
+            rendition = akvcam_rendition_ref(element);
+        else if (element->sequence + AKVCAM_RENDITION_MAX_AGE < sequence)
+            akvcam_list_erase(self->renditions, it);
+
+        it = next;
+        element = next_element;
+    }
+
+    if (!rendition) {
+        rendition = akvcam_rendition_new(format, controls, sequence);
+        akvcam_list_push_back(self->renditions,
+                              rendition,
+                              (akvcam_copy_t) akvcam_rendition_ref,
+                              (akvcam_delete_t) akvcam_rendition_delete);
+    }
+
+    mutex_unlock(&self->mutex);
+
+    return rendition;
+}
@@ -0,0 +1,46 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef AKVCAM_RENDITION_CACHE_H
+#define AKVCAM_RENDITION_CACHE_H
+
+#include <linux/types.h>
+
+#include "rendition_cache_types.h"
+#include "format_types.h"
+#include "frame_types.h"
+
+// public
+akvcam_rendition_cache_t akvcam_rendition_cache_new(void);
+void akvcam_rendition_cache_delete(akvcam_rendition_cache_t self);
+akvcam_rendition_cache_t akvcam_rendition_cache_ref(akvcam_rendition_cache_t self);
+
+akvcam_frame_t akvcam_rendition_cache_frame(akvcam_rendition_cache_t self,
+                                            akvcam_format_ct format,
+                                            akvcam_rendition_controls_ct controls,
+                                            uint64_t sequence,
+                                            akvcam_frame_ct frame,
+                                            akvcam_rendition_render_t render,
+                                            void *user_data);
+void akvcam_rendition_cache_clear(akvcam_rendition_cache_t self);
+
+// public static
+bool akvcam_rendition_controls_equals(akvcam_rendition_controls_ct controls,
+                                      akvcam_rendition_controls_ct other);
+
+#endif // AKVCAM_RENDITION_CACHE_H
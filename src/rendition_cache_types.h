@@ -0,0 +1,55 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef AKVCAM_RENDITION_CACHE_TYPES_H
+#define AKVCAM_RENDITION_CACHE_TYPES_H
+
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+#include "converter_types.h"
+#include "frame_types.h"
+
+struct akvcam_rendition_cache;
+typedef struct akvcam_rendition_cache *akvcam_rendition_cache_t;
+typedef const struct akvcam_rendition_cache *akvcam_rendition_cache_ct;
+
+// Controls that affect how a frame is rendered into the capture format.
+typedef struct
+{
+    int brightness;
+    int contrast;
+    int gamma;
+    int saturation;
+    int hue;
+    bool gray;
+    bool horizontal_flip;
+    bool vertical_flip;
+    bool swap_rgb;
+    AKVCAM_SCALING_MODE scaling;
+    AKVCAM_ASPECT_RATIO_MODE aspect_ratio;
+    struct v4l2_rect crop;
+} akvcam_rendition_controls;
+
+typedef akvcam_rendition_controls *akvcam_rendition_controls_t;
+typedef const akvcam_rendition_controls *akvcam_rendition_controls_ct;
+
+typedef akvcam_frame_t (*akvcam_rendition_render_t)(void *user_data,
+                                                    akvcam_frame_ct frame);
+
+#endif // AKVCAM_RENDITION_CACHE_TYPES_H
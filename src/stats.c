@@ -0,0 +1,381 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/kref.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#include "stats.h"
+#include "utils.h"
+
+/* Latencies are accumulated in power of two buckets, bucket n counts the
+ * samples in the [2^(n-1), 2^n) ns range, the last one counts everything
+ * above it.
+ */
+#define AKVCAM_STATS_BUCKETS 40
+
+/* The producer to consumer latency needs a finer resolution for reporting
+ * percentiles, each power of two range is split in 8 linear sub-buckets,
+ * which gives a relative error below 12.5%.
+ */
+#define AKVCAM_STATS_LATENCY_SUB_BITS    3
+#define AKVCAM_STATS_LATENCY_SUB_BUCKETS (1 << AKVCAM_STATS_LATENCY_SUB_BITS)
+#define AKVCAM_STATS_LATENCY_BUCKETS \
+    ((AKVCAM_STATS_BUCKETS - AKVCAM_STATS_LATENCY_SUB_BITS + 1) \
+     * AKVCAM_STATS_LATENCY_SUB_BUCKETS)
+
+typedef struct
+{
+    atomic64_t count;
+    atomic64_t total;
+    atomic64_t max;
+    atomic64_t buckets[AKVCAM_STATS_BUCKETS];
+} akvcam_stats_histogram, *akvcam_stats_histogram_t;
+
+struct akvcam_stats
+{
+    struct kref ref;
+    atomic64_t counters[AKVCAM_STATS_COUNTER_COUNT];
+    akvcam_stats_histogram histograms[AKVCAM_STATS_STAGE_COUNT];
+    atomic64_t latency_count;
+    atomic64_t latency_max;
+    atomic64_t latency[AKVCAM_STATS_LATENCY_BUCKETS];
+    struct dentry *debugfs;
+};
+
+static const char *akvcam_stats_counter_names[] = {
+    "frames_received",
+    "frames_delivered",
+    "frames_dropped",
+    "default_frames",
+    "errors",
+};
+
+static const char *akvcam_stats_stage_names[] = {
+    "read",
+    "convert",
+    "filter",
+    "write",
+    "tick",
+};
+
+static struct dentry *akvcam_stats_debugfs_root = NULL;
+
+void akvcam_stats_update_max(atomic64_t *max, uint64_t value);
+size_t akvcam_stats_latency_bucket(uint64_t value);
+uint64_t akvcam_stats_latency_bucket_max(size_t bucket);
+
+int akvcam_stats_debugfs_show(struct seq_file *file, void *data);
+int akvcam_stats_debugfs_open(struct inode *inode, struct file *file);
+ssize_t akvcam_stats_debugfs_reset(struct file *file,
+                                   const char __user *buffer,
+                                   size_t size,
+                                   loff_t *offset);
+
+static const struct file_operations akvcam_stats_debugfs_fops = {
+    .owner   = THIS_MODULE                ,
+    .open    = akvcam_stats_debugfs_open  ,
+    .read    = seq_read                   ,
+    .llseek  = seq_lseek                  ,
+    .release = single_release             ,
+};
+
+static const struct file_operations akvcam_stats_debugfs_reset_fops = {
+    .owner   = THIS_MODULE                ,
+    .open    = simple_open                ,
+    .write   = akvcam_stats_debugfs_reset ,
+};
+
+akvcam_stats_t akvcam_stats_new(void)
+{
+    akvcam_stats_t self = kzalloc(sizeof(struct akvcam_stats), GFP_KERNEL);
+    kref_init(&self->ref);
+
+    return self;
+}
+
+static void akvcam_stats_free(struct kref *ref)
+{
+    akvcam_stats_t self = container_of(ref, struct akvcam_stats, ref);
+    kfree(self);
+}
+
+void akvcam_stats_delete(akvcam_stats_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_stats_free);
+}
+
+akvcam_stats_t akvcam_stats_ref(akvcam_stats_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+void akvcam_stats_count(akvcam_stats_t self, AKVCAM_STATS_COUNTER counter)
+{
+    atomic64_inc(self->counters + counter);
+}
+
+void akvcam_stats_record(akvcam_stats_t self,
+                         AKVCAM_STATS_STAGE stage,
+                         uint64_t time_ns)
+{
+    akvcam_stats_histogram_t histogram = self->histograms + stage;
+    int bucket = min(fls64(time_ns), AKVCAM_STATS_BUCKETS - 1);
+
+    atomic64_inc(&histogram->count);
+    atomic64_add((s64) time_ns, &histogram->total);
+    atomic64_inc(histogram->buckets + bucket);
+    akvcam_stats_update_max(&histogram->max, time_ns);
+}
+
+void akvcam_stats_record_latency(akvcam_stats_t self, uint64_t latency_ns)
+{
+    atomic64_inc(&self->latency_count);
+    atomic64_inc(self->latency + akvcam_stats_latency_bucket(latency_ns));
+    akvcam_stats_update_max(&self->latency_max, latency_ns);
+}
+
+// Returns the upper bound of the bucket containing the given percentile.
+uint64_t akvcam_stats_latency_percentile(akvcam_stats_t self,
+                                         unsigned int percentile)
+{
+    u64 count = (u64) atomic64_read(&self->latency_count);
+    u64 max = (u64) atomic64_read(&self->latency_max);
+    u64 rank;
+    u64 samples = 0;
+    size_t i;
+
+    if (count < 1)
+        return 0;
+
+    rank = max_t(u64, div64_u64(count * percentile + 99, 100), 1);
+
+    for (i = 0; i < AKVCAM_STATS_LATENCY_BUCKETS; i++) {
+        samples += (u64) atomic64_read(self->latency + i);
+
+        if (samples >= rank)
+            return min(akvcam_stats_latency_bucket_max(i), max);
+    }
+
+    return max;
+}
+
+void akvcam_stats_reset(akvcam_stats_t self)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < AKVCAM_STATS_COUNTER_COUNT; i++)
+        atomic64_set(self->counters + i, 0);
+
+    for (i = 0; i < AKVCAM_STATS_STAGE_COUNT; i++) {
+        akvcam_stats_histogram_t histogram = self->histograms + i;
+
+        atomic64_set(&histogram->count, 0);
+        atomic64_set(&histogram->total, 0);
+        atomic64_set(&histogram->max, 0);
+
+        for (j = 0; j < AKVCAM_STATS_BUCKETS; j++)
+            atomic64_set(histogram->buckets + j, 0);
+    }
+
+    atomic64_set(&self->latency_count, 0);
+    atomic64_set(&self->latency_max, 0);
+
+    for (i = 0; i < AKVCAM_STATS_LATENCY_BUCKETS; i++)
+        atomic64_set(self->latency + i, 0);
+}
+
+size_t akvcam_stats_print(akvcam_stats_t self, char *buffer, size_t size)
+{
+    size_t n = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < AKVCAM_STATS_COUNTER_COUNT; i++)
+        n += scnprintf(buffer + n,
+                       size - n,
+                       "%s: %lld\n",
+                       akvcam_stats_counter_names[i],
+                       (long long) atomic64_read(self->counters + i));
+
+    for (i = 0; i < AKVCAM_STATS_STAGE_COUNT; i++) {
+        akvcam_stats_histogram_t histogram = self->histograms + i;
+        u64 count = (u64) atomic64_read(&histogram->count);
+        u64 total = (u64) atomic64_read(&histogram->total);
+
+        n += scnprintf(buffer + n,
+                       size - n,
+                       "%s_ns: count=%llu avg=%llu max=%lld",
+                       akvcam_stats_stage_names[i],
+                       count,
+                       count? div64_u64(total, count): 0,
+                       (long long) atomic64_read(&histogram->max));
+
+        // Only the non empty buckets, as upper bound:samples.
+        for (j = 0; j < AKVCAM_STATS_BUCKETS; j++) {
+            s64 samples = atomic64_read(histogram->buckets + j);
+
+            if (samples > 0)
+                n += scnprintf(buffer + n,
+                               size - n,
+                               " %llu:%lld",
+                               1ULL << j,
+                               (long long) samples);
+        }
+
+        n += scnprintf(buffer + n, size - n, "\n");
+    }
+
+    n += scnprintf(buffer + n,
+                   size - n,
+                   "latency_ns: count=%lld p50=%llu p99=%llu max=%lld\n",
+                   (long long) atomic64_read(&self->latency_count),
+                   akvcam_stats_latency_percentile(self, 50),
+                   akvcam_stats_latency_percentile(self, 99),
+                   (long long) atomic64_read(&self->latency_max));
+
+    return n;
+}
+
+void akvcam_stats_debugfs_add(akvcam_stats_t self, int num)
+{
+    char name[32];
+
+    if (!akvcam_stats_debugfs_root || self->debugfs)
+        return;
+
+    snprintf(name, 32, "video%d", num);
+    self->debugfs = debugfs_create_dir(name, akvcam_stats_debugfs_root);
+    debugfs_create_file("stats",
+                        S_IRUGO,
+                        self->debugfs,
+                        self,
+                        &akvcam_stats_debugfs_fops);
+    debugfs_create_file("reset",
+                        S_IWUSR,
+                        self->debugfs,
+                        self,
+                        &akvcam_stats_debugfs_reset_fops);
+}
+
+void akvcam_stats_debugfs_remove(akvcam_stats_t self)
+{
+    debugfs_remove_recursive(self->debugfs);
+    self->debugfs = NULL;
+}
+
+void akvcam_stats_debugfs_init(void)
+{
+    akvcam_stats_debugfs_root = debugfs_create_dir("akvcam", NULL);
+}
+
+void akvcam_stats_debugfs_uninit(void)
+{
+    debugfs_remove_recursive(akvcam_stats_debugfs_root);
+    akvcam_stats_debugfs_root = NULL;
+}
+
+void akvcam_stats_update_max(atomic64_t *max, uint64_t value)
+{
+    s64 current_max = atomic64_read(max);
+
+    while ((s64) value > current_max) {
+        s64 old = atomic64_cmpxchg(max, current_max, (s64) value);
+
+        if (old == current_max)
+            break;
+
+        current_max = old;
+    }
+}
+
+size_t akvcam_stats_latency_bucket(uint64_t value)
+{
+    int exponent;
+    size_t bucket;
+
+    if (value < AKVCAM_STATS_LATENCY_SUB_BUCKETS)
+        return (size_t) value;
+
+    exponent = fls64(value) - 1;
+    bucket = (size_t) (exponent - AKVCAM_STATS_LATENCY_SUB_BITS + 1)
+             * AKVCAM_STATS_LATENCY_SUB_BUCKETS
+             + ((value >> (exponent - AKVCAM_STATS_LATENCY_SUB_BITS))
+                & (AKVCAM_STATS_LATENCY_SUB_BUCKETS - 1));
+
+    return min_t(size_t, bucket, AKVCAM_STATS_LATENCY_BUCKETS - 1);
+}
+
+uint64_t akvcam_stats_latency_bucket_max(size_t bucket)
+{
+    size_t range = bucket / AKVCAM_STATS_LATENCY_SUB_BUCKETS;
+    uint64_t sub = bucket % AKVCAM_STATS_LATENCY_SUB_BUCKETS;
+    int shift;
+
+    if (range < 1)
+        return sub;
+
+    shift = (int) range - 1;
+
+    return ((AKVCAM_STATS_LATENCY_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+int akvcam_stats_debugfs_show(struct seq_file *file, void *data)
+{
+    char *buffer = kzalloc(PAGE_SIZE, GFP_KERNEL);
+
+    UNUSED(data);
+
+    if (!buffer)
+        return -ENOMEM;
+
+    akvcam_stats_print(file->private, buffer, PAGE_SIZE);
+    seq_puts(file, buffer);
+    kfree(buffer);
+
+    return 0;
+}
+
+int akvcam_stats_debugfs_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, akvcam_stats_debugfs_show, inode->i_private);
+}
+
+ssize_t akvcam_stats_debugfs_reset(struct file *file,
+                                   const char __user *buffer,
+                                   size_t size,
+                                   loff_t *offset)
+{
+    UNUSED(buffer);
+    UNUSED(offset);
+    akvcam_stats_reset(file->private_data);
+
+    return (ssize_t) size;
+}
@@ -0,0 +1,48 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_STATS_H
+#define AKVCAM_STATS_H
+
+#include <linux/types.h>
+
+#include "stats_types.h"
+
+// public
+akvcam_stats_t akvcam_stats_new(void);
+void akvcam_stats_delete(akvcam_stats_t self);
+akvcam_stats_t akvcam_stats_ref(akvcam_stats_t self);
+
+void akvcam_stats_count(akvcam_stats_t self, AKVCAM_STATS_COUNTER counter);
+void akvcam_stats_record(akvcam_stats_t self,
+                         AKVCAM_STATS_STAGE stage,
+                         uint64_t time_ns);
+void akvcam_stats_record_latency(akvcam_stats_t self, uint64_t latency_ns);
+uint64_t akvcam_stats_latency_percentile(akvcam_stats_t self,
+                                         unsigned int percentile);
+void akvcam_stats_reset(akvcam_stats_t self);
+size_t akvcam_stats_print(akvcam_stats_t self, char *buffer, size_t size);
+void akvcam_stats_debugfs_add(akvcam_stats_t self, int num);
+void akvcam_stats_debugfs_remove(akvcam_stats_t self);
+
+// public static
+void akvcam_stats_debugfs_init(void);
+void akvcam_stats_debugfs_uninit(void);
+
+#endif // AKVCAM_STATS_H
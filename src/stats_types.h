@@ -0,0 +1,47 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_STATS_TYPES_H
+#define AKVCAM_STATS_TYPES_H
+
+typedef enum
+{
+    AKVCAM_STATS_COUNTER_FRAMES_RECEIVED,
+    AKVCAM_STATS_COUNTER_FRAMES_DELIVERED,
+    AKVCAM_STATS_COUNTER_FRAMES_DROPPED,
+    AKVCAM_STATS_COUNTER_DEFAULT_FRAMES,
+    AKVCAM_STATS_COUNTER_ERRORS,
+    AKVCAM_STATS_COUNTER_COUNT
+} AKVCAM_STATS_COUNTER;
+
+typedef enum
+{
+    AKVCAM_STATS_STAGE_READ,
+    AKVCAM_STATS_STAGE_CONVERT,
+    AKVCAM_STATS_STAGE_FILTER,
+    AKVCAM_STATS_STAGE_WRITE,
+    AKVCAM_STATS_STAGE_TICK,
+    AKVCAM_STATS_STAGE_COUNT
+} AKVCAM_STATS_STAGE;
+
+struct akvcam_stats;
+typedef struct akvcam_stats *akvcam_stats_t;
+typedef const struct akvcam_stats *akvcam_stats_ct;
+
+#endif // AKVCAM_STATS_TYPES_H
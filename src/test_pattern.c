@@ -0,0 +1,419 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <linux/kref.h>
+#include <linux/slab.h>
+#include <linux/videodev2.h>
+
+#include "test_pattern.h"
+#include "converter.h"
+#include "format.h"
+#include "frame.h"
+
+#define AKVCAM_TEST_PATTERN_SEED 0x9e3779b97f4a7c15ULL
+
+typedef struct
+{
+    AKVCAM_TEST_PATTERN pattern;
+    char str[32];
+} akvcam_test_pattern_strings, *akvcam_test_pattern_strings_t;
+
+static const akvcam_test_pattern_strings akvcam_test_pattern_strs[] = {
+    {AKVCAM_TEST_PATTERN_NOISE     , "noise"   },
+    {AKVCAM_TEST_PATTERN_BARS      , "bars"    },
+    {AKVCAM_TEST_PATTERN_GRADIENT  , "gradient"},
+    {AKVCAM_TEST_PATTERN_MOVING_BOX, "box"     },
+    {AKVCAM_TEST_PATTERN_COUNTER   , "counter" },
+};
+
+// Colour bars, from left to right, in ARGB.
+static const uint32_t akvcam_test_pattern_bars[] = {
+    0xffc0c0c0,
+    0xffc0c000,
+    0xff00c0c0,
+    0xff00c000,
+    0xffc000c0,
+    0xffc00000,
+    0xff0000c0,
+    0xff000000,
+};
+
+// 3x5 digits, the most significant bit of each row is the leftmost pixel.
+static const uint8_t akvcam_test_pattern_digits[10][5] = {
+    {7, 5, 5, 5, 7},
+    {2, 6, 2, 2, 7},
+    {7, 1, 7, 4, 7},
+    {7, 1, 7, 1, 7},
+    {5, 5, 7, 1, 1},
+    {7, 4, 7, 1, 7},
+    {7, 4, 7, 5, 7},
+    {7, 1, 1, 1, 1},
+    {7, 5, 7, 5, 7},
+    {7, 5, 7, 1, 7},
+};
+
+struct akvcam_test_pattern
+{
+    struct kref ref;
+    AKVCAM_TEST_PATTERN pattern;
+    akvcam_converter_t converter;
+    akvcam_format_t format;
+    akvcam_frame_t background;
+    akvcam_frame_t frame;
+    uint64_t frame_number;
+    uint64_t seed;
+};
+
+void akvcam_test_pattern_reset(akvcam_test_pattern_t self);
+akvcam_frame_t akvcam_test_pattern_render_background(akvcam_test_pattern_ct self);
+void akvcam_test_pattern_fill_rect(akvcam_frame_t frame,
+                                   int x,
+                                   int y,
+                                   int width,
+                                   int height,
+                                   uint32_t color);
+void akvcam_test_pattern_draw_box(akvcam_test_pattern_ct self,
+                                  akvcam_frame_t frame);
+void akvcam_test_pattern_draw_counter(akvcam_test_pattern_ct self,
+                                      akvcam_frame_t frame);
+void akvcam_test_pattern_fill_noise(akvcam_test_pattern_t self,
+                                    akvcam_frame_t frame);
+
+akvcam_test_pattern_t akvcam_test_pattern_new(void)
+{
+    akvcam_test_pattern_t self =
+            kzalloc(sizeof(struct akvcam_test_pattern), GFP_KERNEL);
+    kref_init(&self->ref);
+    self->pattern = AKVCAM_TEST_PATTERN_NOISE;
+    self->converter = akvcam_converter_new();
+    akvcam_converter_set_scaling_mode(self->converter,
+                                      AKVCAM_SCALING_MODE_FAST);
+    akvcam_converter_set_aspect_ratio_mode(self->converter,
+                                           AKVCAM_ASPECT_RATIO_MODE_IGNORE);
+    self->seed = AKVCAM_TEST_PATTERN_SEED;
+
+    return self;
+}
+
+static void akvcam_test_pattern_free(struct kref *ref)
+{
+    akvcam_test_pattern_t self =
+            container_of(ref, struct akvcam_test_pattern, ref);
+    akvcam_test_pattern_reset(self);
+    akvcam_converter_delete(self->converter);
+    kfree(self);
+}
+
+void akvcam_test_pattern_delete(akvcam_test_pattern_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_test_pattern_free);
+}
+
+akvcam_test_pattern_t akvcam_test_pattern_ref(akvcam_test_pattern_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+AKVCAM_TEST_PATTERN akvcam_test_pattern_pattern(akvcam_test_pattern_ct self)
+{
+    return self->pattern;
+}
+
+void akvcam_test_pattern_set_pattern(akvcam_test_pattern_t self,
+                                     AKVCAM_TEST_PATTERN pattern)
+{
+    if (self->pattern == pattern)
+        return;
+
+    self->pattern = pattern;
+    akvcam_test_pattern_reset(self);
+}
+
+bool akvcam_test_pattern_is_static(akvcam_test_pattern_ct self)
+{
+    return self->pattern == AKVCAM_TEST_PATTERN_BARS
+           || self->pattern == AKVCAM_TEST_PATTERN_GRADIENT;
+}
+
+akvcam_frame_t akvcam_test_pattern_frame(akvcam_test_pattern_t self,
+                                         akvcam_format_ct format)
+{
+    akvcam_frame_t frame;
+
+    if (!self->format || !akvcam_format_is_same_format(self->format, format)) {
+        akvcam_test_pattern_reset(self);
+        self->format = akvcam_format_new_copy(format);
+        akvcam_converter_set_output_format(self->converter, format);
+    }
+
+    switch (self->pattern) {
+    case AKVCAM_TEST_PATTERN_NOISE:
+        /* The frame is refilled in place, callers must release it before
+         * asking for the next one.
+         */
+        if (!self->frame)
+            self->frame = akvcam_frame_new(self->format);
+
+        akvcam_test_pattern_fill_noise(self, self->frame);
+        frame = akvcam_frame_ref(self->frame);
+
+        break;
+
+    case AKVCAM_TEST_PATTERN_BARS:
+    case AKVCAM_TEST_PATTERN_GRADIENT:
+        // Static patterns are rendered and converted once per format.
+        if (!self->frame) {
+            akvcam_frame_t background =
+                    akvcam_test_pattern_render_background(self);
+
+            akvcam_converter_begin(self->converter);
+            self->frame = akvcam_converter_convert(self->converter,
+                                                   background);
+            akvcam_converter_end(self->converter);
+            akvcam_frame_delete(background);
+        }
+
+        frame = akvcam_frame_ref(self->frame);
+
+        break;
+
+    default: {
+        akvcam_frame_t canvas;
+
+        if (!self->background)
+            self->background = akvcam_test_pattern_render_background(self);
+
+        canvas = akvcam_frame_new_copy(self->background);
+
+        if (self->pattern == AKVCAM_TEST_PATTERN_MOVING_BOX)
+            akvcam_test_pattern_draw_box(self, canvas);
+        else
+            akvcam_test_pattern_draw_counter(self, canvas);
+
+        akvcam_converter_begin(self->converter);
+        frame = akvcam_converter_convert(self->converter, canvas);
+        akvcam_converter_end(self->converter);
+        akvcam_frame_delete(canvas);
+
+        break;
+    }
+    }
+
+    self->frame_number++;
+
+    return frame;
+}
+
+AKVCAM_TEST_PATTERN akvcam_test_pattern_from_string(const char *str)
+{
+    size_t i;
+
+    if (str)
+        for (i = 0; i < ARRAY_SIZE(akvcam_test_pattern_strs); i++)
+            if (strcmp(akvcam_test_pattern_strs[i].str, str) == 0)
+                return akvcam_test_pattern_strs[i].pattern;
+
+    return AKVCAM_TEST_PATTERN_NOISE;
+}
+
+const char *akvcam_test_pattern_to_string(AKVCAM_TEST_PATTERN pattern)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(akvcam_test_pattern_strs); i++)
+        if (akvcam_test_pattern_strs[i].pattern == pattern)
+            return akvcam_test_pattern_strs[i].str;
+
+    return "";
+}
+
+void akvcam_test_pattern_reset(akvcam_test_pattern_t self)
+{
+    akvcam_frame_delete(self->frame);
+    self->frame = NULL;
+    akvcam_frame_delete(self->background);
+    self->background = NULL;
+    akvcam_format_delete(self->format);
+    self->format = NULL;
+    akvcam_converter_reset(self->converter);
+}
+
+akvcam_frame_t akvcam_test_pattern_render_background(akvcam_test_pattern_ct self)
+{
+    size_t width = akvcam_format_width(self->format);
+    size_t height = akvcam_format_height(self->format);
+    struct v4l2_fract frame_rate = akvcam_format_frame_rate(self->format);
+    akvcam_format_t format;
+    akvcam_frame_t frame;
+    size_t nbars = ARRAY_SIZE(akvcam_test_pattern_bars);
+    size_t x;
+    size_t y;
+
+    format = akvcam_format_new(V4L2_PIX_FMT_ARGB32,
+                               width,
+                               height,
+                               &frame_rate);
+    frame = akvcam_frame_new(format);
+    akvcam_format_delete(format);
+
+    if (width < 1 || height < 1)
+        return frame;
+
+    if (self->pattern == AKVCAM_TEST_PATTERN_GRADIENT
+        || self->pattern == AKVCAM_TEST_PATTERN_MOVING_BOX) {
+        for (y = 0; y < height; y++) {
+            uint8_t *line = akvcam_frame_line(frame, 0, y);
+            uint8_t g = (uint8_t) (255 * y / height);
+
+            for (x = 0; x < width; x++) {
+                uint8_t r = (uint8_t) (255 * x / width);
+
+                line[4 * x]     = 0xff;
+                line[4 * x + 1] = r;
+                line[4 * x + 2] = g;
+                line[4 * x + 3] = 255 - r;
+            }
+        }
+    } else {
+        for (x = 0; x < nbars; x++)
+            akvcam_test_pattern_fill_rect(frame,
+                                          (int) (x * width / nbars),
+                                          0,
+                                          (int) ((x + 1) * width / nbars
+                                                 - x * width / nbars),
+                                          (int) height,
+                                          akvcam_test_pattern_bars[x]);
+    }
+
+    return frame;
+}
+
+void akvcam_test_pattern_fill_rect(akvcam_frame_t frame,
+                                   int x,
+                                   int y,
+                                   int width,
+                                   int height,
+                                   uint32_t color)
+{
+    akvcam_format_t format = akvcam_frame_format_nr(frame);
+    int frame_width = (int) akvcam_format_width(format);
+    int frame_height = (int) akvcam_format_height(format);
+    int xmin = max(x, 0);
+    int ymin = max(y, 0);
+    int xmax = min(x + width, frame_width);
+    int ymax = min(y + height, frame_height);
+    uint8_t pixel[4] = {
+        (uint8_t) (color >> 24),
+        (uint8_t) (color >> 16),
+        (uint8_t) (color >> 8),
+        (uint8_t) color,
+    };
+    int i;
+    int j;
+
+    for (j = ymin; j < ymax; j++) {
+        uint8_t *line = akvcam_frame_line(frame, 0, (size_t) j);
+
+        for (i = xmin; i < xmax; i++)
+            memcpy(line + 4 * i, pixel, 4);
+    }
+}
+
+void akvcam_test_pattern_draw_box(akvcam_test_pattern_ct self,
+                                  akvcam_frame_t frame)
+{
+    int width = (int) akvcam_format_width(self->format);
+    int height = (int) akvcam_format_height(self->format);
+    int size = max(min(width, height) / 8, 2);
+    int xrange = max(width - size, 1);
+    int yrange = max(height - size, 1);
+    int x = (int) ((4 * self->frame_number) % (2 * (uint64_t) xrange));
+    int y = (int) ((3 * self->frame_number) % (2 * (uint64_t) yrange));
+
+    // Bounce against the frame borders.
+    if (x >= xrange)
+        x = 2 * xrange - x;
+
+    if (y >= yrange)
+        y = 2 * yrange - y;
+
+    akvcam_test_pattern_fill_rect(frame, x, y, size, size, 0xffffffff);
+}
+
+void akvcam_test_pattern_draw_counter(akvcam_test_pattern_ct self,
+                                      akvcam_frame_t frame)
+{
+    int height = (int) akvcam_format_height(self->format);
+    int scale = max(height / 60, 1);
+    char digits[24];
+    int ndigits;
+    int i;
+    int row;
+    int col;
+
+    ndigits = snprintf(digits,
+                       sizeof(digits),
+                       "%llu",
+                       (unsigned long long) self->frame_number);
+    akvcam_test_pattern_fill_rect(frame,
+                                  0,
+                                  0,
+                                  (4 * ndigits + 1) * scale,
+                                  7 * scale,
+                                  0xff000000);
+
+    for (i = 0; i < ndigits; i++) {
+        const uint8_t *glyph = akvcam_test_pattern_digits[digits[i] - '0'];
+
+        for (row = 0; row < 5; row++)
+            for (col = 0; col < 3; col++)
+                if (glyph[row] & (4 >> col))
+                    akvcam_test_pattern_fill_rect(frame,
+                                                  (4 * i + col + 1) * scale,
+                                                  (row + 1) * scale,
+                                                  scale,
+                                                  scale,
+                                                  0xffffffff);
+    }
+}
+
+void akvcam_test_pattern_fill_noise(akvcam_test_pattern_t self,
+                                    akvcam_frame_t frame)
+{
+    uint8_t *data = (uint8_t *) akvcam_frame_data(frame);
+    size_t size = akvcam_frame_size(frame);
+    uint64_t state = self->seed;
+    uint64_t value;
+    size_t i;
+
+    // xorshift64*, not cryptographically secure but fast.
+    for (i = 0; i < size; i += sizeof(uint64_t)) {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        value = state * 0x2545f4914f6cdd1dULL;
+        memcpy(data + i, &value, min(sizeof(uint64_t), size - i));
+    }
+
+    self->seed = state;
+}
@@ -0,0 +1,45 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_TEST_PATTERN_H
+#define AKVCAM_TEST_PATTERN_H
+
+#include <linux/types.h>
+
+#include "test_pattern_types.h"
+#include "format_types.h"
+#include "frame_types.h"
+
+// public
+akvcam_test_pattern_t akvcam_test_pattern_new(void);
+void akvcam_test_pattern_delete(akvcam_test_pattern_t self);
+akvcam_test_pattern_t akvcam_test_pattern_ref(akvcam_test_pattern_t self);
+
+AKVCAM_TEST_PATTERN akvcam_test_pattern_pattern(akvcam_test_pattern_ct self);
+void akvcam_test_pattern_set_pattern(akvcam_test_pattern_t self,
+                                     AKVCAM_TEST_PATTERN pattern);
+bool akvcam_test_pattern_is_static(akvcam_test_pattern_ct self);
+akvcam_frame_t akvcam_test_pattern_frame(akvcam_test_pattern_t self,
+                                         akvcam_format_ct format);
+
+// public static
+AKVCAM_TEST_PATTERN akvcam_test_pattern_from_string(const char *str);
+const char *akvcam_test_pattern_to_string(AKVCAM_TEST_PATTERN pattern);
+
+#endif // AKVCAM_TEST_PATTERN_H
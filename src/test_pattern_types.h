@@ -0,0 +1,36 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef AKVCAM_TEST_PATTERN_TYPES_H
+#define AKVCAM_TEST_PATTERN_TYPES_H
+
+typedef enum
+{
+    AKVCAM_TEST_PATTERN_NOISE,
+    AKVCAM_TEST_PATTERN_BARS,
+    AKVCAM_TEST_PATTERN_GRADIENT,
+    AKVCAM_TEST_PATTERN_MOVING_BOX,
+    AKVCAM_TEST_PATTERN_COUNTER,
+} AKVCAM_TEST_PATTERN;
+
+struct akvcam_test_pattern;
+typedef struct akvcam_test_pattern *akvcam_test_pattern_t;
+typedef const struct akvcam_test_pattern *akvcam_test_pattern_ct;
+
+#endif // AKVCAM_TEST_PATTERN_TYPES_H
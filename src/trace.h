@@ -0,0 +1,131 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2026  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM akvcam
+
+#if !defined(AKVCAM_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define AKVCAM_TRACE_H
+
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(akvcam_buffer_class,
+    TP_PROTO(int device, u32 sequence, size_t bytes),
+    TP_ARGS(device, sequence, bytes),
+    TP_STRUCT__entry(
+        __field(int, device)
+        __field(u32, sequence)
+        __field(size_t, bytes)
+    ),
+    TP_fast_assign(
+        __entry->device = device;
+        __entry->sequence = sequence;
+        __entry->bytes = bytes;
+    ),
+    TP_printk("device=%d sequence=%u bytes=%zu",
+              __entry->device,
+              __entry->sequence,
+              __entry->bytes)
+);
+
+// A buffer was queued by the client, sequence is the buffer index.
+DEFINE_EVENT(akvcam_buffer_class, akvcam_buffer_queue,
+    TP_PROTO(int device, u32 sequence, size_t bytes),
+    TP_ARGS(device, sequence, bytes)
+);
+
+DEFINE_EVENT(akvcam_buffer_class, akvcam_read_frame,
+    TP_PROTO(int device, u32 sequence, size_t bytes),
+    TP_ARGS(device, sequence, bytes)
+);
+
+DEFINE_EVENT(akvcam_buffer_class, akvcam_write_frame,
+    TP_PROTO(int device, u32 sequence, size_t bytes),
+    TP_ARGS(device, sequence, bytes)
+);
+
+DEFINE_EVENT(akvcam_buffer_class, akvcam_buffer_done,
+    TP_PROTO(int device, u32 sequence, size_t bytes),
+    TP_ARGS(device, sequence, bytes)
+);
+
+TRACE_EVENT(akvcam_frame_handoff,
+    TP_PROTO(int output, int capture, u64 sequence, size_t bytes),
+    TP_ARGS(output, capture, sequence, bytes),
+    TP_STRUCT__entry(
+        __field(int, output)
+        __field(int, capture)
+        __field(u64, sequence)
+        __field(size_t, bytes)
+    ),
+    TP_fast_assign(
+        __entry->output = output;
+        __entry->capture = capture;
+        __entry->sequence = sequence;
+        __entry->bytes = bytes;
+    ),
+    TP_printk("output=%d capture=%d sequence=%llu bytes=%zu",
+              __entry->output,
+              __entry->capture,
+              __entry->sequence,
+              __entry->bytes)
+);
+
+DECLARE_EVENT_CLASS(akvcam_stage_class,
+    TP_PROTO(int device, size_t bytes),
+    TP_ARGS(device, bytes),
+    TP_STRUCT__entry(
+        __field(int, device)
+        __field(size_t, bytes)
+    ),
+    TP_fast_assign(
+        __entry->device = device;
+        __entry->bytes = bytes;
+    ),
+    TP_printk("device=%d bytes=%zu", __entry->device, __entry->bytes)
+);
+
+DEFINE_EVENT(akvcam_stage_class, akvcam_convert_start,
+    TP_PROTO(int device, size_t bytes),
+    TP_ARGS(device, bytes)
+);
+
+DEFINE_EVENT(akvcam_stage_class, akvcam_convert_end,
+    TP_PROTO(int device, size_t bytes),
+    TP_ARGS(device, bytes)
+);
+
+DEFINE_EVENT(akvcam_stage_class, akvcam_filter_start,
+    TP_PROTO(int device, size_t bytes),
+    TP_ARGS(device, bytes)
+);
+
+DEFINE_EVENT(akvcam_stage_class, akvcam_filter_end,
+    TP_PROTO(int device, size_t bytes),
+    TP_ARGS(device, bytes)
+);
+
+#endif // AKVCAM_TRACE_H
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE trace
+
+#include <trace/define_trace.h>